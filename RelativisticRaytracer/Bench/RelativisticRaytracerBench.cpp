@@ -0,0 +1,1106 @@
+// RelativisticRaytracerBench.cpp : Renders the canonical benchmark scenes from scripted cameras
+// and writes the timings as JSON so regressions can be tracked.
+//
+// Usage: RelativisticRaytracerBench [--out results.json] [--frames N] [--accumulate N]
+//                                   [--width W] [--height H] [--references dir] [--write-references]
+//                                   [--scene name] [--sampler-curves] [--curve-frames N] [--curve-reference N]
+//                                   [--foveation] [--sequence dir] [--wavefront] [--bvh-builders]
+//                                   [--scene-switch N] [--views N] [--environment] [--time-slice MS] [--hybrid]
+//                                   [--primary-cache]
+//
+// Without --scene every scene is run in its own child process, so no scene's timings are affected
+// by the buffers and caches an earlier one left behind. Images are compared against <references>/<scene>.png when present.
+// Mrays/s counts camera samples (paths) per second, not individual bounce segments.
+// peakHostMb and peakGpuMb are the most MemoryTracker saw the engine hold over the whole run of the scene.
+// filterMs is the GPU time of the a-trous filter, single/filteredFrameRmse compare one frame
+// at full rays per pixel against the reference before and after filtering.
+// --sampler-curves adds the float RMSE of every sampler after 1, 2, 4 ... curve-frames accumulated
+// frames, measured against a curve-reference frame render with the PCG sampler from a sequence of its own.
+// legacy is the x * y seeded hash the tracer had before the samplers, kept as the baseline.
+// --foveation compares accumulate frames with and without foveation against the same reference,
+// with the error split between the focus regions and the periphery.
+// --sequence repeats the motion run while FrameWriter records it as png, exr and pfm into dir,
+// msPerFrame next to baselineMsPerFrame shows whether the render loop was held up by writing.
+// --wavefront repeats the motion run on the compute tracer with and without ray binning, the node
+// cache hit rate is simulated per workgroup in a separate run, see wavefront_trace.comp.
+// --bvh-builders times the CPU and GPU BVH builders on spheres of 100k and 1M triangles instead of
+// running the scenes, each build in its own process. The GPU time waits for the build to finish
+// but leaves out reading the hierarchy back, which is reported on its own.
+// --scene-switch loads every scene in turn N times over in a single process through ResetScene
+// instead of running them, the first round allocates and later ones reuse the pooled buffers.
+// switchMs runs from the reset to the first frame of the new scene, models loaded from disk included.
+// --views renders N viewpoints spread around the orbit back to back, each in its own render context
+// over the one copy of the scene, msPerViewFrame is the time per frame of a single view.
+// --environment swaps in a sky with a small bright sun and compares analytic misses against the baked sky
+// with sun and sky sampling, as RMSE curves like --sampler-curves, accumulation time per frame and the time
+// per frame of a camera looking up past the scene, where every primary ray misses.
+// --time-slice accumulates frames at full quality from a still camera, whole and then split into bands
+// held to MS per display frame, reporting the display frame times next to the time per accumulated frame.
+// --hybrid repeats the motion and accumulation runs with primary hits read from the rasterized models, savedMs is
+// the tracing time the hybrid frames no longer spend, the frame time saved with rasterMs added back, and rmse
+// compares accumulated images of both against each other.
+// --primary-cache accumulates frames from a still camera with and without the primary ray cache, speedup is the
+// uncached time per accumulated frame over the cached one and rmse compares the accumulated images of both.
+
+#include "../Graphics/TracingEngine.h"
+#include "../Graphics/Profiler.h"
+#include "../Graphics/FrameWriter.h"
+#include "../Graphics/WavefrontTracer.h"
+
+#include <raymath.h>
+#include <raylib.h>
+#include <rlgl.h>
+#include <external/glad.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+
+struct BenchSettings
+{
+	std::string outPath = "bench_results.json";
+	std::string referenceDir = "bench_references";
+	std::string scene;
+	int width = 1024;
+	int height = 512;
+	int motionFrames = 120;
+	int accumulateFrames = 64;
+	int referenceFrames = 2048;
+	int maxBounces = 7;
+	int raysPerPixel = 10;
+	bool writeReferences = false;
+	bool samplerCurves = false;
+	int curveFrames = 64;
+	int curveReferenceFrames = 512;
+	bool foveation = false;
+	std::string sequenceDir;
+	bool wavefront = false;
+	bool bvhBuilders = false;
+	// set on the child processes --bvh-builders starts
+	std::string bvhBuilder;
+	int bvhTriangles = 0;
+	int sceneSwitchRounds = 0;
+	int views = 0;
+	bool environment = false;
+	float timeSliceMs = 0;
+	bool hybrid = false;
+	bool primaryCache = false;
+};
+
+struct BenchScene
+{
+	const char* name;
+	void (*build)(std::vector<Model>* models);
+	Vector3 target;
+	float orbitRadius;
+	float orbitHeight;
+};
+
+struct BenchResult
+{
+	std::string scene;
+	int triangles = 0;
+	double bvhBuildMs = 0;
+	double uploadMs = 0;
+	double motionMsPerFrame = 0;
+	double motionMrays = 0;
+	double accumulateMsPerFrame = 0;
+	double accumulateMrays = 0;
+	double imageRmse = -1;
+	double filterMs = 0;
+	double singleFrameRmse = -1;
+	double filteredFrameRmse = -1;
+	double peakHostMb = 0;
+	double peakGpuMb = 0;
+	std::string samplerCurves;
+	std::string foveation;
+	std::string sequence;
+	std::string wavefront;
+	std::string views;
+	std::string environment;
+	std::string timeSlicing;
+	std::string hybrid;
+	std::string primaryCache;
+};
+
+static RaytracingMaterial white = { Vector4(1,1,1,1), Vector4(0,0,0,0), Vector4(0,0,0,0) };
+static RaytracingMaterial pink = { Vector4(1,0.6f,0.6f,0), Vector4(0,0,0,0), Vector4(0,0,0,0) };
+static RaytracingMaterial light = { Vector4(1,0.6f,0.6f,1), Vector4(1,0.8,0.6,1.5), Vector4(0,0,0,0) };
+static RaytracingMaterial metal = { Vector4(1,1,1,1), Vector4(0,0,0,0), Vector4(0,1,0,0) };
+
+static void UploadModel(std::vector<Model>* models, Model model, RaytracingMaterial material, int bvhDepth)
+{
+	bool indexed = model.meshCount > 0 && model.meshes[0].indices != NULL;
+	TracingEngine::UploadRaylibModel(model, material, indexed, bvhDepth);
+	models->push_back(model);
+}
+
+static Model LoadRing()
+{
+	Model ring = LoadModelFromMesh(GenMeshTorus(1, 4.0f, 16, 32));
+	ring.transform = MatrixScale(1, 1, 0.1f) * MatrixRotateX(PI / 2) * MatrixTranslate(0, 5, 0);
+	return ring;
+}
+
+static void BuildMonkey(std::vector<Model>* models)
+{
+	Model model = LoadModel("resources/meshes/monkey.obj");
+	model.transform = MatrixTranslate(0, 3, 0);
+	UploadModel(models, model, pink, 8);
+}
+
+static void BuildDragon(std::vector<Model>* models)
+{
+	Model model = LoadModel("resources/meshes/stanford_dragon.glb");
+	model.transform = MatrixScale(0.05f, 0.05f, 0.05f);
+	UploadModel(models, model, white, 12);
+}
+
+static void BuildTorusRing(std::vector<Model>* models)
+{
+	TracingEngine::gravityBodies.push_back({ {0,5,0,10} });
+	UploadModel(models, LoadRing(), light, 10);
+}
+
+// a grid of small spheres over the floor, enough that the sphere hierarchy is what the rays spend their time in
+static void BuildManySpheres(std::vector<Model>* models)
+{
+	const int gridSize = 32;
+	const float spacing = 0.6f;
+
+	for (int z = 0; z < gridSize; z++)
+	{
+		for (int x = 0; x < gridSize; x++)
+		{
+			Vector3 center = Vector3((x - (gridSize - 1) * 0.5f) * spacing, 0.25f, (z - (gridSize - 1) * 0.5f) * spacing);
+			TracingEngine::spheres.push_back({ center, 0.25f, (x + z) % 2 ? metal : light });
+		}
+	}
+
+	Model floor = LoadModelFromMesh(GenMeshPlane(20, 20, 1, 1));
+	UploadModel(models, floor, white, 1);
+}
+
+static void BuildGravityBodies(std::vector<Model>* models)
+{
+	TracingEngine::gravityBodies.push_back({ {-3,5,0,10} });
+	TracingEngine::gravityBodies.push_back({ {3,5,0,10} });
+	TracingEngine::gravityBodies.push_back({ {0,5,4,10} });
+
+	BuildMonkey(models);
+	UploadModel(models, LoadRing(), light, 10);
+}
+
+// accretion disk debris, enough spheres that testing each one per ray would dominate the frame
+static void BuildDebrisDisk(std::vector<Model>* models)
+{
+	TracingEngine::gravityBodies.push_back({ {0,2,0,10} });
+
+	for (int i = 0; i < 20000; i++)
+	{
+		// golden angle and ratio sequences rather than a random generator, so every run sees the same disk
+		float angle = i * 2.39996323f;
+		float radius = 3 + 9 * sqrtf((i * 0.618034f) - floorf(i * 0.618034f));
+		float height = 2 + 0.3f * sinf(i * 12.9898f);
+		float size = 0.03f + 0.05f * ((i * 7) % 11) / 10.0f;
+
+		TracingEngine::spheres.push_back({ Vector3(cosf(angle) * radius, height, sinf(angle) * radius), size, i % 7 ? white : light });
+	}
+
+	Model floor = LoadModelFromMesh(GenMeshPlane(30, 30, 1, 1));
+	UploadModel(models, floor, white, 1);
+}
+
+static const BenchScene scenes[] =
+{
+	{ "monkey", BuildMonkey, Vector3(0, 3, 0), 8, 4 },
+	{ "dragon", BuildDragon, Vector3(0, 2.5f, 0), 10, 4 },
+	{ "torus_ring", BuildTorusRing, Vector3(0, 5, 0), 15, 8 },
+	{ "many_spheres", BuildManySpheres, Vector3(0, 1, 0), 10, 5 },
+	{ "gravity_bodies", BuildGravityBodies, Vector3(0, 4, 0), 16, 8 },
+	{ "debris_disk", BuildDebrisDisk, Vector3(0, 2, 0), 18, 7 },
+};
+
+// scripted path, one full orbit over the motion phase, frame 0 is also the accumulation viewpoint
+static Camera BenchCamera(const BenchScene* scene, int frame, int numFrames)
+{
+	float t = numFrames > 0 ? (float)frame / numFrames : 0;
+	float angle = t * 2 * PI;
+
+	Camera camera = Camera();
+	camera.position = scene->target + Vector3(cosf(angle) * scene->orbitRadius, scene->orbitHeight, sinf(angle) * scene->orbitRadius);
+	camera.target = scene->target;
+	camera.up = Vector3(0, 1, 0);
+	camera.fovy = 45;
+	camera.projection = CAMERA_PERSPECTIVE;
+	return camera;
+}
+
+// flushes raylib's batch and blocks until the GPU has run everything queued, so a timer read after it covers the frames
+static void WaitForGpu()
+{
+	rlDrawRenderBatchActive();
+	glFinish();
+}
+
+static double RenderFrames(const BenchScene* scene, int numFrames, bool moving)
+{
+	double start = GetTime();
+
+	for (int i = 0; i < numFrames; i++)
+	{
+		Camera camera = BenchCamera(scene, moving ? i : 0, numFrames);
+		TracingEngine::UploadData(&camera);
+		if (TracingEngine::Render(&camera)) FrameWriter::Capture(TracingEngine::GetPresentedTexture());
+	}
+
+	WaitForGpu();
+
+	return numFrames > 0 ? (GetTime() - start) * 1000.0 / numFrames : 0;
+}
+
+static double ImageRmse(Image a, Image b)
+{
+	if (a.width != b.width || a.height != b.height)
+	{
+		return -1;
+	}
+
+	Color* pixelsA = (Color*)a.data;
+	Color* pixelsB = (Color*)b.data;
+	double sum = 0;
+	int numPixels = a.width * a.height;
+
+	for (int i = 0; i < numPixels; i++)
+	{
+		double dr = (pixelsA[i].r - pixelsB[i].r) / 255.0;
+		double dg = (pixelsA[i].g - pixelsB[i].g) / 255.0;
+		double db = (pixelsA[i].b - pixelsB[i].b) / 255.0;
+		sum += dr * dr + dg * dg + db * db;
+	}
+
+	return sqrt(sum / (numPixels * 3.0));
+}
+
+static double FloatRmse(const std::vector<float>& a, const std::vector<float>& b)
+{
+	double sum = 0;
+
+	for (size_t i = 0; i < a.size(); i++)
+	{
+		double d = a[i] - b[i];
+		sum += d * d;
+	}
+
+	return a.empty() ? 0 : sqrt(sum / a.size());
+}
+
+static std::string MeasureSamplerCurves(const BenchScene* scene, const BenchSettings& settings)
+{
+	Camera camera = BenchCamera(scene, 0, 1);
+	Rectangle frame = Rectangle(0, 0, (float)settings.width, (float)settings.height);
+
+	std::vector<float> reference(settings.width * settings.height * 3);
+	std::vector<float> image(reference.size());
+
+	// far past any sample the curves reach, so the PCG curve does not replay the reference's own sequence
+	TracingEngine::GetContext()->samplerType = SAMPLER_PCG;
+	TracingEngine::GetContext()->sampleSeed = 1 << 24;
+	TracingEngine::RenderRegion(&camera, frame, settings.curveReferenceFrames);
+	TracingEngine::ReadRegion(frame, reference.data());
+	TracingEngine::GetContext()->sampleSeed = 0;
+
+	std::string json = "{";
+
+	for (int sampler = 0; sampler < SAMPLER_COUNT; sampler++)
+	{
+		TracingEngine::GetContext()->samplerType = sampler;
+		json += TextFormat("%s\"%s\": [", sampler > 0 ? ", " : " ", Sampler::GetName(sampler));
+
+		for (int frames = 1; frames <= settings.curveFrames; frames *= 2)
+		{
+			TracingEngine::RenderRegion(&camera, frame, frames);
+			TracingEngine::ReadRegion(frame, image.data());
+			json += TextFormat("%s{ \"frames\": %i, \"rmse\": %.6f }", frames > 1 ? ", " : " ", frames, FloatRmse(image, reference));
+		}
+
+		json += " ]";
+	}
+
+	return json + " }";
+}
+
+static std::string MeasureFoveation(const BenchScene* scene, const BenchSettings& settings)
+{
+	Camera camera = BenchCamera(scene, 0, 1);
+	Rectangle frame = Rectangle(0, 0, (float)settings.width, (float)settings.height);
+	int numPixels = settings.width * settings.height;
+
+	std::vector<float> reference(numPixels * 3);
+	std::vector<float> image(reference.size());
+	std::vector<int> focus(numPixels);
+
+	TracingEngine::GetContext()->foveation = false;
+	TracingEngine::RenderRegion(&camera, frame, settings.curveReferenceFrames);
+	TracingEngine::ReadRegion(frame, reference.data());
+
+	std::string json = "{";
+
+	for (int foveated = 1; foveated >= 0; foveated--)
+	{
+		TracingEngine::GetContext()->foveation = foveated;
+
+		// reading back waits for the GPU, so this covers the tracing
+		double start = GetTime();
+		TracingEngine::RenderRegion(&camera, frame, settings.accumulateFrames);
+		TracingEngine::ReadRegion(frame, image.data());
+		double msPerFrame = (GetTime() - start) * 1000.0 / settings.accumulateFrames;
+
+		// UploadData projected the regions for this camera, both runs use the foveated run's mask
+		if (foveated)
+		{
+			for (int i = 0; i < numPixels; i++)
+			{
+				focus[i] = TracingEngine::GetSampleRate(Vector2((float)(i % settings.width), (float)(i / settings.width))) >= 0.999f;
+			}
+		}
+
+		double sums[2] = { 0, 0 };
+		int counts[2] = { 0, 0 };
+
+		for (int i = 0; i < numPixels * 3; i++)
+		{
+			double d = image[i] - reference[i];
+			sums[focus[i / 3]] += d * d;
+			counts[focus[i / 3]]++;
+		}
+
+		const char* name = foveated ? "foveated" : "full";
+		json += TextFormat("%s\"%s\": { \"raysPerFrame\": %.0f, \"msPerFrame\": %.3f, \"focusRmse\": %.6f, \"peripheryRmse\": %.6f }",
+			foveated ? " " : ", ", name, TracingEngine::GetExpectedRays(), msPerFrame,
+			counts[1] > 0 ? sqrt(sums[1] / counts[1]) : 0, counts[0] > 0 ? sqrt(sums[0] / counts[0]) : 0);
+	}
+
+	int focusPixels = 0;
+
+	for (int f : focus)
+	{
+		focusPixels += f;
+	}
+
+	TracingEngine::GetContext()->foveation = false;
+	return json + TextFormat(", \"focusFraction\": %.4f }", (double)focusPixels / numPixels);
+}
+
+static std::string MeasureSequence(const BenchScene* scene, const BenchSettings& settings)
+{
+	double baselineMs = RenderFrames(scene, settings.motionFrames, true);
+	std::string json = TextFormat("{ \"baselineMsPerFrame\": %.3f", baselineMs);
+
+	const char* formats[] = { "png", "exr", "pfm" };
+
+	for (const char* format : formats)
+	{
+		std::string pattern = TextFormat("%s/%s_%%05i.%s", settings.sequenceDir.c_str(), scene->name, format);
+
+		if (!FrameWriter::Begin(pattern.c_str(), settings.width, settings.height))
+		{
+			continue;
+		}
+
+		double msPerFrame = RenderFrames(scene, settings.motionFrames, true);
+		FrameWriter::End();
+
+		FrameWriterStats stats = FrameWriter::GetStats();
+		double seconds = stats.wallMs / 1000.0;
+
+		json += TextFormat(", \"%s\": { \"msPerFrame\": %.3f, \"writtenFramesPerSecond\": %.1f, \"mbPerSecond\": %.1f, \"encodeMsPerFrame\": %.2f, \"stalls\": %i }",
+			format, msPerFrame, stats.framesWritten / seconds, stats.bytesWritten / (1024.0 * 1024.0) / seconds,
+			stats.framesWritten > 0 ? stats.encodeMs / stats.framesWritten : 0, stats.stalls);
+	}
+
+	return json + " }";
+}
+
+static std::string MeasureWavefront(const BenchScene* scene, const BenchSettings& settings)
+{
+	// the same one sample per pixel with a moving camera as motionMsPerFrame
+	TracingEngine::GetContext()->denoise = false;
+	WavefrontTracer::enabled = true;
+
+	std::string json = "{";
+	int statsFrames = std::max(settings.motionFrames / 8, 1);
+
+	for (int binned = 0; binned <= 1; binned++)
+	{
+		WavefrontTracer::binning = binned;
+		WavefrontTracer::cacheStats = false;
+
+		RenderFrames(scene, 4, true);
+		double msPerFrame = RenderFrames(scene, settings.motionFrames, true);
+
+		// reading the counters back every frame would distort the timing, so they get their own run
+		WavefrontTracer::cacheStats = true;
+		WavefrontTracer::ResetStats();
+		RenderFrames(scene, statsFrames, true);
+
+		WavefrontStats stats = WavefrontTracer::GetStats();
+		double hitRate = stats.nodeFetches > 0 ? (double)stats.nodeCacheHits / stats.nodeFetches : 0;
+
+		json += TextFormat("%s\"%s\": { \"msPerFrame\": %.3f, \"secondaryRaysPerFrame\": %.0f, \"nodeFetchesPerRay\": %.2f, \"nodeCacheHitRate\": %.4f }",
+			binned ? ", " : " ", binned ? "binned" : "unbinned", msPerFrame, (double)stats.rays / std::max(stats.frames, 1),
+			stats.rays > 0 ? (double)stats.nodeFetches / stats.rays : 0, hitRate);
+	}
+
+	WavefrontTracer::enabled = false;
+	WavefrontTracer::cacheStats = false;
+	return json + TextFormat(", \"binningMs\": %.3f }", Profiler::GetAverageMs("binning"));
+}
+
+static std::string MeasureViews(const BenchScene* scene, const BenchSettings& settings)
+{
+	Vector2 resolution = Vector2(settings.width, settings.height);
+	std::vector<RenderContext*> views = { TracingEngine::GetContext() };
+
+	// the other views start from the first one's settings
+	views[0]->denoise = true;
+
+	for (int i = 1; i < settings.views; i++)
+	{
+		views.push_back(TracingEngine::CreateContext(resolution, settings.maxBounces, settings.raysPerPixel, 0.001f));
+	}
+
+	double start = GetTime();
+
+	// interleaved a frame at a time, so every view has to pick its history up again each frame
+	for (int f = 0; f < settings.accumulateFrames; f++)
+	{
+		for (int i = 0; i < (int)views.size(); i++)
+		{
+			Camera camera = BenchCamera(scene, i, (int)views.size());
+			TracingEngine::UseContext(views[i]);
+			TracingEngine::UploadData(&camera);
+			TracingEngine::Render(&camera);
+		}
+	}
+
+	double msPerViewFrame = (GetTime() - start) * 1000.0 / (settings.accumulateFrames * views.size());
+
+	TracingEngine::UseContext(views[0]);
+
+	// measured while every view still has its targets
+	double targetMb = MemoryTracker::GetUsage(MEMORY_GPU_RENDER_TARGETS).bytes / (1024.0 * 1024.0) / views.size();
+
+	for (int i = 1; i < (int)views.size(); i++)
+	{
+		TracingEngine::DestroyContext(views[i]);
+	}
+
+	return TextFormat("{ \"views\": %i, \"msPerViewFrame\": %.3f, \"sharedGeometryMb\": %.2f, \"targetMbPerView\": %.2f }",
+		(int)views.size(), msPerViewFrame, ShaderBufferPool::GetAllocatedBytes() / (1024.0 * 1024.0), targetMb);
+}
+
+static std::string MeasureEnvironment(const BenchScene* scene, const BenchSettings& settings)
+{
+	Camera camera = BenchCamera(scene, 0, 1);
+	Rectangle frame = Rectangle(0, 0, (float)settings.width, (float)settings.height);
+
+	// away from the scene and up at the orbit's height over its radius
+	Camera skyCamera = camera;
+	skyCamera.target = camera.position + (camera.position - scene->target);
+
+	std::vector<float> reference(settings.width * settings.height * 3);
+	std::vector<float> image(reference.size());
+
+	// the scenes' sun is too broad to tell the two apart
+	SkyMaterial sky = TracingEngine::skyMaterial;
+	TracingEngine::SetSky(SkyMaterial{ Color(90, 150, 230, 255), Color(200, 220, 240, 255), DARKGRAY, Color(255, 240, 220, 255),
+		Vector3Normalize(Vector3(-0.5f, -1, -0.5f)), 2000, 400 });
+
+	// both converge to the same image, the sampled one gets there sooner
+	TracingEngine::environmentSampling = true;
+	TracingEngine::RenderRegion(&camera, frame, settings.curveReferenceFrames);
+	TracingEngine::ReadRegion(frame, reference.data());
+
+	std::string json = "{";
+
+	for (int sampled = 0; sampled <= 1; sampled++)
+	{
+		TracingEngine::environmentSampling = sampled;
+		json += TextFormat("%s\"%s\": { \"curve\": [", sampled ? ", " : " ", sampled ? "sampled" : "analytic");
+
+		for (int frames = 1; frames <= settings.curveFrames; frames *= 2)
+		{
+			TracingEngine::RenderRegion(&camera, frame, frames);
+			TracingEngine::ReadRegion(frame, image.data());
+			json += TextFormat("%s{ \"frames\": %i, \"rmse\": %.6f }", frames > 1 ? ", " : " ", frames, FloatRmse(image, reference));
+		}
+
+		RenderFrames(scene, 1, false);
+		TracingEngine::GetContext()->denoise = true;
+		double msPerFrame = RenderFrames(scene, settings.accumulateFrames, false);
+
+		// one sample per pixel, so the frame is mostly the miss shader
+		TracingEngine::GetContext()->denoise = false;
+		double start = GetTime();
+
+		for (int f = 0; f < settings.accumulateFrames; f++)
+		{
+			TracingEngine::UploadData(&skyCamera);
+			TracingEngine::Render(&skyCamera);
+		}
+
+		double missMsPerFrame = (GetTime() - start) * 1000.0 / std::max(settings.accumulateFrames, 1);
+
+		json += TextFormat(" ], \"msPerFrame\": %.3f, \"missMsPerFrame\": %.3f }", msPerFrame, missMsPerFrame);
+	}
+
+	TracingEngine::environmentSampling = true;
+	TracingEngine::SetSky(sky);
+	return json + " }";
+}
+
+static std::string MeasureTimeSlicing(const BenchScene* scene, const BenchSettings& settings)
+{
+	Camera camera = BenchCamera(scene, 0, 1);
+	std::string json = "{";
+
+	for (int sliced = 0; sliced <= 1; sliced++)
+	{
+		// without slicing the target would lower the quality instead
+		TracingEngine::GetContext()->targetFrameMs = sliced ? settings.timeSliceMs : 0;
+		TracingEngine::GetContext()->timeSlicing = sliced;
+		TracingEngine::GetContext()->denoise = true;
+
+		// the first frame restarts the accumulation, slicing only starts once the camera is still
+		TracingEngine::RenderRegion(&camera, Rectangle(0, 0, (float)settings.width, (float)settings.height), 1);
+		RenderFrames(scene, 1, false);
+
+		int startFrames = TracingEngine::GetAccumulatedFrames();
+		int displayFrames = 0;
+		double maxMs = 0;
+		double start = GetTime();
+
+		while (TracingEngine::GetAccumulatedFrames() - startFrames < settings.accumulateFrames)
+		{
+			double frameStart = GetTime();
+			TracingEngine::UploadData(&camera);
+			TracingEngine::Render(&camera);
+			// each display frame is held until the GPU finishes it, or the next one's time would include it
+			WaitForGpu();
+			maxMs = std::max(maxMs, (GetTime() - frameStart) * 1000.0);
+			displayFrames++;
+		}
+
+		double totalMs = (GetTime() - start) * 1000.0;
+
+		json += TextFormat("%s\"%s\": { \"displayMsPerFrame\": %.3f, \"maxDisplayMs\": %.3f, \"msPerAccumulatedFrame\": %.3f, \"displayFramesPerAccumulatedFrame\": %.2f }",
+			sliced ? ", " : " ", sliced ? "sliced" : "whole", totalMs / displayFrames, maxMs, totalMs / settings.accumulateFrames,
+			(double)displayFrames / settings.accumulateFrames);
+	}
+
+	TracingEngine::GetContext()->targetFrameMs = 0;
+	TracingEngine::GetContext()->timeSlicing = false;
+	return json + TextFormat(", \"budgetMs\": %.1f }", settings.timeSliceMs);
+}
+
+static std::string MeasureHybrid(const BenchScene* scene, const BenchSettings& settings)
+{
+	Camera camera = BenchCamera(scene, 0, 1);
+	Rectangle frame = Rectangle(0, 0, (float)settings.width, (float)settings.height);
+
+	std::vector<float> traced(settings.width * settings.height * 3);
+	std::vector<float> image(traced.size());
+
+	double motionMs[2];
+	double accumulateMs[2];
+
+	for (int hybrid = 0; hybrid <= 1; hybrid++)
+	{
+		TracingEngine::hybridFirstHit = hybrid;
+
+		TracingEngine::GetContext()->denoise = false;
+		RenderFrames(scene, 4, true);
+		motionMs[hybrid] = RenderFrames(scene, settings.motionFrames, true);
+
+		RenderFrames(scene, 1, false);
+		TracingEngine::GetContext()->denoise = true;
+		accumulateMs[hybrid] = RenderFrames(scene, settings.accumulateFrames, false);
+
+		TracingEngine::RenderRegion(&camera, frame, settings.accumulateFrames);
+		TracingEngine::ReadRegion(frame, hybrid ? image.data() : traced.data());
+	}
+
+	TracingEngine::hybridFirstHit = false;
+
+	// only the hybrid frames draw the raster, so its average is theirs alone
+	double rasterMs = Profiler::GetAverageMs("raster");
+
+	return TextFormat("{ \"motion\": { \"tracedMsPerFrame\": %.3f, \"hybridMsPerFrame\": %.3f, \"savedMs\": %.3f }, "
+		"\"accumulate\": { \"tracedMsPerFrame\": %.3f, \"hybridMsPerFrame\": %.3f, \"savedMs\": %.3f }, \"rasterMs\": %.3f, \"rmse\": %.6f }",
+		motionMs[0], motionMs[1], motionMs[0] - motionMs[1] + rasterMs, accumulateMs[0], accumulateMs[1], accumulateMs[0] - accumulateMs[1] + rasterMs,
+		rasterMs, FloatRmse(image, traced));
+}
+
+static std::string MeasurePrimaryCache(const BenchScene* scene, const BenchSettings& settings)
+{
+	Camera camera = BenchCamera(scene, 0, 1);
+	Rectangle frame = Rectangle(0, 0, (float)settings.width, (float)settings.height);
+
+	std::vector<float> traced(settings.width * settings.height * 3);
+	std::vector<float> image(traced.size());
+
+	double accumulateMs[2];
+
+	for (int cached = 0; cached <= 1; cached++)
+	{
+		TracingEngine::primaryCache = cached;
+
+		// the plain frame records the cache, every accumulated frame after it reads it
+		TracingEngine::GetContext()->denoise = false;
+		RenderFrames(scene, 1, false);
+		TracingEngine::GetContext()->denoise = true;
+		accumulateMs[cached] = RenderFrames(scene, settings.accumulateFrames, false);
+
+		TracingEngine::RenderRegion(&camera, frame, settings.accumulateFrames);
+		TracingEngine::ReadRegion(frame, cached ? image.data() : traced.data());
+	}
+
+	TracingEngine::primaryCache = false;
+
+	return TextFormat("{ \"tracedMsPerFrame\": %.3f, \"cachedMsPerFrame\": %.3f, \"speedup\": %.3f, \"rmse\": %.6f }",
+		accumulateMs[0], accumulateMs[1], accumulateMs[0] / accumulateMs[1], FloatRmse(image, traced));
+}
+
+static std::string MeasureBvhBuild(const BenchSettings& settings)
+{
+	SetConfigFlags(FLAG_WINDOW_HIDDEN);
+	InitWindow(settings.width, settings.height, "raylib raytracer bench");
+
+	TracingEngine::Initialize(Vector2(settings.width, settings.height), settings.maxBounces, settings.raysPerPixel, 0.001f);
+
+	bool gpu = settings.bvhBuilder == "gpu";
+	TracingEngine::bvhBuilder = gpu ? BVH_BUILDER_GPU : BVH_BUILDER_CPU;
+
+	// two triangles per quad of the parametric sphere
+	int segments = (int)sqrtf(settings.bvhTriangles / 2.0f);
+	Model sphere = LoadModelFromMesh(GenMeshSphere(1, segments, segments));
+
+	// about four triangles per leaf for the CPU builder, the GPU one always goes down to single triangles
+	int depth = (int)ceil(log2(std::max(settings.bvhTriangles / 4.0, 1.0)));
+
+	std::vector<Model> models;
+	UploadModel(&models, sphere, white, depth);
+	TracingEngine::UploadStaticData();
+
+	std::string json = TextFormat("{ \"builder\": \"%s\", \"triangles\": %i, \"buildMs\": %.3f, \"uploadMs\": %.3f, \"readbackMs\": %.3f }",
+		gpu ? "gpu" : "cpu", TracingEngine::GetTriangleCount(), TracingEngine::lastBVHBuildMs, TracingEngine::lastUploadMs,
+		gpu ? TracingEngine::lastBVHReadbackMs : 0.0);
+
+	UnloadModel(sphere);
+	TracingEngine::Unload();
+	CloseWindow();
+
+	return json;
+}
+
+static std::string MeasureSceneSwitching(const BenchSettings& settings)
+{
+	SetConfigFlags(FLAG_WINDOW_HIDDEN);
+	InitWindow(settings.width, settings.height, "raylib raytracer bench");
+	SetTargetFPS(0);
+
+	Vector2 resolution = Vector2(settings.width, settings.height);
+	TracingEngine::Initialize(resolution, settings.maxBounces, settings.raysPerPixel, 0.001f);
+	TracingEngine::skyMaterial = SkyMaterial{ DARKGRAY, DARKGRAY, DARKGRAY, DARKGRAY, Vector3(-0.5f, -1, -0.5f), 1, 0.5 };
+
+	std::vector<Model> models;
+	std::string json = "[";
+	bool first = true;
+
+	for (int round = 0; round < settings.sceneSwitchRounds; round++)
+	{
+		for (const BenchScene& scene : scenes)
+		{
+			double start = GetTime();
+
+			TracingEngine::ResetScene(resolution, settings.maxBounces, settings.raysPerPixel, 0.001f);
+
+			// the engine only forgets the models, they are still ours to unload
+			for (Model model : models)
+			{
+				UnloadModel(model);
+			}
+
+			models.clear();
+
+			scene.build(&models);
+			TracingEngine::UploadStaticData();
+			RenderFrames(&scene, 1, false);
+
+			double switchMs = (GetTime() - start) * 1000.0;
+
+			json += TextFormat("%s\n    { \"round\": %i, \"scene\": \"%s\", \"switchMs\": %.3f, \"resetMs\": %.3f, \"bvhBuildMs\": %.3f, \"uploadMs\": %.3f, \"bufferMb\": %.2f, \"pooledBuffers\": %i }",
+				first ? "" : ",", round, scene.name, switchMs, TracingEngine::lastSceneResetMs, TracingEngine::lastBVHBuildMs,
+				TracingEngine::lastUploadMs, ShaderBufferPool::GetAllocatedBytes() / (1024.0 * 1024.0), ShaderBufferPool::GetAvailableCount());
+			first = false;
+		}
+	}
+
+	for (Model model : models)
+	{
+		UnloadModel(model);
+	}
+
+	TracingEngine::Unload();
+	CloseWindow();
+
+	return json + "\n  ]";
+}
+
+static std::string ResultToJson(const BenchResult& result)
+{
+	std::string json = TextFormat("{ \"scene\": \"%s\", \"triangles\": %i, \"bvhBuildMs\": %.3f, \"uploadMs\": %.3f, "
+		"\"motionMsPerFrame\": %.3f, \"motionMraysPerSecond\": %.2f, "
+		"\"accumulateMsPerFrame\": %.3f, \"accumulateMraysPerSecond\": %.2f, \"imageRmse\": %.6f, "
+		"\"filterMs\": %.3f, \"singleFrameRmse\": %.6f, \"filteredFrameRmse\": %.6f, \"peakHostMb\": %.2f, \"peakGpuMb\": %.2f",
+		result.scene.c_str(), result.triangles, result.bvhBuildMs, result.uploadMs,
+		result.motionMsPerFrame, result.motionMrays, result.accumulateMsPerFrame, result.accumulateMrays, result.imageRmse,
+		result.filterMs, result.singleFrameRmse, result.filteredFrameRmse, result.peakHostMb, result.peakGpuMb);
+
+	// TextFormat has a fixed size buffer, the curves are appended separately
+	if (!result.samplerCurves.empty())
+	{
+		json += ", \"samplerCurves\": " + result.samplerCurves;
+	}
+
+	if (!result.foveation.empty())
+	{
+		json += ", \"foveation\": " + result.foveation;
+	}
+
+	if (!result.sequence.empty())
+	{
+		json += ", \"sequence\": " + result.sequence;
+	}
+
+	if (!result.wavefront.empty())
+	{
+		json += ", \"wavefront\": " + result.wavefront;
+	}
+
+	if (!result.views.empty())
+	{
+		json += ", \"views\": " + result.views;
+	}
+
+	if (!result.environment.empty())
+	{
+		json += ", \"environment\": " + result.environment;
+	}
+
+	if (!result.timeSlicing.empty())
+	{
+		json += ", \"timeSlicing\": " + result.timeSlicing;
+	}
+
+	if (!result.hybrid.empty())
+	{
+		json += ", \"hybrid\": " + result.hybrid;
+	}
+
+	if (!result.primaryCache.empty())
+	{
+		json += ", \"primaryCache\": " + result.primaryCache;
+	}
+
+	return json + " }";
+}
+
+static BenchResult RunScene(const BenchScene* scene, const BenchSettings& settings)
+{
+	BenchResult result;
+	result.scene = scene->name;
+
+	SetConfigFlags(FLAG_WINDOW_HIDDEN);
+	InitWindow(settings.width, settings.height, "raylib raytracer bench");
+	SetTargetFPS(0);
+
+	TracingEngine::Initialize(Vector2(settings.width, settings.height), settings.maxBounces, settings.raysPerPixel, 0.001f);
+	TracingEngine::skyMaterial = SkyMaterial{ DARKGRAY, DARKGRAY, DARKGRAY, DARKGRAY, Vector3(-0.5f, -1, -0.5f), 1, 0.5 };
+
+	std::vector<Model> models;
+	scene->build(&models);
+
+	TracingEngine::UploadStaticData();
+
+	result.triangles = TracingEngine::GetTriangleCount();
+	result.bvhBuildMs = TracingEngine::lastBVHBuildMs;
+	result.uploadMs = TracingEngine::lastUploadMs;
+
+	double pixels = (double)settings.width * settings.height;
+
+	// interactive mode: one ray per pixel, camera moving every frame
+	TracingEngine::GetContext()->denoise = false;
+	RenderFrames(scene, 4, true);
+	result.motionMsPerFrame = RenderFrames(scene, settings.motionFrames, true);
+	result.motionMrays = result.motionMsPerFrame > 0 ? pixels / (result.motionMsPerFrame * 1000.0) : 0;
+
+	// progressive mode: static camera, full rays per pixel accumulated over frames,
+	// one plain frame first so the history the accumulation starts from is of the same view
+	RenderFrames(scene, 1, false);
+	TracingEngine::GetContext()->denoise = true;
+	result.accumulateMsPerFrame = RenderFrames(scene, settings.accumulateFrames, false);
+	result.accumulateMrays = result.accumulateMsPerFrame > 0 ? pixels * settings.raysPerPixel / (result.accumulateMsPerFrame * 1000.0) : 0;
+
+	result.filterMs = Profiler::GetAverageMs("filter");
+
+	Image image = TracingEngine::CaptureFrame();
+	std::string referencePath = TextFormat("%s/%s.png", settings.referenceDir.c_str(), scene->name);
+	Image reference = { 0 };
+
+	if (settings.writeReferences)
+	{
+		RenderFrames(scene, settings.referenceFrames, false);
+		reference = TracingEngine::CaptureFrame();
+		ExportImage(reference, referencePath.c_str());
+	}
+	else if (FileExists(referencePath.c_str()))
+	{
+		reference = LoadImage(referencePath.c_str());
+		ImageFormat(&reference, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8);
+	}
+
+	if (reference.data != NULL)
+	{
+		result.imageRmse = ImageRmse(image, reference);
+
+		// a single frame at full rays per pixel, as it comes out of the tracer and after the filter
+		Camera camera = BenchCamera(scene, 0, 1);
+		TracingEngine::RenderRegion(&camera, Rectangle(0, 0, (float)settings.width, (float)settings.height), 1);
+
+		Image single = TracingEngine::CaptureFrame();
+		Image filtered = TracingEngine::CaptureFrame(true);
+		result.singleFrameRmse = ImageRmse(single, reference);
+		result.filteredFrameRmse = ImageRmse(filtered, reference);
+		UnloadImage(single);
+		UnloadImage(filtered);
+
+		UnloadImage(reference);
+	}
+
+	UnloadImage(image);
+
+	if (settings.samplerCurves)
+	{
+		result.samplerCurves = MeasureSamplerCurves(scene, settings);
+	}
+
+	if (settings.foveation)
+	{
+		result.foveation = MeasureFoveation(scene, settings);
+	}
+
+	if (!settings.sequenceDir.empty())
+	{
+		result.sequence = MeasureSequence(scene, settings);
+	}
+
+	if (settings.wavefront)
+	{
+		result.wavefront = MeasureWavefront(scene, settings);
+	}
+
+	if (settings.views > 1)
+	{
+		result.views = MeasureViews(scene, settings);
+	}
+
+	if (settings.environment)
+	{
+		result.environment = MeasureEnvironment(scene, settings);
+	}
+
+	if (settings.timeSliceMs > 0)
+	{
+		result.timeSlicing = MeasureTimeSlicing(scene, settings);
+	}
+
+	if (settings.hybrid)
+	{
+		result.hybrid = MeasureHybrid(scene, settings);
+	}
+
+	if (settings.primaryCache)
+	{
+		result.primaryCache = MeasurePrimaryCache(scene, settings);
+	}
+
+	// every scene has a process to itself, so the peaks are this scene's
+	result.peakHostMb = MemoryTracker::GetPeakTotal(false) / (1024.0 * 1024.0);
+	result.peakGpuMb = MemoryTracker::GetPeakTotal(true) / (1024.0 * 1024.0);
+
+	for (Model model : models)
+	{
+		UnloadModel(model);
+	}
+
+	TracingEngine::Unload();
+	CloseWindow();
+
+	return result;
+}
+
+int main(int argc, char** argv)
+{
+	BenchSettings settings;
+
+	for (int i = 1; i < argc; i++)
+	{
+		bool hasValue = i + 1 < argc;
+
+		if (!strcmp(argv[i], "--out") && hasValue) settings.outPath = argv[++i];
+		else if (!strcmp(argv[i], "--scene") && hasValue) settings.scene = argv[++i];
+		else if (!strcmp(argv[i], "--frames") && hasValue) settings.motionFrames = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--accumulate") && hasValue) settings.accumulateFrames = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--width") && hasValue) settings.width = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--height") && hasValue) settings.height = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--references") && hasValue) settings.referenceDir = argv[++i];
+		else if (!strcmp(argv[i], "--write-references")) settings.writeReferences = true;
+		else if (!strcmp(argv[i], "--sampler-curves")) settings.samplerCurves = true;
+		else if (!strcmp(argv[i], "--curve-frames") && hasValue) settings.curveFrames = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--curve-reference") && hasValue) settings.curveReferenceFrames = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--foveation")) settings.foveation = true;
+		else if (!strcmp(argv[i], "--sequence") && hasValue) settings.sequenceDir = argv[++i];
+		else if (!strcmp(argv[i], "--wavefront")) settings.wavefront = true;
+		else if (!strcmp(argv[i], "--bvh-builders")) settings.bvhBuilders = true;
+		else if (!strcmp(argv[i], "--scene-switch") && hasValue) settings.sceneSwitchRounds = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--views") && hasValue) settings.views = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--environment")) settings.environment = true;
+		else if (!strcmp(argv[i], "--time-slice") && hasValue) settings.timeSliceMs = (float)atof(argv[++i]);
+		else if (!strcmp(argv[i], "--hybrid")) settings.hybrid = true;
+		else if (!strcmp(argv[i], "--primary-cache")) settings.primaryCache = true;
+		else if (!strcmp(argv[i], "--bvh-build") && i + 2 < argc)
+		{
+			settings.bvhBuilder = argv[++i];
+			settings.bvhTriangles = atoi(argv[++i]);
+		}
+	}
+
+	if (!settings.bvhBuilder.empty())
+	{
+		std::ofstream(settings.outPath) << MeasureBvhBuild(settings);
+		return 0;
+	}
+
+	if (settings.sceneSwitchRounds > 0)
+	{
+		std::ofstream(settings.outPath) << "{\n  \"sceneSwitches\": " << MeasureSceneSwitching(settings) << "\n}\n";
+		return 0;
+	}
+
+	if (settings.bvhBuilders)
+	{
+		const char* builders[] = { "cpu", "gpu" };
+		int sizes[] = { 100000, 1000000 };
+
+		std::stringstream json;
+		json << "{\n  \"bvhBuilds\": [\n";
+
+		bool first = true;
+
+		for (int size : sizes)
+		{
+			for (const char* builder : builders)
+			{
+				std::string buildPath = TextFormat("%s.%s_%i", settings.outPath.c_str(), builder, size);
+				std::string command = TextFormat("\"%s\" --bvh-build %s %i --out \"%s\"", argv[0], builder, size, buildPath.c_str());
+
+				if (std::system(command.c_str()) != 0)
+				{
+					TraceLog(LOG_WARNING, "BENCH: %s build of %i triangles failed", builder, size);
+					continue;
+				}
+
+				std::ifstream buildFile(buildPath);
+				std::stringstream buildJson;
+				buildJson << buildFile.rdbuf();
+				buildFile.close();
+				std::remove(buildPath.c_str());
+
+				json << (first ? "    " : ",\n    ") << buildJson.str();
+				first = false;
+
+				TraceLog(LOG_INFO, "BENCH: %s", buildJson.str().c_str());
+			}
+		}
+
+		json << "\n  ]\n}\n";
+		std::ofstream(settings.outPath) << json.str();
+
+		return 0;
+	}
+
+	if (!settings.scene.empty())
+	{
+		for (const BenchScene& scene : scenes)
+		{
+			if (settings.scene == scene.name)
+			{
+				std::ofstream(settings.outPath) << ResultToJson(RunScene(&scene, settings));
+				return 0;
+			}
+		}
+
+		TraceLog(LOG_ERROR, "BENCH: Unknown scene %s", settings.scene.c_str());
+		return 1;
+	}
+
+	// every scene runs in a child process, see the top of the file
+	std::string passThrough;
+
+	for (int i = 1; i < argc; i++)
+	{
+		passThrough += TextFormat(" \"%s\"", argv[i]);
+	}
+
+	std::stringstream json;
+	json << "{\n  \"width\": " << settings.width << ", \"height\": " << settings.height
+		<< ", \"raysPerPixel\": " << settings.raysPerPixel << ", \"maxBounces\": " << settings.maxBounces << ",\n  \"scenes\": [\n";
+
+	bool first = true;
+
+	for (const BenchScene& scene : scenes)
+	{
+		std::string scenePath = settings.outPath + "." + scene.name;
+		std::string command = TextFormat("\"%s\"%s --scene %s --out \"%s\"", argv[0], passThrough.c_str(), scene.name, scenePath.c_str());
+
+		if (std::system(command.c_str()) != 0)
+		{
+			TraceLog(LOG_WARNING, "BENCH: Scene %s failed", scene.name);
+			continue;
+		}
+
+		std::ifstream sceneFile(scenePath);
+		std::stringstream sceneJson;
+		sceneJson << sceneFile.rdbuf();
+		sceneFile.close();
+		std::remove(scenePath.c_str());
+
+		json << (first ? "    " : ",\n    ") << sceneJson.str();
+		first = false;
+
+		TraceLog(LOG_INFO, "BENCH: %s", sceneJson.str().c_str());
+	}
+
+	json << "\n  ]\n}\n";
+	std::ofstream(settings.outPath) << json.str();
+
+	return 0;
+}
@@ -0,0 +1,205 @@
+#include "DistributedRenderer.h"
+#include "TracingEngine.h"
+
+#include <thread>
+#include <chrono>
+#include <algorithm>
+
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#define popen _popen
+#define pclose _pclose
+#define PIPE_READ_MODE "rb"
+#else
+#define PIPE_READ_MODE "r"
+#endif
+
+std::vector<RenderTile> DistributedRenderer::SplitTiles(int width, int height, int tileSize, int workerIndex, int numWorkers)
+{
+	std::vector<RenderTile> tiles;
+	int index = 0;
+
+	for (int y = 0; y < height; y += tileSize)
+	{
+		for (int x = 0; x < width; x += tileSize)
+		{
+			if (index++ % numWorkers == workerIndex)
+			{
+				tiles.push_back({ x, y, std::min(tileSize, width - x), std::min(tileSize, height - y) });
+			}
+		}
+	}
+
+	return tiles;
+}
+
+bool DistributedRenderer::RunWorker(Camera* camera, int frames, int tileSize, int workerIndex, int numWorkers, double startupMs, FILE* out)
+{
+#ifdef _WIN32
+	_setmode(_fileno(out), _O_BINARY);
+#endif
+
+	Vector2 resolution = TracingEngine::GetResolution();
+	std::vector<RenderTile> tiles = SplitTiles((int)resolution.x, (int)resolution.y, tileSize, workerIndex, numWorkers);
+	std::vector<float> pixels;
+
+	for (const RenderTile& tile : tiles)
+	{
+		Rectangle region = Rectangle((float)tile.x, (float)tile.y, (float)tile.width, (float)tile.height);
+		pixels.resize(tile.width * tile.height * 3);
+
+		// reading the region back waits for the GPU, so the time covers the whole tile
+		double start = GetTime();
+		TracingEngine::RenderRegion(camera, region, frames);
+		TracingEngine::ReadRegion(region, pixels.data());
+		float ms = (float)((GetTime() - start) * 1000.0);
+
+		TileMessage message = { TILE_MESSAGE_MAGIC, TILE_MESSAGE_TILE, tile, frames, ms };
+
+		if (fwrite(&message, sizeof(message), 1, out) != 1 || fwrite(pixels.data(), sizeof(float), pixels.size(), out) != pixels.size())
+		{
+			return false;
+		}
+
+		fflush(out);
+	}
+
+	TileMessage done = { TILE_MESSAGE_MAGIC, TILE_MESSAGE_DONE, {}, frames, (float)startupMs };
+	bool written = fwrite(&done, sizeof(done), 1, out) == 1;
+	fflush(out);
+
+	return written;
+}
+
+bool DistributedRenderer::ReadWorker(FILE* pipe, int width, int height, float* image, WorkerReport* report)
+{
+	std::vector<float> pixels;
+	TileMessage message;
+
+	while (fread(&message, sizeof(message), 1, pipe) == 1)
+	{
+		if (message.magic != TILE_MESSAGE_MAGIC)
+		{
+			return false;
+		}
+
+		if (message.type == TILE_MESSAGE_DONE)
+		{
+			report->startupMs = message.ms;
+			return true;
+		}
+
+		RenderTile tile = message.tile;
+
+		if (tile.x < 0 || tile.y < 0 || tile.width <= 0 || tile.height <= 0 || tile.x + tile.width > width || tile.y + tile.height > height)
+		{
+			return false;
+		}
+
+		pixels.resize(tile.width * tile.height * 3);
+
+		if (fread(pixels.data(), sizeof(float), pixels.size(), pipe) != pixels.size())
+		{
+			return false;
+		}
+
+		// tiles never overlap, so workers can write into the shared image without locking
+		for (int row = 0; row < tile.height; row++)
+		{
+			std::copy_n(&pixels[row * tile.width * 3], tile.width * 3, &image[((tile.y + row) * width + tile.x) * 3]);
+		}
+
+		report->tiles++;
+		report->renderMs += message.ms;
+	}
+
+	// the worker exited before saying it was done
+	return false;
+}
+
+bool DistributedRenderer::RunCoordinator(const std::string& workerCommand, int width, int height, int numWorkers, std::vector<float>* image, DistributedResult* result)
+{
+	image->assign(width * height * 3, 0);
+	result->workers.assign(numWorkers, WorkerReport{});
+
+	// the coordinator has no window, so no raylib clock either
+	auto start = std::chrono::steady_clock::now();
+
+	std::vector<FILE*> pipes(numWorkers, nullptr);
+
+	for (int i = 0; i < numWorkers; i++)
+	{
+		std::string command = workerCommand + " --worker-index " + std::to_string(i);
+		pipes[i] = popen(command.c_str(), PIPE_READ_MODE);
+
+		if (pipes[i] == nullptr)
+		{
+			TraceLog(LOG_ERROR, "DISTRIBUTED: Failed to start worker %i", i);
+			result->workers[i].failed = true;
+		}
+	}
+
+	std::vector<std::thread> readers;
+
+	for (int i = 0; i < numWorkers; i++)
+	{
+		if (pipes[i] == nullptr)
+		{
+			continue;
+		}
+
+		readers.emplace_back([&, i]()
+			{
+				result->workers[i].failed = !ReadWorker(pipes[i], width, height, image->data(), &result->workers[i]);
+			});
+	}
+
+	for (std::thread& reader : readers)
+	{
+		reader.join();
+	}
+
+	for (int i = 0; i < numWorkers; i++)
+	{
+		if (pipes[i] != nullptr && pclose(pipes[i]) != 0)
+		{
+			result->workers[i].failed = true;
+		}
+	}
+
+	result->wallMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	double busyMs = 0;
+	bool ok = true;
+
+	for (int i = 0; i < numWorkers; i++)
+	{
+		WorkerReport* report = &result->workers[i];
+		busyMs += report->renderMs;
+		ok = ok && !report->failed;
+
+		TraceLog(report->failed ? LOG_ERROR : LOG_INFO, "DISTRIBUTED: Worker %i %s, %i tiles, %.0f ms startup, %.0f ms tracing",
+			i, report->failed ? "failed" : "finished", report->tiles, report->startupMs, report->renderMs);
+	}
+
+	result->efficiency = result->wallMs > 0 ? busyMs / (numWorkers * result->wallMs) : 0;
+
+	TraceLog(LOG_INFO, "DISTRIBUTED: %i workers, %.0f ms wall, %.0f%% of worker time spent tracing", numWorkers, result->wallMs, result->efficiency * 100);
+	return ok;
+}
+
+Image DistributedRenderer::ToImage(const std::vector<float>& image, int width, int height)
+{
+	Image result = GenImageColor(width, height, BLACK);
+	Color* pixels = (Color*)result.data;
+
+	for (int i = 0; i < width * height; i++)
+	{
+		pixels[i].r = (unsigned char)(std::clamp(image[i * 3 + 0], 0.0f, 1.0f) * 255.0f + 0.5f);
+		pixels[i].g = (unsigned char)(std::clamp(image[i * 3 + 1], 0.0f, 1.0f) * 255.0f + 0.5f);
+		pixels[i].b = (unsigned char)(std::clamp(image[i * 3 + 2], 0.0f, 1.0f) * 255.0f + 0.5f);
+	}
+
+	return result;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <raylib.h>
+
+// "RRTL" little endian
+#define TILE_MESSAGE_MAGIC 0x4C545252
+
+struct RenderTile
+{
+	int x;
+	int y;
+	int width;
+	int height;
+};
+
+enum TileMessageType
+{
+	TILE_MESSAGE_TILE,
+	TILE_MESSAGE_DONE
+};
+
+// written by workers before each tile's rgb floats, a done message carries the startup time instead
+struct TileMessage
+{
+	unsigned int magic;
+	int type;
+	RenderTile tile;
+	int frames;
+	float ms;
+};
+
+struct WorkerReport
+{
+	int tiles;
+	double startupMs;
+	double renderMs;
+	bool failed;
+};
+
+struct DistributedResult
+{
+	double wallMs;
+	std::vector<WorkerReport> workers;
+	// time workers spent tracing over the time they were available for it
+	double efficiency;
+};
+
+// splits offline frames into tiles that separate worker processes accumulate with their own GL context
+class DistributedRenderer
+{
+private:
+	static bool ReadWorker(FILE* pipe, int width, int height, float* image, WorkerReport* report);
+
+public:
+	// tiles are dealt out round robin so every worker gets a spread of cheap and expensive regions
+	static std::vector<RenderTile> SplitTiles(int width, int height, int tileSize, int workerIndex, int numWorkers);
+
+	// worker side, call once the scene is uploaded, streams each finished tile to out
+	static bool RunWorker(Camera* camera, int frames, int tileSize, int workerIndex, int numWorkers, double startupMs, FILE* out);
+
+	// coordinator side, needs no window, workerCommand gets " --worker-index i" appended for each worker
+	static bool RunCoordinator(const std::string& workerCommand, int width, int height, int numWorkers, std::vector<float>* image, DistributedResult* result);
+
+	static Image ToImage(const std::vector<float>& image, int width, int height);
+};
@@ -0,0 +1,155 @@
+#include "EnvironmentMap.h"
+
+#include <cmath>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+#include <raymath.h>
+#include <rlgl.h>
+
+#include "MemoryTracker.h"
+
+// keeps every bin drawable, so a dark part of the sky still has a pdf the escaped rays can be weighed against
+#define ENVIRONMENT_MIN_LUMINANCE_FRACTION 0.01
+// neither the sun nor the sky is ever sampled less often than this when both give off light
+#define ENVIRONMENT_MIN_STRATEGY_PROBABILITY 0.1
+
+static float Luminance(Vector3 color)
+{
+	return 0.2126f * color.x + 0.7152f * color.y + 0.0722f * color.z;
+}
+
+static float SmoothStep(float edge0, float edge1, float x)
+{
+	float t = std::clamp((x - edge0) / (edge1 - edge0), 0.0f, 1.0f);
+	return t * t * (3 - 2 * t);
+}
+
+Vector3 EnvironmentMap::SkyRadiance(const SkyMaterial& sky, float y)
+{
+	Vector4 zenith = TracingEngine::ColorToVector4(sky.skyColorZenith);
+	Vector4 horizon = TracingEngine::ColorToVector4(sky.skyColorHorizon);
+	Vector4 ground = TracingEngine::ColorToVector4(sky.groundColor);
+
+	float skyGradientT = powf(SmoothStep(0.0f, 0.4f, y), 0.35f);
+	Vector3 skyGradient = Vector3Lerp(Vector3(horizon.x, horizon.y, horizon.z), Vector3(zenith.x, zenith.y, zenith.z), skyGradientT);
+
+	float groundToSkyT = SmoothStep(-0.01f, 0.0f, y);
+	return Vector3Lerp(Vector3(ground.x, ground.y, ground.z), skyGradient, groundToSkyT);
+}
+
+double EnvironmentMap::SunPower(const SkyMaterial& sky)
+{
+	Vector4 color = TracingEngine::ColorToVector4(sky.sunColor);
+	double luminance = Luminance(Vector3(color.x, color.y, color.z));
+	double length = Vector3Length(sky.sunDirection);
+
+	if (luminance <= 0 || sky.sunIntensity <= 0 || length <= 0)
+	{
+		return 0;
+	}
+
+	// (length cos)^focus over the hemisphere around the sun, the horizon mask is ignored. the direction is not
+	// normalized, so the length's power goes through logs to stay finite with a sharp focus
+	double scale = std::exp(std::min(sky.sunFocus * std::log(length), 600.0));
+	return sky.sunIntensity * scale * 2 * PI / (sky.sunFocus + 1) * luminance;
+}
+
+void EnvironmentMap::Bake(const SkyMaterial& sky)
+{
+	if (texture.id != 0 && memcmp(&sky, &bakedSky, sizeof(SkyMaterial)) == 0)
+	{
+		return;
+	}
+
+	std::vector<float> texels((ENVIRONMENT_MAP_SIZE + 1) * 4);
+	std::vector<float> luminance(ENVIRONMENT_MAP_SIZE);
+	double skyPower = 0;
+	float maxLuminance = 0;
+
+	for (int i = 0; i < ENVIRONMENT_MAP_SIZE; i++)
+	{
+		float y = -1 + (i + 0.5f) * 2.0f / ENVIRONMENT_MAP_SIZE;
+		Vector3 radiance = SkyRadiance(sky, y);
+
+		texels[i * 4 + 0] = radiance.x;
+		texels[i * 4 + 1] = radiance.y;
+		texels[i * 4 + 2] = radiance.z;
+
+		luminance[i] = Luminance(radiance);
+		maxLuminance = std::max(maxLuminance, luminance[i]);
+		// every bin covers 2 / size of the height, and so 4 PI / size of the sphere
+		skyPower += luminance[i] * 4 * PI / ENVIRONMENT_MAP_SIZE;
+	}
+
+	float minLuminance = std::max(maxLuminance * (float)ENVIRONMENT_MIN_LUMINANCE_FRACTION, 1e-6f);
+	double total = 0;
+
+	for (int i = 0; i < ENVIRONMENT_MAP_SIZE; i++)
+	{
+		total += std::max(luminance[i], minLuminance);
+	}
+
+	double cdf = 0;
+
+	for (int i = 0; i < ENVIRONMENT_MAP_SIZE; i++)
+	{
+		texels[i * 4 + 3] = (float)(cdf / total);
+		cdf += std::max(luminance[i], minLuminance);
+	}
+
+	// clamped sampling past the top reads the last bin's sky
+	texels[ENVIRONMENT_MAP_SIZE * 4 + 0] = texels[(ENVIRONMENT_MAP_SIZE - 1) * 4 + 0];
+	texels[ENVIRONMENT_MAP_SIZE * 4 + 1] = texels[(ENVIRONMENT_MAP_SIZE - 1) * 4 + 1];
+	texels[ENVIRONMENT_MAP_SIZE * 4 + 2] = texels[(ENVIRONMENT_MAP_SIZE - 1) * 4 + 2];
+	texels[ENVIRONMENT_MAP_SIZE * 4 + 3] = 1;
+
+	double sunPower = SunPower(sky);
+
+	if (sunPower <= 0)
+	{
+		sunSampleProbability = 0;
+	}
+	else if (skyPower <= 0)
+	{
+		sunSampleProbability = 1;
+	}
+	else
+	{
+		sunSampleProbability = (float)std::clamp(sunPower / (sunPower + skyPower),
+			ENVIRONMENT_MIN_STRATEGY_PROBABILITY, 1 - ENVIRONMENT_MIN_STRATEGY_PROBABILITY);
+	}
+
+	if (texture.id == 0)
+	{
+		texture.id = rlLoadTexture(texels.data(), ENVIRONMENT_MAP_SIZE + 1, 1, PIXELFORMAT_UNCOMPRESSED_R32G32B32A32, 1);
+		texture.width = ENVIRONMENT_MAP_SIZE + 1;
+		texture.height = 1;
+		texture.format = PIXELFORMAT_UNCOMPRESSED_R32G32B32A32;
+		texture.mipmaps = 1;
+
+		// the sky is interpolated between bin centers, the CDF is only read with texelFetch
+		SetTextureFilter(texture, TEXTURE_FILTER_BILINEAR);
+		SetTextureWrap(texture, TEXTURE_WRAP_CLAMP);
+
+		MemoryTracker::Add(MEMORY_GPU_TEXTURES, MemoryTracker::TextureBytes(texture));
+	}
+	else
+	{
+		UpdateTexture(texture, texels.data());
+	}
+
+	bakedSky = sky;
+	TraceLog(LOG_INFO, "TRACING: Environment baked, sun sampled with probability %.2f", sunSampleProbability);
+}
+
+void EnvironmentMap::Unload()
+{
+	if (texture.id != 0)
+	{
+		MemoryTracker::Add(MEMORY_GPU_TEXTURES, -MemoryTracker::TextureBytes(texture));
+		UnloadTexture(texture);
+	}
+
+	texture = Texture2D{ 0 };
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <raylib.h>
+
+#include "TracingEngine.h"
+
+// bins over the elevation of the sky, matches ENVIRONMENT_MAP_SIZE in raytracer_common.glsl
+#define ENVIRONMENT_MAP_SIZE 1024
+
+// the sky without the sun baked for getEnvironmentLight, and the table sampleEnvironment draws directions from.
+// SkyMaterial only varies with elevation, so a row of bins over y holds all of it, an equirectangular map would
+// repeat the same row. the texture is size + 1 texels wide, rgb is the sky at each bin's center and alpha the
+// luminance CDF where the bin starts, the last texel closes the CDF at 1
+class EnvironmentMap
+{
+private:
+	inline static Texture2D texture = { 0 };
+	inline static SkyMaterial bakedSky;
+	inline static float sunSampleProbability = 0;
+
+	// same gradient as the analytic getEnvironmentLight, linear rgb
+	static Vector3 SkyRadiance(const SkyMaterial& sky, float y);
+	// integral of the sun's luminance over the sphere
+	static double SunPower(const SkyMaterial& sky);
+
+public:
+	// rebakes only when the sky differs from the one already in the texture
+	static void Bake(const SkyMaterial& sky);
+
+	static Texture2D GetTexture() { return texture; }
+	// share of the sun in the light sampleEnvironment draws, by power
+	static float GetSunSampleProbability() { return sunSampleProbability; }
+
+	static void Unload();
+};
@@ -0,0 +1,370 @@
+#include "FrameWriter.h"
+
+#include <rlgl.h>
+#include <external/glad.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+bool FrameWriter::Begin(const char* pattern, int width, int height, int firstFrame)
+{
+	if (recording)
+	{
+		End();
+	}
+
+	if (IsFileExtension(pattern, ".exr")) format = FRAME_EXR;
+	else if (IsFileExtension(pattern, ".pfm")) format = FRAME_PFM;
+	else if (IsFileExtension(pattern, ".png")) format = FRAME_PNG;
+	else
+	{
+		TraceLog(LOG_WARNING, "OUTPUT: %s is not a .png, .exr or .pfm pattern", pattern);
+		return false;
+	}
+
+	const char* directory = GetDirectoryPath(pattern);
+
+	if (directory[0] != '\0' && !DirectoryExists(directory))
+	{
+		MakeDirectory(directory);
+	}
+
+	FrameWriter::pattern = pattern;
+	FrameWriter::width = width;
+	FrameWriter::height = height;
+	frameNumber = firstFrame;
+	nextReadback = 0;
+	framesInFlight = 0;
+	stats = {};
+
+	for (Readback& readback : readbacks)
+	{
+		glGenBuffers(1, &readback.pbo);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.pbo);
+		glBufferData(GL_PIXEL_PACK_BUFFER, (GLsizeiptr)width * height * 4 * sizeof(float), nullptr, GL_STREAM_READ);
+		readback.fence = nullptr;
+		readback.pending = false;
+	}
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	encoders = std::make_unique<ThreadPool>();
+	recording = true;
+	startTime = GetTime();
+
+	TraceLog(LOG_INFO, "OUTPUT: Recording %ix%i frames to %s", width, height, pattern);
+
+	return true;
+}
+
+void FrameWriter::Capture(Texture2D texture)
+{
+	if (!recording)
+	{
+		return;
+	}
+
+	// the oldest readback has had FRAME_WRITER_BUFFERS - 1 frames to finish, usually this does not wait
+	Readback* readback = &readbacks[nextReadback];
+
+	if (readback->pending)
+	{
+		Collect(readback);
+	}
+
+	rlDrawRenderBatchActive();
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, readback->pbo);
+	glBindTexture(GL_TEXTURE_2D, texture.id);
+	glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_FLOAT, nullptr);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	readback->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	readback->frame = frameNumber++;
+	readback->pending = true;
+
+	nextReadback = (nextReadback + 1) % FRAME_WRITER_BUFFERS;
+}
+
+void FrameWriter::Collect(Readback* readback)
+{
+	bool stalled = false;
+	GLenum status = glClientWaitSync((GLsync)readback->fence, 0, 0);
+
+	if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+	{
+		stalled = true;
+		glClientWaitSync((GLsync)readback->fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull);
+	}
+
+	glDeleteSync((GLsync)readback->fence);
+	readback->fence = nullptr;
+	readback->pending = false;
+
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+
+		if (framesInFlight >= maxFramesInFlight)
+		{
+			stalled = true;
+			frameWritten.wait(lock, [] { return framesInFlight < maxFramesInFlight; });
+		}
+
+		stats.stalls += stalled;
+		framesInFlight++;
+	}
+
+	size_t size = (size_t)width * height * 4;
+	std::vector<float> rgba(size);
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, readback->pbo);
+	void* mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size * sizeof(float), GL_MAP_READ_BIT);
+
+	if (mapped != nullptr)
+	{
+		memcpy(rgba.data(), mapped, size * sizeof(float));
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	}
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	if (mapped == nullptr)
+	{
+		TraceLog(LOG_WARNING, "OUTPUT: Failed to map the readback of frame %i", readback->frame);
+
+		std::lock_guard<std::mutex> lock(mutex);
+		framesInFlight--;
+		return;
+	}
+
+	int frame = readback->frame;
+	encoders->Submit([frame, rgba = std::move(rgba)] { Encode(frame, rgba); });
+}
+
+void FrameWriter::Encode(int frame, const std::vector<float>& rgba)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	// TextFormat shares one buffer between threads
+	char path[1024];
+	snprintf(path, sizeof(path), pattern.c_str(), frame);
+
+	std::vector<unsigned char> file;
+
+	if (format == FRAME_PFM)
+	{
+		file = EncodePfm(rgba, width, height);
+	}
+	else if (format == FRAME_EXR)
+	{
+		file = EncodeExr(rgba, width, height);
+	}
+	else
+	{
+		// the same clamp the window applies, rows flipped since GL starts at the bottom
+		std::vector<unsigned char> rgb((size_t)width * height * 3);
+
+		for (int y = 0; y < height; y++)
+		{
+			const float* source = &rgba[(size_t)(height - 1 - y) * width * 4];
+			unsigned char* destination = &rgb[(size_t)y * width * 3];
+
+			for (int x = 0; x < width; x++)
+			{
+				for (int c = 0; c < 3; c++)
+				{
+					destination[x * 3 + c] = (unsigned char)(std::clamp(source[x * 4 + c], 0.0f, 1.0f) * 255.0f + 0.5f);
+				}
+			}
+		}
+
+		Image image = { rgb.data(), width, height, 1, PIXELFORMAT_UNCOMPRESSED_R8G8B8 };
+		int size = 0;
+		unsigned char* png = ExportImageToMemory(image, ".png", &size);
+
+		if (png != nullptr)
+		{
+			file.assign(png, png + size);
+			MemFree(png);
+		}
+	}
+
+	std::ofstream output(path, std::ios::binary);
+	output.write((const char*)file.data(), file.size());
+	bool written = !file.empty() && output.good();
+	output.close();
+
+	if (!written)
+	{
+		TraceLog(LOG_WARNING, "OUTPUT: Failed to write %s", path);
+	}
+
+	double encodeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	std::lock_guard<std::mutex> lock(mutex);
+	stats.framesWritten += written;
+	stats.bytesWritten += written ? file.size() : 0;
+	stats.encodeMs += encodeMs;
+	framesInFlight--;
+	frameWritten.notify_all();
+}
+
+std::vector<unsigned char> FrameWriter::EncodePfm(const std::vector<float>& rgba, int width, int height)
+{
+	// PFM rows go bottom to top like GL's, a negative scale marks little endian floats
+	char header[64];
+	int headerLength = snprintf(header, sizeof(header), "PF\n%i %i\n-1.0\n", width, height);
+	std::vector<unsigned char> file(header, header + headerLength);
+	size_t offset = file.size();
+	file.resize(offset + (size_t)width * height * 3 * sizeof(float));
+
+	float* rgb = (float*)(file.data() + offset);
+
+	for (size_t i = 0; i < (size_t)width * height; i++)
+	{
+		rgb[i * 3 + 0] = rgba[i * 4 + 0];
+		rgb[i * 3 + 1] = rgba[i * 4 + 1];
+		rgb[i * 3 + 2] = rgba[i * 4 + 2];
+	}
+
+	return file;
+}
+
+template<typename T>
+static void Append(std::vector<unsigned char>* file, T value)
+{
+	const unsigned char* bytes = (const unsigned char*)&value;
+	file->insert(file->end(), bytes, bytes + sizeof(T));
+}
+
+static void AppendString(std::vector<unsigned char>* file, const char* text)
+{
+	file->insert(file->end(), text, text + strlen(text) + 1);
+}
+
+static void AppendAttribute(std::vector<unsigned char>* file, const char* name, const char* type, int size)
+{
+	AppendString(file, name);
+	AppendString(file, type);
+	Append(file, size);
+}
+
+std::vector<unsigned char> FrameWriter::EncodeExr(const std::vector<float>& rgba, int width, int height)
+{
+	// uncompressed scanline OpenEXR with 32 bit float channels, so it is only a reshuffle of the readback
+	std::vector<unsigned char> file;
+	Append(&file, 20000630);
+	Append(&file, 2);
+
+	// channels are stored in alphabetical order
+	const char* channels[3] = { "B", "G", "R" };
+	AppendAttribute(&file, "channels", "chlist", 3 * 18 + 1);
+
+	for (const char* channel : channels)
+	{
+		AppendString(&file, channel);
+		// FLOAT, not linear, three reserved bytes, no subsampling
+		Append(&file, 2);
+		Append(&file, 0);
+		Append(&file, 1);
+		Append(&file, 1);
+	}
+
+	file.push_back(0);
+
+	int box[4] = { 0, 0, width - 1, height - 1 };
+
+	AppendAttribute(&file, "compression", "compression", 1);
+	file.push_back(0);
+	AppendAttribute(&file, "dataWindow", "box2i", sizeof(box));
+	for (int v : box) Append(&file, v);
+	AppendAttribute(&file, "displayWindow", "box2i", sizeof(box));
+	for (int v : box) Append(&file, v);
+	AppendAttribute(&file, "lineOrder", "lineOrder", 1);
+	file.push_back(0);
+	AppendAttribute(&file, "pixelAspectRatio", "float", 4);
+	Append(&file, 1.0f);
+	AppendAttribute(&file, "screenWindowCenter", "v2f", 8);
+	Append(&file, 0.0f);
+	Append(&file, 0.0f);
+	AppendAttribute(&file, "screenWindowWidth", "float", 4);
+	Append(&file, 1.0f);
+	file.push_back(0);
+
+	int lineBytes = width * 3 * (int)sizeof(float);
+	unsigned long long firstLine = file.size() + (size_t)height * sizeof(unsigned long long);
+
+	for (int y = 0; y < height; y++)
+	{
+		Append(&file, firstLine + (unsigned long long)y * (8 + lineBytes));
+	}
+
+	file.reserve(file.size() + (size_t)height * (8 + lineBytes));
+
+	for (int y = 0; y < height; y++)
+	{
+		Append(&file, y);
+		Append(&file, lineBytes);
+
+		// EXR counts lines from the top
+		const float* row = &rgba[(size_t)(height - 1 - y) * width * 4];
+
+		for (int c = 2; c >= 0; c--)
+		{
+			for (int x = 0; x < width; x++)
+			{
+				Append(&file, row[x * 4 + c]);
+			}
+		}
+	}
+
+	return file;
+}
+
+void FrameWriter::End()
+{
+	if (!recording)
+	{
+		return;
+	}
+
+	// oldest first, so frames reach the encoders in order
+	for (int i = 0; i < FRAME_WRITER_BUFFERS; i++)
+	{
+		Readback* readback = &readbacks[(nextReadback + i) % FRAME_WRITER_BUFFERS];
+
+		if (readback->pending)
+		{
+			Collect(readback);
+		}
+	}
+
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		frameWritten.wait(lock, [] { return framesInFlight == 0; });
+		stats.wallMs = (GetTime() - startTime) * 1000.0;
+	}
+
+	encoders.reset();
+
+	for (Readback& readback : readbacks)
+	{
+		glDeleteBuffers(1, &readback.pbo);
+	}
+
+	recording = false;
+
+	double seconds = stats.wallMs / 1000.0;
+	TraceLog(LOG_INFO, "OUTPUT: Wrote %i frames, %.1f frames/s, %.1f MB/s, %.1f ms encoding per frame, %i stalls", stats.framesWritten,
+		stats.framesWritten / seconds, stats.bytesWritten / (1024.0 * 1024.0) / seconds,
+		stats.framesWritten > 0 ? stats.encodeMs / stats.framesWritten : 0, stats.stalls);
+}
+
+FrameWriterStats FrameWriter::GetStats()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return stats;
+}
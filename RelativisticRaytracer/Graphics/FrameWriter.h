@@ -0,0 +1,83 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <raylib.h>
+
+#include "ThreadPool.h"
+
+// readbacks in flight, a frame is mapped this many captures after it was issued
+#define FRAME_WRITER_BUFFERS 3
+
+enum FrameFormat
+{
+	FRAME_PNG,
+	FRAME_EXR,
+	FRAME_PFM
+};
+
+struct FrameWriterStats
+{
+	int framesWritten;
+	// captures that had to wait, for a readback still on the GPU or for the encoders to catch up
+	int stalls;
+	double bytesWritten;
+	// summed over all frames, spent on the encoder threads
+	double encodeMs;
+	// from Begin until the last frame was on disk
+	double wallMs;
+};
+
+// writes numbered frames to disk without stalling the render loop, each capture is copied into a
+// pixel buffer on the GPU and only mapped a few frames later, encoding runs on its own thread pool
+class FrameWriter
+{
+private:
+	struct Readback
+	{
+		unsigned int pbo;
+		void* fence;
+		int frame;
+		bool pending;
+	};
+
+	inline static Readback readbacks[FRAME_WRITER_BUFFERS];
+	inline static int nextReadback = 0;
+	inline static std::string pattern;
+	inline static int format = FRAME_PNG;
+	inline static int width = 0;
+	inline static int height = 0;
+	inline static int frameNumber = 0;
+	inline static bool recording = false;
+	inline static double startTime = 0;
+
+	inline static std::unique_ptr<ThreadPool> encoders;
+	inline static std::mutex mutex;
+	inline static std::condition_variable frameWritten;
+	inline static int framesInFlight = 0;
+	inline static FrameWriterStats stats;
+
+	static void Collect(Readback* readback);
+	static void Encode(int frame, const std::vector<float>& rgba);
+
+	static std::vector<unsigned char> EncodePfm(const std::vector<float>& rgba, int width, int height);
+	static std::vector<unsigned char> EncodeExr(const std::vector<float>& rgba, int width, int height);
+
+public:
+	// frames waiting to be encoded before Capture blocks, bounds the memory a slow disk can take
+	inline static int maxFramesInFlight = 8;
+
+	// pattern is a printf format for the frame number, such as frames/frame_%05d.exr,
+	// the extension picks the format, png is clamped to 8 bits while exr and pfm keep linear floats
+	static bool Begin(const char* pattern, int width, int height, int firstFrame = 0);
+	// texture has to be width by height with float rgba texels
+	static void Capture(Texture2D texture);
+	// writes out every captured frame and waits for them to be on disk
+	static void End();
+
+	static bool IsRecording() { return recording; }
+	static FrameWriterStats GetStats();
+};
@@ -0,0 +1,230 @@
+#include "GpuBVHBuilder.h"
+
+#include <string>
+#include <rlgl.h>
+#include <external/glad.h>
+
+#include "ShaderCache.h"
+#include "TracingEngine.h"
+#include "MemoryTracker.h"
+
+std::vector<std::string> GpuBVHBuilder::GetSources()
+{
+	const char* stages[LBVH_STAGE_COUNT] = { "LBVH_BOUNDS", "LBVH_MORTON", "LBVH_SORT_COUNT", "LBVH_SORT_SCAN",
+		"LBVH_SORT_SCATTER", "LBVH_HIERARCHY", "LBVH_REDUCE" };
+
+	std::string source = ShaderCache::LoadSource("resources/shaders/lbvh.comp");
+	std::vector<std::string> sources;
+
+	for (const char* stage : stages)
+	{
+		sources.push_back(ShaderCache::InsertDefines(source, std::string("#define ") + stage + "\n"));
+	}
+
+	return sources;
+}
+
+bool GpuBVHBuilder::Load()
+{
+	std::vector<unsigned int> built;
+
+	for (const std::string& source : GetSources())
+	{
+		unsigned int shader = rlCompileShader(source.c_str(), RL_COMPUTE_SHADER);
+		unsigned int program = shader != 0 ? rlLoadComputeShaderProgram(shader) : 0;
+
+		if (shader != 0)
+		{
+			glDeleteShader(shader);
+		}
+
+		if (program == 0)
+		{
+			for (unsigned int other : built)
+			{
+				rlUnloadShaderProgram(other);
+			}
+
+			TraceLog(LOG_WARNING, "TRACING: LBVH build shaders failed to build");
+			return false;
+		}
+
+		built.push_back(program);
+	}
+
+	SetPrograms(built);
+	return true;
+}
+
+void GpuBVHBuilder::SetPrograms(const std::vector<unsigned int>& built)
+{
+	UnloadPrograms();
+
+	for (int i = 0; i < LBVH_STAGE_COUNT; i++)
+	{
+		programs[i] = ShaderCache::FromProgram(built[i]);
+	}
+
+	loaded = true;
+}
+
+void GpuBVHBuilder::UnloadPrograms()
+{
+	for (Shader& program : programs)
+	{
+		if (program.id != 0)
+		{
+			UnloadShader(program);
+		}
+
+		program = Shader{ 0 };
+	}
+
+	loaded = false;
+}
+
+void GpuBVHBuilder::Reserve(int numTriangles)
+{
+	if (numTriangles <= capacity)
+	{
+		return;
+	}
+
+	int* buffers[] = { &pairSSBOs[0], &pairSSBOs[1], &buildNodesSSBO, &sortedTrianglesSSBO, &stateSSBO };
+
+	for (int* buffer : buffers)
+	{
+		if (*buffer != 0)
+		{
+			rlUnloadShaderBuffer(*buffer);
+		}
+	}
+
+	unsigned int groups = (numTriangles + LBVH_GROUP_SIZE - 1) / LBVH_GROUP_SIZE;
+
+	pairSSBOs[0] = rlLoadShaderBuffer(numTriangles * 2 * sizeof(unsigned int), NULL, RL_DYNAMIC_COPY);
+	pairSSBOs[1] = rlLoadShaderBuffer(numTriangles * 2 * sizeof(unsigned int), NULL, RL_DYNAMIC_COPY);
+	buildNodesSSBO = rlLoadShaderBuffer(NodeCount(numTriangles) * sizeof(LbvhBuildNode), NULL, RL_DYNAMIC_COPY);
+	sortedTrianglesSSBO = rlLoadShaderBuffer(numTriangles * sizeof(Triangle), NULL, RL_DYNAMIC_COPY);
+	stateSSBO = rlLoadShaderBuffer(sizeof(LbvhBuildState) + 16 * groups * sizeof(unsigned int), NULL, RL_DYNAMIC_COPY);
+
+	capacity = numTriangles;
+	MemoryTracker::Set(MEMORY_GPU_BVH_BUILD, (long long)numTriangles * (4 * sizeof(unsigned int) + sizeof(Triangle)) +
+		(long long)NodeCount(numTriangles) * sizeof(LbvhBuildNode) + sizeof(LbvhBuildState) + 16 * groups * sizeof(unsigned int));
+}
+
+void GpuBVHBuilder::Dispatch(int stage, unsigned int groups)
+{
+	if (groups == 0)
+	{
+		return;
+	}
+
+	rlEnableShader(programs[stage].id);
+	rlComputeShaderDispatch(groups, 1, 1);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+}
+
+bool GpuBVHBuilder::Build(int meshIndex, int firstTriangle, int numTriangles, int rootNodeIndex, int trianglesSSBO)
+{
+	if (numTriangles <= 0 || (!loaded && !Load()))
+	{
+		return false;
+	}
+
+	Reserve(numTriangles);
+
+	int groups = (numTriangles + LBVH_GROUP_SIZE - 1) / LBVH_GROUP_SIZE;
+
+	for (Shader program : programs)
+	{
+		SetShaderValue(program, GetShaderLocation(program, "meshIndex"), &meshIndex, SHADER_UNIFORM_INT);
+		SetShaderValue(program, GetShaderLocation(program, "firstTriangle"), &firstTriangle, SHADER_UNIFORM_INT);
+		SetShaderValue(program, GetShaderLocation(program, "numPrimitives"), &numTriangles, SHADER_UNIFORM_INT);
+		SetShaderValue(program, GetShaderLocation(program, "nodeOffset"), &rootNodeIndex, SHADER_UNIFORM_INT);
+		SetShaderValue(program, GetShaderLocation(program, "numGroups"), &groups, SHADER_UNIFORM_INT);
+	}
+
+	LbvhBuildState state = { { ~0u, ~0u, ~0u }, { 0, 0, 0 }, 0, 0 };
+	rlUpdateShaderBuffer(stateSSBO, &state, sizeof(state), 0);
+
+	rlBindShaderBuffer(buildNodesSSBO, 7);
+	rlBindShaderBuffer(sortedTrianglesSSBO, 8);
+	rlBindShaderBuffer(stateSSBO, 9);
+
+	Dispatch(LBVH_BOUNDS, groups);
+
+	rlBindShaderBuffer(pairSSBOs[0], 6);
+	Dispatch(LBVH_MORTON, groups);
+
+	Shader scatter = programs[LBVH_SORT_SCATTER];
+	int countLocation = GetShaderLocation(programs[LBVH_SORT_COUNT], "digitShift");
+	int scatterLocation = GetShaderLocation(scatter, "digitShift");
+
+	for (int pass = 0; pass < LBVH_SORT_PASSES; pass++)
+	{
+		int shift = pass * 4;
+		SetShaderValue(programs[LBVH_SORT_COUNT], countLocation, &shift, SHADER_UNIFORM_INT);
+		SetShaderValue(scatter, scatterLocation, &shift, SHADER_UNIFORM_INT);
+
+		rlBindShaderBuffer(pairSSBOs[pass % 2], 5);
+		rlBindShaderBuffer(pairSSBOs[1 - pass % 2], 6);
+
+		Dispatch(LBVH_SORT_COUNT, groups);
+		Dispatch(LBVH_SORT_SCAN, 1);
+		Dispatch(LBVH_SORT_SCATTER, groups);
+	}
+
+	// an even number of passes leaves the sorted pairs where the Morton codes started
+	rlBindShaderBuffer(pairSSBOs[0], 5);
+
+	Dispatch(LBVH_HIERARCHY, (numTriangles - 1 + LBVH_GROUP_SIZE - 1) / LBVH_GROUP_SIZE);
+	Dispatch(LBVH_REDUCE, groups);
+	rlDisableShader();
+
+	glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+	rlCopyShaderBuffer(trianglesSSBO, sortedTrianglesSSBO, firstTriangle * sizeof(Triangle), 0, numTriangles * sizeof(Triangle));
+
+	return true;
+}
+
+void GpuBVHBuilder::ReadOrder(int numTriangles, std::vector<int>* order, int* height)
+{
+	std::vector<unsigned int> pairs(numTriangles * 2);
+	rlReadShaderBuffer(pairSSBOs[0], pairs.data(), pairs.size() * sizeof(unsigned int), 0);
+
+	order->resize(numTriangles);
+
+	for (int i = 0; i < numTriangles; i++)
+	{
+		(*order)[i] = (int)pairs[i * 2 + 1];
+	}
+
+	*height = ReadHeight();
+}
+
+int GpuBVHBuilder::ReadHeight()
+{
+	LbvhBuildState state;
+	rlReadShaderBuffer(stateSSBO, &state, sizeof(state), 0);
+	return (int)state.rootHeight;
+}
+
+void GpuBVHBuilder::Unload()
+{
+	UnloadPrograms();
+
+	int* buffers[] = { &pairSSBOs[0], &pairSSBOs[1], &buildNodesSSBO, &sortedTrianglesSSBO, &stateSSBO };
+
+	for (int* buffer : buffers)
+	{
+		if (*buffer != 0)
+		{
+			rlUnloadShaderBuffer(*buffer);
+			*buffer = 0;
+		}
+	}
+
+	capacity = 0;
+	MemoryTracker::Set(MEMORY_GPU_BVH_BUILD, 0);
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <raylib.h>
+
+// triangles per workgroup in every stage of lbvh.comp
+#define LBVH_GROUP_SIZE 256
+// 4 bit digits, the last pass only sorts the top two bits of the 30 bit Morton codes
+#define LBVH_SORT_PASSES 8
+
+// std430 layout of BuildNode in lbvh.comp
+struct LbvhBuildNode
+{
+	int parent;
+	unsigned int slot;
+	unsigned int first;
+	unsigned int last;
+	unsigned int visits;
+	unsigned int height;
+	int left;
+	int right;
+};
+
+// head of the BuildState buffer, the digit counts follow it
+struct LbvhBuildState
+{
+	unsigned int centroidMin[3];
+	unsigned int centroidMax[3];
+	unsigned int rootHeight;
+	unsigned int padding;
+};
+
+// linear BVH builds in compute shaders, Morton codes of the triangle centroids are radix sorted,
+// the hierarchy follows from their common prefixes and bounds are reduced bottom up. the nodes go
+// straight into the node buffer in the layout RayBVH reads, one triangle per leaf, and the mesh's
+// triangles are reordered to match on the GPU
+class GpuBVHBuilder
+{
+private:
+	enum Stage
+	{
+		LBVH_BOUNDS,
+		LBVH_MORTON,
+		LBVH_SORT_COUNT,
+		LBVH_SORT_SCAN,
+		LBVH_SORT_SCATTER,
+		LBVH_HIERARCHY,
+		LBVH_REDUCE,
+		LBVH_STAGE_COUNT
+	};
+
+	inline static Shader programs[LBVH_STAGE_COUNT];
+	inline static bool loaded = false;
+
+	// morton code and triangle pairs, ping-ponged by the sort passes, the sorted pairs end up in the first
+	inline static int pairSSBOs[2] = { 0, 0 };
+	inline static int buildNodesSSBO = 0;
+	inline static int sortedTrianglesSSBO = 0;
+	inline static int stateSSBO = 0;
+	inline static int capacity = 0;
+
+	static bool Load();
+	static void UnloadPrograms();
+	static void Reserve(int numTriangles);
+	static void Dispatch(int stage, unsigned int groups);
+
+public:
+	// one triangle per leaf, so a mesh needs this many nodes
+	static int NodeCount(int numTriangles) { return std::max(2 * numTriangles - 1, 1); }
+
+	// builds the hierarchy of the triangles at firstTriangle into the nodes from rootNodeIndex on and writes the
+	// root bounds into the mesh, the engine's mesh, triangle and node buffers have to be bound. binding 5 is
+	// left on one of the sort buffers
+	static bool Build(int meshIndex, int firstTriangle, int numTriangles, int rootNodeIndex, int trianglesSSBO);
+	// order of the last build as indices into the triangles it started from, waits for the GPU
+	static void ReadOrder(int numTriangles, std::vector<int>* order, int* height);
+	// levels below the root of the last build, waits for the GPU
+	static int ReadHeight();
+
+	// lbvh.comp with each stage's define, to rebuild the programs off the main thread, none before the first build
+	static std::vector<std::string> GetReloadSources() { return loaded ? GetSources() : std::vector<std::string>(); }
+	static std::vector<std::string> GetSources();
+	// takes ownership of programs built from GetSources, the old ones are unloaded
+	static void SetPrograms(const std::vector<unsigned int>& programs);
+	static void Unload();
+};
@@ -0,0 +1,156 @@
+#include "MemoryTracker.h"
+
+#include <algorithm>
+
+#define MEGABYTES(bytes) ((bytes) / (1024.0 * 1024.0))
+
+void* MemoryTracker::Resource::do_allocate(size_t bytes, size_t alignment)
+{
+	void* p = std::pmr::new_delete_resource()->allocate(bytes, alignment);
+	Add(category, (long long)bytes);
+	return p;
+}
+
+void MemoryTracker::Resource::do_deallocate(void* p, size_t bytes, size_t alignment)
+{
+	std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+	Add(category, -(long long)bytes);
+}
+
+const char* MemoryTracker::GetName(int category)
+{
+	switch (category)
+	{
+	case MEMORY_HOST_GEOMETRY:
+		return "geometry";
+	case MEMORY_HOST_BVH:
+		return "bvh";
+	case MEMORY_HOST_BVH_REFIT:
+		return "bvh refit info";
+	case MEMORY_HOST_MODELS:
+		return "raylib models";
+	case MEMORY_GPU_GEOMETRY:
+		return "geometry buffers";
+	case MEMORY_GPU_MODELS:
+		return "raylib model buffers";
+	case MEMORY_GPU_ENGINE_BUFFERS:
+		return "engine buffers";
+	case MEMORY_GPU_RENDER_TARGETS:
+		return "render targets";
+	case MEMORY_GPU_TEXTURES:
+		return "textures";
+	case MEMORY_GPU_WAVEFRONT:
+		return "wavefront";
+	case MEMORY_GPU_BVH_BUILD:
+		return "bvh build";
+	default:
+		return "unknown";
+	}
+}
+
+void MemoryTracker::UpdatePeaks(int category)
+{
+	usage[category].peakBytes = std::max(usage[category].peakBytes, usage[category].bytes);
+
+	bool gpu = IsGpu(category);
+	peakTotal[gpu] = std::max(peakTotal[gpu], GetTotal(gpu));
+}
+
+void MemoryTracker::Add(int category, long long bytes, long long usedBytes)
+{
+	usage[category].bytes += bytes;
+	usage[category].usedBytes += usedBytes;
+	UpdatePeaks(category);
+}
+
+void MemoryTracker::Set(int category, long long bytes, long long usedBytes)
+{
+	usage[category].bytes = bytes;
+	usage[category].usedBytes = usedBytes;
+	UpdatePeaks(category);
+}
+
+long long MemoryTracker::TextureBytes(Texture2D texture)
+{
+	return texture.id != 0 ? GetPixelDataSize(texture.width, texture.height, texture.format) : 0;
+}
+
+long long MemoryTracker::RenderTextureBytes(RenderTexture2D target)
+{
+	long long depth = target.depth.id != 0 ? (long long)target.depth.width * target.depth.height * 4 : 0;
+	return TextureBytes(target.texture) + depth;
+}
+
+long long MemoryTracker::ModelBytes(Model model)
+{
+	long long bytes = 0;
+
+	for (int i = 0; i < model.meshCount; i++)
+	{
+		Mesh& mesh = model.meshes[i];
+		long long vertices = mesh.vertexCount;
+
+		if (mesh.vertices != NULL) bytes += vertices * 3 * sizeof(float);
+		if (mesh.texcoords != NULL) bytes += vertices * 2 * sizeof(float);
+		if (mesh.texcoords2 != NULL) bytes += vertices * 2 * sizeof(float);
+		if (mesh.normals != NULL) bytes += vertices * 3 * sizeof(float);
+		if (mesh.tangents != NULL) bytes += vertices * 4 * sizeof(float);
+		if (mesh.colors != NULL) bytes += vertices * 4;
+		if (mesh.indices != NULL) bytes += (long long)mesh.triangleCount * 3 * sizeof(unsigned short);
+		if (mesh.animVertices != NULL) bytes += vertices * 3 * sizeof(float);
+		if (mesh.animNormals != NULL) bytes += vertices * 3 * sizeof(float);
+	}
+
+	return bytes;
+}
+
+long long MemoryTracker::GetTotal(bool gpu)
+{
+	long long total = 0;
+
+	for (int i = 0; i < MEMORY_CATEGORY_COUNT; i++)
+	{
+		if (IsGpu(i) == gpu)
+		{
+			total += usage[i].bytes;
+		}
+	}
+
+	return total;
+}
+
+void MemoryTracker::DrawOverlay(int x, int y)
+{
+	DrawText(TextFormat("host: %.1f MB (peak %.1f)  gpu: %.1f MB (peak %.1f)", MEGABYTES(GetTotal(false)), MEGABYTES(peakTotal[0]),
+		MEGABYTES(GetTotal(true)), MEGABYTES(peakTotal[1])), x, y, 20, WHITE);
+	y += 22;
+
+	for (int i = 0; i < MEMORY_CATEGORY_COUNT; i++)
+	{
+		if (usage[i].peakBytes == 0)
+		{
+			continue;
+		}
+
+		DrawText(TextFormat("%s %s: %.2f MB, %.2f used, peak %.2f", IsGpu(i) ? "gpu" : "host", GetName(i),
+			MEGABYTES(usage[i].bytes), MEGABYTES(usage[i].usedBytes), MEGABYTES(usage[i].peakBytes)), x, y, 10, LIGHTGRAY);
+		y += 12;
+	}
+}
+
+void MemoryTracker::LogReport()
+{
+	for (int gpu = 0; gpu <= 1; gpu++)
+	{
+		TraceLog(LOG_INFO, "MEMORY: %s %.2f MB, peak %.2f MB", gpu ? "GPU" : "Host", MEGABYTES(GetTotal(gpu)), MEGABYTES(peakTotal[gpu]));
+
+		for (int i = 0; i < MEMORY_CATEGORY_COUNT; i++)
+		{
+			if (IsGpu(i) == (bool)gpu)
+			{
+				TraceLog(LOG_INFO, "MEMORY:     %-22s %10.2f MB, %10.2f MB used, peak %10.2f MB", GetName(i),
+					MEGABYTES(usage[i].bytes), MEGABYTES(usage[i].usedBytes), MEGABYTES(usage[i].peakBytes));
+			}
+		}
+	}
+}
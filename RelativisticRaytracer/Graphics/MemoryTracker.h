@@ -0,0 +1,86 @@
+#pragma once
+
+#include <vector>
+#include <memory_resource>
+#include <raylib.h>
+
+enum MemoryCategory
+{
+	// host
+	MEMORY_HOST_GEOMETRY,
+	MEMORY_HOST_BVH,
+	MEMORY_HOST_BVH_REFIT,
+	MEMORY_HOST_MODELS,
+	// GPU
+	MEMORY_GPU_GEOMETRY,
+	MEMORY_GPU_MODELS,
+	MEMORY_GPU_ENGINE_BUFFERS,
+	MEMORY_GPU_RENDER_TARGETS,
+	MEMORY_GPU_TEXTURES,
+	MEMORY_GPU_WAVEFRONT,
+	MEMORY_GPU_BVH_BUILD,
+	MEMORY_CATEGORY_COUNT
+};
+
+struct MemoryUsage
+{
+	// allocated, and the part of it holding something, fixed size arrays and pooled buffers are larger than their contents
+	long long bytes;
+	long long usedBytes;
+	long long peakBytes;
+};
+
+// bytes held per category, GPU objects are counted where they are loaded and freed, host containers are measured by
+// their capacity whenever the engine updates them. only called from the main thread
+class MemoryTracker
+{
+private:
+	inline static MemoryUsage usage[MEMORY_CATEGORY_COUNT] = {};
+	inline static long long peakTotal[2] = { 0, 0 };
+
+	static void UpdatePeaks(int category);
+
+public:
+	// an allocator for pmr containers and arenas that counts what it hands out towards a category
+	class Resource : public std::pmr::memory_resource
+	{
+	private:
+		int category;
+
+		void* do_allocate(size_t bytes, size_t alignment) override;
+		void do_deallocate(void* p, size_t bytes, size_t alignment) override;
+		bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+
+	public:
+		Resource(int category) : category(category) {}
+	};
+
+	static const char* GetName(int category);
+	static bool IsGpu(int category) { return category >= MEMORY_GPU_GEOMETRY; }
+
+	// changes a category by the given amounts, negative when something is freed
+	static void Add(int category, long long bytes, long long usedBytes);
+	static void Add(int category, long long bytes) { Add(category, bytes, bytes); }
+	// replaces a category's count, for things measured as a whole
+	static void Set(int category, long long bytes, long long usedBytes);
+	static void Set(int category, long long bytes) { Set(category, bytes, bytes); }
+
+	template <typename T>
+	static long long CapacityBytes(const std::vector<T>& vector) { return (long long)(vector.capacity() * sizeof(T)); }
+	template <typename T>
+	static long long SizeBytes(const std::vector<T>& vector) { return (long long)(vector.size() * sizeof(T)); }
+
+	static long long TextureBytes(Texture2D texture);
+	// color and the 24 bit depth renderbuffer
+	static long long RenderTextureBytes(RenderTexture2D target);
+	// vertex data of the meshes as raylib keeps it on the host, and mostly uploads again
+	static long long ModelBytes(Model model);
+
+	static MemoryUsage GetUsage(int category) { return usage[category]; }
+	static long long GetTotal(bool gpu);
+	static long long GetPeakTotal(bool gpu) { return peakTotal[gpu]; }
+
+	static void DrawOverlay(int x, int y);
+	// every category with its current and peak usage, to the log
+	static void LogReport();
+};
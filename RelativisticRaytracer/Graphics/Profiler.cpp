@@ -0,0 +1,380 @@
+#include "Profiler.h"
+
+#include <rlgl.h>
+#include <external/glad.h>
+
+#include <fstream>
+#include <cstring>
+#include <algorithm>
+
+void Profiler::Initialize()
+{
+	for (int f = 0; f < PROFILER_QUERY_LATENCY; f++)
+	{
+		for (int s = 0; s < PROFILER_MAX_EVENTS; s++)
+		{
+			glGenQueries(2, gpuFrames[f].stages[s].queries);
+		}
+
+		gpuFrames[f].numStages = 0;
+		gpuFrames[f].frameIndex = -1;
+	}
+
+	for (int i = 0; i < PROFILER_HISTORY; i++)
+	{
+		history[i].frameIndex = -1;
+		history[i].numEvents = 0;
+	}
+
+	// GPU timestamps have their own origin, line them up with the CPU clock once
+	GLint64 gpuNow = 0;
+	glGetInteger64v(GL_TIMESTAMP, &gpuNow);
+	gpuTimeOffsetUs = NowUs() - gpuNow / 1000.0;
+
+	frameIndex = 0;
+	frameStartUs = NowUs();
+	gpuFrames[0].frameIndex = 0;
+	history[0].frameIndex = 0;
+	cpuStack.clear();
+	gpuStageOpen = false;
+	initialized = true;
+}
+
+void Profiler::Unload()
+{
+	if (!initialized)
+	{
+		return;
+	}
+
+	for (int f = 0; f < PROFILER_QUERY_LATENCY; f++)
+	{
+		for (int s = 0; s < PROFILER_MAX_EVENTS; s++)
+		{
+			glDeleteQueries(2, gpuFrames[f].stages[s].queries);
+		}
+	}
+
+	initialized = false;
+}
+
+double Profiler::NowUs()
+{
+	return GetTime() * 1000000.0;
+}
+
+int Profiler::GetStage(const char* name)
+{
+	for (size_t i = 0; i < stageNames.size(); i++)
+	{
+		if (stageNames[i] == name)
+		{
+			return i;
+		}
+	}
+
+	stageNames.push_back(name);
+	return stageNames.size() - 1;
+}
+
+ProfilerFrame* Profiler::GetFrame(int index)
+{
+	ProfilerFrame* frame = &history[index % PROFILER_HISTORY];
+	return frame->frameIndex == index ? frame : nullptr;
+}
+
+void Profiler::AddEvent(int frame, int stage, bool gpu, double startUs, double durationUs)
+{
+	ProfilerFrame* profilerFrame = GetFrame(frame);
+
+	if (profilerFrame == nullptr || profilerFrame->numEvents >= PROFILER_MAX_EVENTS)
+	{
+		return;
+	}
+
+	profilerFrame->events[profilerFrame->numEvents++] = { stage, gpu, startUs, durationUs };
+}
+
+void Profiler::BeginGpuStage(const char* name)
+{
+	GpuFrame* gpuFrame = &gpuFrames[frameIndex % PROFILER_QUERY_LATENCY];
+
+	if (!enabled || !initialized || gpuStageOpen || gpuFrame->numStages >= PROFILER_MAX_EVENTS)
+	{
+		return;
+	}
+
+	// raylib batches draws, flush so earlier work is not counted in this stage
+	rlDrawRenderBatchActive();
+
+	GpuStage* stage = &gpuFrame->stages[gpuFrame->numStages];
+	stage->stage = GetStage(name);
+	glQueryCounter(stage->queries[0], GL_TIMESTAMP);
+
+	gpuStageOpen = true;
+}
+
+void Profiler::EndGpuStage()
+{
+	if (!gpuStageOpen)
+	{
+		return;
+	}
+
+	rlDrawRenderBatchActive();
+
+	GpuFrame* gpuFrame = &gpuFrames[frameIndex % PROFILER_QUERY_LATENCY];
+	glQueryCounter(gpuFrame->stages[gpuFrame->numStages].queries[1], GL_TIMESTAMP);
+	gpuFrame->numStages++;
+
+	gpuStageOpen = false;
+}
+
+void Profiler::BeginCpuStage(const char* name)
+{
+	if (!enabled || !initialized)
+	{
+		return;
+	}
+
+	cpuStack.push_back({ GetStage(name), NowUs() });
+}
+
+void Profiler::EndCpuStage()
+{
+	if (cpuStack.empty())
+	{
+		return;
+	}
+
+	std::pair<int, double> scope = cpuStack.back();
+	cpuStack.pop_back();
+
+	AddEvent(frameIndex, scope.first, false, scope.second, NowUs() - scope.second);
+}
+
+void Profiler::CollectGpuFrame(GpuFrame* gpuFrame)
+{
+	for (int i = 0; i < gpuFrame->numStages; i++)
+	{
+		GpuStage* stage = &gpuFrame->stages[i];
+
+		// frames that are still not done after the latency window are dropped rather than waited on
+		GLint available = 0;
+		glGetQueryObjectiv(stage->queries[1], GL_QUERY_RESULT_AVAILABLE, &available);
+
+		if (!available)
+		{
+			continue;
+		}
+
+		GLuint64 begin = 0;
+		GLuint64 end = 0;
+		glGetQueryObjectui64v(stage->queries[0], GL_QUERY_RESULT, &begin);
+		glGetQueryObjectui64v(stage->queries[1], GL_QUERY_RESULT, &end);
+
+		AddEvent(gpuFrame->frameIndex, stage->stage, true, begin / 1000.0 + gpuTimeOffsetUs, (end - begin) / 1000.0);
+	}
+
+	gpuFrame->numStages = 0;
+}
+
+void Profiler::EndFrame()
+{
+	if (!initialized)
+	{
+		return;
+	}
+
+	double now = NowUs();
+	AddEvent(frameIndex, GetStage("frame"), false, frameStartUs, now - frameStartUs);
+	frameStartUs = now;
+
+	frameIndex++;
+
+	ProfilerFrame* frame = &history[frameIndex % PROFILER_HISTORY];
+	frame->frameIndex = frameIndex;
+	frame->numEvents = 0;
+
+	GpuFrame* gpuFrame = &gpuFrames[frameIndex % PROFILER_QUERY_LATENCY];
+	CollectGpuFrame(gpuFrame);
+	gpuFrame->frameIndex = frameIndex;
+}
+
+float Profiler::GetAverageMs(const char* name)
+{
+	int stage = -1;
+
+	for (size_t i = 0; i < stageNames.size(); i++)
+	{
+		if (stageNames[i] == name) stage = i;
+	}
+
+	if (stage < 0)
+	{
+		return 0;
+	}
+
+	double total = 0;
+	int count = 0;
+
+	for (int i = 0; i < PROFILER_HISTORY; i++)
+	{
+		// the current frame is still being recorded
+		if (history[i].frameIndex < 0 || history[i].frameIndex == frameIndex)
+		{
+			continue;
+		}
+
+		for (int e = 0; e < history[i].numEvents; e++)
+		{
+			if (history[i].events[e].stage == stage)
+			{
+				total += history[i].events[e].durationUs;
+				count++;
+			}
+		}
+	}
+
+	return count > 0 ? (float)(total / count / 1000.0) : 0;
+}
+
+float Profiler::GetLatestGpuMs()
+{
+	ProfilerFrame* frame = frameIndex >= PROFILER_QUERY_LATENCY ? GetFrame(frameIndex - PROFILER_QUERY_LATENCY) : nullptr;
+
+	if (frame == nullptr)
+	{
+		return -1;
+	}
+
+	double total = 0;
+	bool found = false;
+
+	for (int e = 0; e < frame->numEvents; e++)
+	{
+		if (frame->events[e].gpu)
+		{
+			total += frame->events[e].durationUs;
+			found = true;
+		}
+	}
+
+	return found ? (float)(total / 1000.0) : -1;
+}
+
+Color Profiler::StageColor(int stage)
+{
+	static const Color palette[] = { ORANGE, SKYBLUE, LIME, PURPLE, GOLD, RED, BLUE, MAGENTA, GREEN, YELLOW };
+	return palette[stage % (sizeof(palette) / sizeof(palette[0]))];
+}
+
+void Profiler::DrawGraph(int x, int y, int width, int height)
+{
+	DrawRectangle(x, y, width, height, Fade(BLACK, 0.6f));
+
+	int frameStage = GetStage("frame");
+
+	// scale to the slowest frame in view, but never below a 60 fps frame
+	float maxMs = 16.6f;
+
+	for (int i = 0; i < PROFILER_HISTORY; i++)
+	{
+		float frameMs = 0;
+
+		for (int e = 0; e < history[i].numEvents; e++)
+		{
+			if (history[i].events[e].gpu) frameMs += history[i].events[e].durationUs / 1000.0;
+			else if (history[i].events[e].stage == frameStage) frameMs = std::max(frameMs, (float)(history[i].events[e].durationUs / 1000.0));
+		}
+
+		maxMs = std::max(maxMs, frameMs);
+	}
+
+	float barWidth = (float)width / PROFILER_HISTORY;
+	float msToPixels = height / maxMs;
+
+	for (int i = 0; i < PROFILER_HISTORY; i++)
+	{
+		ProfilerFrame* frame = GetFrame(frameIndex - PROFILER_HISTORY + 1 + i);
+
+		if (frame == nullptr)
+		{
+			continue;
+		}
+
+		int barX = x + (int)(i * barWidth);
+		float stacked = 0;
+
+		for (int e = 0; e < frame->numEvents; e++)
+		{
+			ProfilerEvent* event = &frame->events[e];
+			float eventPixels = (float)(event->durationUs / 1000.0) * msToPixels;
+
+			if (event->gpu)
+			{
+				DrawRectangle(barX, y + height - (int)(stacked + eventPixels), std::max(1, (int)barWidth), std::max(1, (int)eventPixels), StageColor(event->stage));
+				stacked += eventPixels;
+			}
+			else if (event->stage == frameStage)
+			{
+				DrawRectangle(barX, y + height - (int)eventPixels, std::max(1, (int)barWidth), 1, WHITE);
+			}
+		}
+	}
+
+	int sixtyFps = y + height - (int)(16.6f * msToPixels);
+	DrawLine(x, sixtyFps, x + width, sixtyFps, Fade(WHITE, 0.3f));
+	DrawText(TextFormat("%.1f ms", maxMs), x + 4, y + 4, 10, WHITE);
+
+	int legendY = y + height + 4;
+
+	for (size_t i = 0; i < stageNames.size(); i++)
+	{
+		DrawRectangle(x, legendY + 2, 8, 8, i == frameStage ? WHITE : StageColor(i));
+		DrawText(TextFormat("%s: %.2f ms", stageNames[i].c_str(), GetAverageMs(stageNames[i].c_str())), x + 12, legendY, 10, WHITE);
+		legendY += 12;
+	}
+}
+
+bool Profiler::ExportChromeTrace(const char* fileName)
+{
+	std::ofstream file(fileName);
+
+	if (!file.is_open())
+	{
+		TraceLog(LOG_WARNING, "PROFILER: Failed to open %s for writing", fileName);
+		return false;
+	}
+
+	file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+	file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"CPU\"}},\n";
+	file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":2,\"args\":{\"name\":\"GPU\"}}";
+
+	int numEvents = 0;
+
+	// oldest frame first so the trace reads left to right
+	for (int i = 0; i < PROFILER_HISTORY; i++)
+	{
+		ProfilerFrame* frame = GetFrame(frameIndex - PROFILER_HISTORY + 1 + i);
+
+		if (frame == nullptr)
+		{
+			continue;
+		}
+
+		for (int e = 0; e < frame->numEvents; e++)
+		{
+			ProfilerEvent* event = &frame->events[e];
+
+			file << TextFormat(",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%i,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"frame\":%i}}",
+				stageNames[event->stage].c_str(), event->gpu ? "gpu" : "cpu", event->gpu ? 2 : 1, event->startUs, event->durationUs, frame->frameIndex);
+			numEvents++;
+		}
+	}
+
+	file << "\n]}\n";
+
+	TraceLog(LOG_INFO, "PROFILER: Wrote %i events to %s", numEvents, fileName);
+	return true;
+}
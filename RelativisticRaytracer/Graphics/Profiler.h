@@ -0,0 +1,87 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <raylib.h>
+
+#define PROFILER_HISTORY 240
+#define PROFILER_MAX_EVENTS 32
+// GPU timestamps are read this many frames after they were issued so reading them never stalls
+#define PROFILER_QUERY_LATENCY 4
+
+struct ProfilerEvent
+{
+	int stage;
+	bool gpu;
+	double startUs;
+	double durationUs;
+};
+
+struct ProfilerFrame
+{
+	int frameIndex;
+	int numEvents;
+	ProfilerEvent events[PROFILER_MAX_EVENTS];
+};
+
+class Profiler
+{
+private:
+	struct GpuStage
+	{
+		int stage;
+		unsigned int queries[2];
+	};
+
+	struct GpuFrame
+	{
+		int frameIndex;
+		int numStages;
+		GpuStage stages[PROFILER_MAX_EVENTS];
+	};
+
+	inline static std::vector<std::string> stageNames;
+	inline static ProfilerFrame history[PROFILER_HISTORY];
+	inline static GpuFrame gpuFrames[PROFILER_QUERY_LATENCY];
+
+	inline static int frameIndex = 0;
+	inline static double frameStartUs = 0;
+	inline static double gpuTimeOffsetUs = 0;
+	inline static bool initialized = false;
+	inline static bool gpuStageOpen = false;
+
+	inline static std::vector<std::pair<int, double>> cpuStack;
+
+	static double NowUs();
+	static int GetStage(const char* name);
+	static ProfilerFrame* GetFrame(int index);
+	static void AddEvent(int frame, int stage, bool gpu, double startUs, double durationUs);
+	static void CollectGpuFrame(GpuFrame* gpuFrame);
+	static Color StageColor(int stage);
+
+public:
+	inline static bool enabled = true;
+
+	static void Initialize();
+	static void Unload();
+
+	static void BeginGpuStage(const char* name);
+	static void EndGpuStage();
+	static void BeginCpuStage(const char* name);
+	static void EndCpuStage();
+	static void EndFrame();
+
+	// average over the frames currently held in the ring buffer, 0 for unknown stages
+	static float GetAverageMs(const char* name);
+	// GPU time of all stages in the newest frame whose queries have been read, negative until there is one
+	static float GetLatestGpuMs();
+
+	static void DrawGraph(int x, int y, int width, int height);
+	static bool ExportChromeTrace(const char* fileName);
+};
+
+struct CpuProfileScope
+{
+	CpuProfileScope(const char* name) { Profiler::BeginCpuStage(name); }
+	~CpuProfileScope() { Profiler::EndCpuStage(); }
+};
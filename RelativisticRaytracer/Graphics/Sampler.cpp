@@ -0,0 +1,202 @@
+#include "Sampler.h"
+
+#include <cmath>
+#include <cfloat>
+#include <random>
+#include <algorithm>
+
+const char* Sampler::GetName(int type)
+{
+	switch (type)
+	{
+	case SAMPLER_PCG:
+		return "pcg";
+	case SAMPLER_SOBOL:
+		return "sobol";
+	case SAMPLER_BLUE_NOISE:
+		return "blue noise";
+	case SAMPLER_LEGACY:
+		return "legacy";
+	default:
+		return "unknown";
+	}
+}
+
+std::vector<int> Sampler::GenerateSobolDirections()
+{
+	// primitive polynomial degree, coefficients and initial m values per dimension (Joe and Kuo)
+	struct SobolParams
+	{
+		int s;
+		int a;
+		unsigned int m[3];
+	};
+
+	static const SobolParams params[SOBOL_DIMENSIONS - 1] =
+	{
+		{ 1, 0, { 1 } },
+		{ 2, 1, { 1, 3 } },
+		{ 3, 1, { 1, 3, 1 } },
+	};
+
+	std::vector<int> directions(SOBOL_DIMENSIONS * 32);
+
+	for (int i = 0; i < 32; i++)
+	{
+		directions[i] = (int)(1u << (31 - i));
+	}
+
+	for (int d = 1; d < SOBOL_DIMENSIONS; d++)
+	{
+		const SobolParams& p = params[d - 1];
+		unsigned int v[32];
+
+		for (int i = 0; i < 32; i++)
+		{
+			if (i < p.s)
+			{
+				v[i] = p.m[i] << (31 - i);
+				continue;
+			}
+
+			v[i] = v[i - p.s] ^ (v[i - p.s] >> p.s);
+
+			for (int k = 1; k < p.s; k++)
+			{
+				v[i] ^= ((p.a >> (p.s - 1 - k)) & 1) * v[i - k];
+			}
+		}
+
+		for (int i = 0; i < 32; i++)
+		{
+			directions[d * 32 + i] = (int)v[i];
+		}
+	}
+
+	return directions;
+}
+
+std::vector<float> Sampler::GenerateBlueNoise(int size, unsigned int seed)
+{
+	int count = size * size;
+	const float sigma = 1.5f;
+
+	// gaussian over wrapped offsets so the result tiles
+	std::vector<float> kernel(count);
+
+	for (int y = 0; y < size; y++)
+	{
+		for (int x = 0; x < size; x++)
+		{
+			float dx = (float)std::min(x, size - x);
+			float dy = (float)std::min(y, size - y);
+			kernel[y * size + x] = expf(-(dx * dx + dy * dy) / (2 * sigma * sigma));
+		}
+	}
+
+	auto splat = [&](std::vector<float>& energy, int pixel, float sign)
+		{
+			int px = pixel % size;
+			int py = pixel / size;
+
+			for (int y = 0; y < size; y++)
+			{
+				for (int x = 0; x < size; x++)
+				{
+					energy[y * size + x] += sign * kernel[((y - py + size) % size) * size + (x - px + size) % size];
+				}
+			}
+		};
+
+	auto tightestCluster = [count](const std::vector<float>& energy, const std::vector<char>& pattern)
+		{
+			int best = -1;
+
+			for (int i = 0; i < count; i++)
+			{
+				if (pattern[i] && (best < 0 || energy[i] > energy[best])) best = i;
+			}
+
+			return best;
+		};
+
+	auto largestVoid = [count](const std::vector<float>& energy, const std::vector<char>& pattern)
+		{
+			int best = -1;
+
+			for (int i = 0; i < count; i++)
+			{
+				if (!pattern[i] && (best < 0 || energy[i] < energy[best])) best = i;
+			}
+
+			return best;
+		};
+
+	std::vector<char> pattern(count, 0);
+	std::vector<float> energy(count, 0);
+	std::mt19937 rng(seed);
+
+	// a tenth of the pixels at random as the initial pattern
+	int ones = count / 10;
+
+	for (int placed = 0; placed < ones;)
+	{
+		int pixel = rng() % count;
+
+		if (!pattern[pixel])
+		{
+			pattern[pixel] = 1;
+			splat(energy, pixel, 1);
+			placed++;
+		}
+	}
+
+	// move the tightest cluster into the largest void until it would land where it came from
+	for (int i = 0; i < count; i++)
+	{
+		int cluster = tightestCluster(energy, pattern);
+		pattern[cluster] = 0;
+		splat(energy, cluster, -1);
+
+		int hole = largestVoid(energy, pattern);
+		pattern[hole] = 1;
+		splat(energy, hole, 1);
+
+		if (hole == cluster)
+		{
+			break;
+		}
+	}
+
+	std::vector<int> ranks(count);
+
+	// the initial points take the lowest ranks, removed tightest first
+	std::vector<char> removePattern = pattern;
+	std::vector<float> removeEnergy = energy;
+
+	for (int rank = ones - 1; rank >= 0; rank--)
+	{
+		int cluster = tightestCluster(removeEnergy, removePattern);
+		removePattern[cluster] = 0;
+		splat(removeEnergy, cluster, -1);
+		ranks[cluster] = rank;
+	}
+
+	// everything else fills the largest void, past half full the tightest cluster of zeros is that same pixel
+	for (int rank = ones; rank < count; rank++)
+	{
+		int hole = largestVoid(energy, pattern);
+		pattern[hole] = 1;
+		splat(energy, hole, 1);
+		ranks[hole] = rank;
+	}
+
+	std::vector<float> noise(count);
+
+	for (int i = 0; i < count; i++)
+	{
+		noise[i] = (ranks[i] + 0.5f) / count;
+	}
+
+	return noise;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <vector>
+
+// sobol is generated in 4D sets, higher dimensions use decorrelated copies of the same set
+#define SOBOL_DIMENSIONS 4
+#define BLUE_NOISE_SIZE 64
+
+enum SamplerType
+{
+	SAMPLER_PCG,
+	SAMPLER_SOBOL,
+	SAMPLER_BLUE_NOISE,
+	// the hash the tracer started with, seeded from x * y of the pixel, kept to compare against
+	SAMPLER_LEGACY,
+	SAMPLER_COUNT
+};
+
+// host side tables for the samplers in raytracer_fragment.glsl
+class Sampler
+{
+public:
+	static const char* GetName(int type);
+
+	// 32 direction numbers per dimension, the first dimension is van der Corput
+	static std::vector<int> GenerateSobolDirections();
+
+	// void and cluster ranks scaled to [0, 1), size * size values tiling seamlessly
+	static std::vector<float> GenerateBlueNoise(int size, unsigned int seed);
+};
@@ -0,0 +1,415 @@
+#include "SceneFile.h"
+
+#include <raymath.h>
+
+#include <fstream>
+#include <sstream>
+#include <cstring>
+
+static bool ReadFloats(std::istringstream& in, float* values, int count)
+{
+	for (int i = 0; i < count; i++)
+	{
+		if (!(in >> values[i])) return false;
+	}
+
+	return true;
+}
+
+static bool ReadVector3(std::istringstream& in, Vector3* value)
+{
+	return ReadFloats(in, &value->x, 3);
+}
+
+static bool ReadVector4(std::istringstream& in, Vector4* value)
+{
+	return ReadFloats(in, &value->x, 4);
+}
+
+static bool ReadColor(std::istringstream& in, Color* color)
+{
+	int r, g, b, a;
+	if (!(in >> r >> g >> b >> a)) return false;
+
+	*color = Color((unsigned char)r, (unsigned char)g, (unsigned char)b, (unsigned char)a);
+	return true;
+}
+
+SceneDescription SceneFile::DefaultDescription()
+{
+	SceneDescription scene;
+
+	scene.settings = { 2048, 1024, 7, 10, 0.001f, Camera() };
+	scene.settings.camera.position = Vector3(15, 8, 15);
+	scene.settings.camera.target = Vector3(0, 0.5f, 0);
+	scene.settings.camera.up = Vector3(0, 1, 0);
+	scene.settings.camera.fovy = 45;
+	scene.settings.camera.projection = CAMERA_PERSPECTIVE;
+
+	scene.skyMaterial = SkyMaterial{ DARKGRAY, DARKGRAY, DARKGRAY, DARKGRAY, Vector3(-0.5f, -1, -0.5f), 1, 0.5 };
+
+	return scene;
+}
+
+bool SceneFile::ParseLine(const std::string& line, SceneDescription* scene, std::string* error)
+{
+	std::istringstream in(line);
+	std::string directive;
+
+	if (!(in >> directive) || directive[0] == '#')
+	{
+		return true;
+	}
+
+	std::string key;
+
+	if (directive == "render")
+	{
+		SceneSettings* settings = &scene->settings;
+
+		while (in >> key)
+		{
+			bool ok = key == "resolution" ? (bool)(in >> settings->width >> settings->height)
+				: key == "bounces" ? (bool)(in >> settings->maxBounces)
+				: key == "rpp" ? (bool)(in >> settings->raysPerPixel)
+				: key == "blur" ? (bool)(in >> settings->blur)
+				: false;
+
+			if (!ok) return *error = "bad render setting '" + key + "'", false;
+		}
+	}
+	else if (directive == "camera")
+	{
+		Camera* camera = &scene->settings.camera;
+
+		while (in >> key)
+		{
+			bool ok = key == "position" ? ReadVector3(in, &camera->position)
+				: key == "target" ? ReadVector3(in, &camera->target)
+				: key == "up" ? ReadVector3(in, &camera->up)
+				: key == "fovy" ? (bool)(in >> camera->fovy)
+				: false;
+
+			if (!ok) return *error = "bad camera setting '" + key + "'", false;
+		}
+	}
+	else if (directive == "sky")
+	{
+		SkyMaterial* sky = &scene->skyMaterial;
+
+		while (in >> key)
+		{
+			bool ok = key == "zenith" ? ReadColor(in, &sky->skyColorZenith)
+				: key == "horizon" ? ReadColor(in, &sky->skyColorHorizon)
+				: key == "ground" ? ReadColor(in, &sky->groundColor)
+				: key == "sun" ? ReadColor(in, &sky->sunColor)
+				: key == "direction" ? ReadVector3(in, &sky->sunDirection)
+				: key == "focus" ? (bool)(in >> sky->sunFocus)
+				: key == "intensity" ? (bool)(in >> sky->sunIntensity)
+				: false;
+
+			if (!ok) return *error = "bad sky setting '" + key + "'", false;
+		}
+	}
+	else if (directive == "material")
+	{
+		std::string name;
+		if (!(in >> name)) return *error = "material needs a name", false;
+
+		RaytracingMaterial material = { Vector4(1,1,1,1), Vector4(0,0,0,0), Vector4(0,0,0,0) };
+
+		while (in >> key)
+		{
+			bool ok = key == "color" ? ReadVector4(in, &material.color)
+				: key == "emission" ? ReadVector4(in, &material.emission)
+				: key == "e_s_b_b" ? ReadVector4(in, &material.e_s_b_b)
+				: key == "smoothness" ? (bool)(in >> material.e_s_b_b.y)
+				: key == "specular" ? (bool)(in >> material.e_s_b_b.z)
+				: false;
+
+			if (!ok) return *error = "bad material setting '" + key + "'", false;
+		}
+
+		scene->materials[name] = material;
+	}
+	else if (directive == "model")
+	{
+		SceneModel model = {};
+		model.bvhDepth = 8;
+		model.indexed = -1;
+		model.transform = MatrixIdentity();
+
+		if (!(in >> model.source)) return *error = "model needs a source", false;
+
+		int numParams = model.source == "file" ? 0
+			: model.source == "torus" ? 4
+			: model.source == "sphere" ? 3
+			: model.source == "plane" ? 4
+			: model.source == "cube" ? 3
+			: -1;
+
+		if (numParams < 0) return *error = "unknown model source '" + model.source + "'", false;
+		if (model.source == "file" && !(in >> model.path)) return *error = "model file needs a path", false;
+		if (!ReadFloats(in, model.params, numParams)) return *error = "model " + model.source + " needs " + std::to_string(numParams) + " parameters", false;
+
+		// transforms apply in the order they are written
+		while (in >> key)
+		{
+			Vector3 v;
+			bool ok = true;
+
+			if (key == "material") ok = (bool)(in >> model.material) && scene->materials.count(model.material);
+			else if (key == "bvh") ok = (bool)(in >> model.bvhDepth);
+			else if (key == "indexed") ok = (bool)(in >> model.indexed);
+			else if (key == "scale" && (ok = ReadVector3(in, &v))) model.transform = model.transform * MatrixScale(v.x, v.y, v.z);
+			else if (key == "rotate" && (ok = ReadVector3(in, &v))) model.transform = model.transform * MatrixRotateXYZ(v * DEG2RAD);
+			else if (key == "translate" && (ok = ReadVector3(in, &v))) model.transform = model.transform * MatrixTranslate(v.x, v.y, v.z);
+			else ok = false;
+
+			if (!ok) return *error = "bad model setting '" + key + "'", false;
+		}
+
+		if (model.material.empty()) return *error = "model needs a material", false;
+
+		scene->models.push_back(model);
+	}
+	else if (directive == "sphere")
+	{
+		Sphere sphere = { Vector3(0, 0, 0), 1 };
+		std::string material;
+
+		while (in >> key)
+		{
+			bool ok = key == "position" ? ReadVector3(in, &sphere.position)
+				: key == "radius" ? (bool)(in >> sphere.radius)
+				: key == "material" ? (bool)(in >> material) && scene->materials.count(material)
+				: false;
+
+			if (!ok) return *error = "bad sphere setting '" + key + "'", false;
+		}
+
+		if (material.empty()) return *error = "sphere needs a material", false;
+
+		sphere.mat = scene->materials[material];
+		scene->spheres.push_back(sphere);
+	}
+	else if (directive == "gravity")
+	{
+		GravityBody body = { Vector4(0, 0, 0, 1) };
+
+		while (in >> key)
+		{
+			bool ok = key == "position" ? ReadFloats(in, &body.posmass.x, 3)
+				: key == "mass" ? (bool)(in >> body.posmass.w)
+				: false;
+
+			if (!ok) return *error = "bad gravity setting '" + key + "'", false;
+		}
+
+		scene->gravityBodies.push_back(body);
+	}
+	else if (directive == "focus")
+	{
+		FocusRegion region = { Vector3(0, 0, 0), 1 };
+
+		while (in >> key)
+		{
+			bool ok = key == "position" ? ReadVector3(in, &region.position)
+				: key == "radius" ? (bool)(in >> region.radius)
+				: false;
+
+			if (!ok) return *error = "bad focus setting '" + key + "'", false;
+		}
+
+		scene->focusRegions.push_back(region);
+	}
+	else
+	{
+		return *error = "unknown directive '" + directive + "'", false;
+	}
+
+	return true;
+}
+
+bool SceneFile::LoadDescription(const char* fileName, SceneDescription* scene)
+{
+	std::ifstream file(fileName);
+
+	if (!file.is_open())
+	{
+		TraceLog(LOG_ERROR, "SCENE: Failed to open %s", fileName);
+		return false;
+	}
+
+	*scene = DefaultDescription();
+
+	std::string line;
+	std::string error;
+	int lineNumber = 0;
+
+	while (std::getline(file, line))
+	{
+		lineNumber++;
+
+		if (!ParseLine(line, scene, &error))
+		{
+			TraceLog(LOG_ERROR, "SCENE: %s:%i: %s", fileName, lineNumber, error.c_str());
+			return false;
+		}
+	}
+
+	TraceLog(LOG_INFO, "SCENE: Loaded %s, %i models, %i spheres, %i gravity bodies", fileName, (int)scene->models.size(), (int)scene->spheres.size(), (int)scene->gravityBodies.size());
+	return true;
+}
+
+void SceneFile::Build(const SceneDescription& scene, std::vector<Model>* models)
+{
+	for (const SceneModel& sceneModel : scene.models)
+	{
+		const float* p = sceneModel.params;
+
+		Model model = sceneModel.source == "file" ? LoadModel(sceneModel.path.c_str())
+			: sceneModel.source == "torus" ? LoadModelFromMesh(GenMeshTorus(p[0], p[1], (int)p[2], (int)p[3]))
+			: sceneModel.source == "sphere" ? LoadModelFromMesh(GenMeshSphere(p[0], (int)p[1], (int)p[2]))
+			: sceneModel.source == "plane" ? LoadModelFromMesh(GenMeshPlane(p[0], p[1], (int)p[2], (int)p[3]))
+			: LoadModelFromMesh(GenMeshCube(p[0], p[1], p[2]));
+
+		model.transform = sceneModel.transform;
+
+		bool indexed = sceneModel.indexed >= 0 ? sceneModel.indexed : model.meshCount > 0 && model.meshes[0].indices != NULL;
+
+		TracingEngine::UploadRaylibModel(model, scene.materials.at(sceneModel.material), indexed, sceneModel.bvhDepth);
+		models->push_back(model);
+	}
+
+	TracingEngine::spheres = scene.spheres;
+	TracingEngine::gravityBodies = scene.gravityBodies;
+	TracingEngine::focusRegions = scene.focusRegions;
+	TracingEngine::skyMaterial = scene.skyMaterial;
+
+	TracingEngine::UploadStaticData();
+}
+
+bool SceneFile::IsCompiled(const char* fileName)
+{
+	std::ifstream file(fileName, std::ios::binary);
+	unsigned int magic = 0;
+
+	return file.read((char*)&magic, sizeof(magic)) && magic == COMPILED_SCENE_MAGIC;
+}
+
+template <typename T>
+static void WriteArray(std::ofstream& file, const std::vector<T>& values)
+{
+	file.write((const char*)values.data(), values.size() * sizeof(T));
+}
+
+// the count comes from the file, it is checked against what is left of it before anything is allocated
+template <typename T>
+static bool ReadArray(std::ifstream& file, std::streamoff fileSize, std::vector<T>* values, int count)
+{
+	std::streamoff remaining = fileSize - (std::streamoff)file.tellg();
+
+	if (count < 0 || !file || (std::streamoff)count > remaining / (std::streamoff)sizeof(T))
+	{
+		return false;
+	}
+
+	values->resize(count);
+	return (bool)file.read((char*)values->data(), (std::streamsize)count * sizeof(T));
+}
+
+bool SceneFile::SaveCompiled(const char* fileName, const SceneSettings& settings)
+{
+	std::ofstream file(fileName, std::ios::binary);
+
+	if (!file.is_open())
+	{
+		TraceLog(LOG_ERROR, "SCENE: Failed to open %s for writing", fileName);
+		return false;
+	}
+
+	CompiledSceneHeader header = {};
+	header.magic = COMPILED_SCENE_MAGIC;
+	header.version = COMPILED_SCENE_VERSION;
+	header.settings = settings;
+	header.skyMaterial = TracingEngine::skyMaterial;
+	header.numMeshes = TracingEngine::meshes.size();
+	header.numTriangles = TracingEngine::triangles.size();
+	header.numNodes = TracingEngine::nodes.size();
+	header.numSpheres = TracingEngine::spheres.size();
+	header.sphereRootNode = TracingEngine::sphereRootNode;
+	header.sphereBvhDepth = TracingEngine::sphereBvhDepth;
+	header.numGravityBodies = TracingEngine::gravityBodies.size();
+	header.numFocusRegions = TracingEngine::focusRegions.size();
+
+	file.write((const char*)&header, sizeof(header));
+	WriteArray(file, TracingEngine::meshes);
+	WriteArray(file, TracingEngine::triangles);
+	WriteArray(file, TracingEngine::triangleSourceIndices);
+	WriteArray(file, TracingEngine::nodes);
+	WriteArray(file, TracingEngine::spheres);
+	WriteArray(file, TracingEngine::gravityBodies);
+	WriteArray(file, TracingEngine::focusRegions);
+
+	TraceLog(LOG_INFO, "SCENE: Compiled %s, %i triangles, %i nodes", fileName, header.numTriangles, header.numNodes);
+	return (bool)file;
+}
+
+bool SceneFile::ReadCompiledHeader(const char* fileName, CompiledSceneHeader* header)
+{
+	std::ifstream file(fileName, std::ios::binary);
+
+	if (!file.read((char*)header, sizeof(CompiledSceneHeader)) || header->magic != COMPILED_SCENE_MAGIC)
+	{
+		TraceLog(LOG_ERROR, "SCENE: %s is not a compiled scene", fileName);
+		return false;
+	}
+
+	if (header->version != COMPILED_SCENE_VERSION)
+	{
+		TraceLog(LOG_ERROR, "SCENE: %s is version %u, expected %u, recompile it", fileName, header->version, COMPILED_SCENE_VERSION);
+		return false;
+	}
+
+	return true;
+}
+
+bool SceneFile::LoadCompiled(const char* fileName)
+{
+	CompiledSceneHeader header;
+
+	if (!ReadCompiledHeader(fileName, &header))
+	{
+		return false;
+	}
+
+	std::ifstream file(fileName, std::ios::binary | std::ios::ate);
+	std::streamoff fileSize = file.tellg();
+	file.seekg(sizeof(CompiledSceneHeader));
+
+	// every array lands directly in the vector the engine uploads from, no parsing or staging copies
+	bool ok = ReadArray(file, fileSize, &TracingEngine::meshes, header.numMeshes)
+		&& ReadArray(file, fileSize, &TracingEngine::triangles, header.numTriangles)
+		&& ReadArray(file, fileSize, &TracingEngine::triangleSourceIndices, header.numTriangles)
+		&& ReadArray(file, fileSize, &TracingEngine::nodes, header.numNodes)
+		&& ReadArray(file, fileSize, &TracingEngine::spheres, header.numSpheres)
+		&& ReadArray(file, fileSize, &TracingEngine::gravityBodies, header.numGravityBodies)
+		&& ReadArray(file, fileSize, &TracingEngine::focusRegions, header.numFocusRegions);
+
+	if (!ok)
+	{
+		TraceLog(LOG_ERROR, "SCENE: %s is truncated or corrupt", fileName);
+		return false;
+	}
+
+	TracingEngine::skyMaterial = header.skyMaterial;
+	TracingEngine::totalTriangles = header.numTriangles;
+	TracingEngine::sphereRootNode = header.sphereRootNode;
+	TracingEngine::sphereBvhDepth = header.sphereBvhDepth;
+
+	TracingEngine::UploadCompiledData();
+
+	TraceLog(LOG_INFO, "SCENE: Loaded compiled %s, %i triangles, %i nodes", fileName, header.numTriangles, header.numNodes);
+	return true;
+}
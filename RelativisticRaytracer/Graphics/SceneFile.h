@@ -0,0 +1,83 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+#include <raylib.h>
+
+#include "TracingEngine.h"
+
+// "RRSC" little endian
+#define COMPILED_SCENE_MAGIC 0x43535252
+#define COMPILED_SCENE_VERSION 3
+
+struct SceneSettings
+{
+	int width;
+	int height;
+	int maxBounces;
+	int raysPerPixel;
+	float blur;
+	Camera camera;
+};
+
+struct SceneModel
+{
+	// "file" loads path, the raylib mesh generators take their arguments from params
+	std::string source;
+	std::string path;
+	float params[4];
+	std::string material;
+	int bvhDepth;
+	int indexed;
+	Matrix transform;
+};
+
+struct SceneDescription
+{
+	SceneSettings settings;
+	SkyMaterial skyMaterial;
+	std::map<std::string, RaytracingMaterial> materials;
+	std::vector<SceneModel> models;
+	std::vector<Sphere> spheres;
+	std::vector<GravityBody> gravityBodies;
+	std::vector<FocusRegion> focusRegions;
+};
+
+struct CompiledSceneHeader
+{
+	unsigned int magic;
+	unsigned int version;
+	SceneSettings settings;
+	SkyMaterial skyMaterial;
+	int numMeshes;
+	int numTriangles;
+	int numNodes;
+	int numSpheres;
+	// the sphere tree is part of the nodes, the spheres are stored in its leaf order
+	int sphereRootNode;
+	int sphereBvhDepth;
+	int numGravityBodies;
+	int numFocusRegions;
+};
+
+class SceneFile
+{
+private:
+	static bool ParseLine(const std::string& line, SceneDescription* scene, std::string* error);
+
+public:
+	static SceneDescription DefaultDescription();
+
+	// text form, meant for authoring
+	static bool LoadDescription(const char* fileName, SceneDescription* scene);
+	// loads the models of a description into TracingEngine and builds the BVHs, call after TracingEngine::Initialize
+	static void Build(const SceneDescription& scene, std::vector<Model>* models);
+
+	// binary form, the engine's triangles, nodes and meshes exactly as uploaded so nothing is rebuilt on load
+	static bool IsCompiled(const char* fileName);
+	static bool SaveCompiled(const char* fileName, const SceneSettings& settings);
+	static bool ReadCompiledHeader(const char* fileName, CompiledSceneHeader* header);
+	// reads straight into TracingEngine's vectors and uploads them, call after TracingEngine::Initialize
+	static bool LoadCompiled(const char* fileName);
+};
@@ -0,0 +1,87 @@
+#include "ShaderBufferPool.h"
+
+#include <algorithm>
+#include <rlgl.h>
+#include <external/glad.h>
+
+#include "MemoryTracker.h"
+
+// never zero sized, an empty buffer is bound as one too small to hold an element
+#define MIN_BUFFER_SIZE 16u
+
+PooledBuffer ShaderBufferPool::Acquire(unsigned int size)
+{
+	int best = -1;
+
+	for (int i = 0; i < (int)available.size(); i++)
+	{
+		if (available[i].capacity >= size && (best < 0 || available[i].capacity < available[best].capacity))
+		{
+			best = i;
+		}
+	}
+
+	if (best >= 0)
+	{
+		PooledBuffer buffer = available[best];
+		available.erase(available.begin() + best);
+		return buffer;
+	}
+
+	// a quarter extra, so the next scene being slightly larger still fits
+	unsigned int capacity = std::max(size + size / 4, MIN_BUFFER_SIZE);
+	allocatedBytes += capacity;
+	MemoryTracker::Add(MEMORY_GPU_GEOMETRY, capacity, 0);
+
+	return PooledBuffer{ rlLoadShaderBuffer(capacity, NULL, RL_DYNAMIC_COPY), capacity, 0 };
+}
+
+void ShaderBufferPool::Upload(PooledBuffer* buffer, const void* data, unsigned int size)
+{
+	if (buffer->id == 0 || buffer->capacity < size)
+	{
+		Release(buffer);
+		*buffer = Acquire(size);
+	}
+
+	MemoryTracker::Add(MEMORY_GPU_GEOMETRY, 0, (long long)size - buffer->size);
+	buffer->size = size;
+
+	if (size > 0)
+	{
+		rlUpdateShaderBuffer(buffer->id, data, size, 0);
+	}
+}
+
+void ShaderBufferPool::Release(PooledBuffer* buffer)
+{
+	if (buffer->id != 0)
+	{
+		MemoryTracker::Add(MEMORY_GPU_GEOMETRY, 0, -(long long)buffer->size);
+		available.push_back(PooledBuffer{ buffer->id, buffer->capacity, 0 });
+	}
+
+	*buffer = PooledBuffer{ 0, 0, 0 };
+}
+
+void ShaderBufferPool::Bind(const PooledBuffer& buffer, unsigned int index)
+{
+	if (buffer.id == 0)
+	{
+		return;
+	}
+
+	glBindBufferRange(GL_SHADER_STORAGE_BUFFER, index, buffer.id, 0, std::max(buffer.size, MIN_BUFFER_SIZE));
+}
+
+void ShaderBufferPool::Unload()
+{
+	for (PooledBuffer& buffer : available)
+	{
+		rlUnloadShaderBuffer(buffer.id);
+		allocatedBytes -= buffer.capacity;
+		MemoryTracker::Add(MEMORY_GPU_GEOMETRY, -(long long)buffer.capacity, 0);
+	}
+
+	available.clear();
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <vector>
+
+// a shader storage buffer that can hold more than it currently does, only size bytes are bound
+struct PooledBuffer
+{
+	unsigned int id;
+	unsigned int capacity;
+	unsigned int size;
+};
+
+// SSBOs a scene gives back when it is reset and the next one takes over, so switching between
+// scenes of similar size rewrites buffers instead of reallocating them
+class ShaderBufferPool
+{
+private:
+	inline static std::vector<PooledBuffer> available;
+	inline static unsigned long long allocatedBytes = 0;
+
+	// the smallest pooled buffer that fits, or a new one with some headroom
+	static PooledBuffer Acquire(unsigned int size);
+
+public:
+	// writes size bytes into the buffer, swapping it for a larger one from the pool if it has to grow
+	static void Upload(PooledBuffer* buffer, const void* data, unsigned int size);
+	// hands the buffer back, it reads as empty afterwards
+	static void Release(PooledBuffer* buffer);
+	// binds the used range only, so length() in the shaders counts the scene and not the capacity
+	static void Bind(const PooledBuffer& buffer, unsigned int index);
+
+	// in use and pooled
+	static unsigned long long GetAllocatedBytes() { return allocatedBytes; }
+	static int GetAvailableCount() { return (int)available.size(); }
+
+	// frees the pooled buffers, the ones still handed out stay with their owners
+	static void Unload();
+};
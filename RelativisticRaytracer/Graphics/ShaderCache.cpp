@@ -0,0 +1,255 @@
+#include "ShaderCache.h"
+
+#include <rlgl.h>
+#include <external/glad.h>
+#include <cstring>
+#include <vector>
+
+const char* ShaderCache::defaultVertexShader =
+	"#version 330\n"
+	"in vec3 vertexPosition;\n"
+	"in vec2 vertexTexCoord;\n"
+	"in vec4 vertexColor;\n"
+	"out vec2 fragTexCoord;\n"
+	"out vec4 fragColor;\n"
+	"uniform mat4 mvp;\n"
+	"void main()\n"
+	"{\n"
+	"    fragTexCoord = vertexTexCoord;\n"
+	"    fragColor = vertexColor;\n"
+	"    gl_Position = mvp*vec4(vertexPosition, 1.0);\n"
+	"}\n";
+
+unsigned long long ShaderCache::Fnv1a(const std::string& text, unsigned long long hash)
+{
+	for (unsigned char c : text)
+	{
+		hash ^= c;
+		hash *= 1099511628211ull;
+	}
+
+	return hash;
+}
+
+std::string ShaderCache::LoadSource(const std::string& fileName, std::vector<std::string>* files)
+{
+	if (files != nullptr)
+	{
+		files->push_back(fileName);
+	}
+
+	char* text = LoadFileText(fileName.c_str());
+
+	if (text == nullptr)
+	{
+		return "";
+	}
+
+	std::string source = text;
+	UnloadFileText(text);
+
+	std::string directory = GetDirectoryPath(fileName.c_str());
+	const std::string directive = "#include \"";
+	size_t position = 0;
+
+	while ((position = source.find(directive, position)) != std::string::npos)
+	{
+		if (position > 0 && source[position - 1] != '\n')
+		{
+			position += directive.size();
+			continue;
+		}
+
+		size_t nameStart = position + directive.size();
+		size_t nameEnd = source.find('"', nameStart);
+		size_t lineEnd = source.find('\n', position);
+		std::string included = LoadSource(directory + "/" + source.substr(nameStart, nameEnd - nameStart), files);
+
+		source.replace(position, lineEnd - position, included);
+		position += included.size();
+	}
+
+	return source;
+}
+
+std::string ShaderCache::InsertDefines(const std::string& source, const std::string& defines)
+{
+	std::string code = source;
+	code.insert(code.find('\n') + 1, defines);
+	return code;
+}
+
+Shader ShaderCache::FromProgram(unsigned int id)
+{
+	// the same locations LoadShaderFromMemory looks up
+	Shader shader = { id, (int*)MemAlloc(RL_MAX_SHADER_LOCATIONS * sizeof(int)) };
+
+	for (int i = 0; i < RL_MAX_SHADER_LOCATIONS; i++)
+	{
+		shader.locs[i] = -1;
+	}
+
+	shader.locs[SHADER_LOC_VERTEX_POSITION] = rlGetLocationAttrib(id, RL_DEFAULT_SHADER_ATTRIB_NAME_POSITION);
+	shader.locs[SHADER_LOC_VERTEX_TEXCOORD01] = rlGetLocationAttrib(id, RL_DEFAULT_SHADER_ATTRIB_NAME_TEXCOORD);
+	shader.locs[SHADER_LOC_VERTEX_TEXCOORD02] = rlGetLocationAttrib(id, RL_DEFAULT_SHADER_ATTRIB_NAME_TEXCOORD2);
+	shader.locs[SHADER_LOC_VERTEX_NORMAL] = rlGetLocationAttrib(id, RL_DEFAULT_SHADER_ATTRIB_NAME_NORMAL);
+	shader.locs[SHADER_LOC_VERTEX_TANGENT] = rlGetLocationAttrib(id, RL_DEFAULT_SHADER_ATTRIB_NAME_TANGENT);
+	shader.locs[SHADER_LOC_VERTEX_COLOR] = rlGetLocationAttrib(id, RL_DEFAULT_SHADER_ATTRIB_NAME_COLOR);
+	shader.locs[SHADER_LOC_MATRIX_MVP] = rlGetLocationUniform(id, RL_DEFAULT_SHADER_UNIFORM_NAME_MVP);
+	shader.locs[SHADER_LOC_MATRIX_VIEW] = rlGetLocationUniform(id, RL_DEFAULT_SHADER_UNIFORM_NAME_VIEW);
+	shader.locs[SHADER_LOC_MATRIX_PROJECTION] = rlGetLocationUniform(id, RL_DEFAULT_SHADER_UNIFORM_NAME_PROJECTION);
+	shader.locs[SHADER_LOC_MATRIX_MODEL] = rlGetLocationUniform(id, RL_DEFAULT_SHADER_UNIFORM_NAME_MODEL);
+	shader.locs[SHADER_LOC_MATRIX_NORMAL] = rlGetLocationUniform(id, RL_DEFAULT_SHADER_UNIFORM_NAME_NORMAL);
+	shader.locs[SHADER_LOC_COLOR_DIFFUSE] = rlGetLocationUniform(id, RL_DEFAULT_SHADER_UNIFORM_NAME_COLOR);
+	shader.locs[SHADER_LOC_MAP_DIFFUSE] = rlGetLocationUniform(id, RL_DEFAULT_SHADER_SAMPLER2D_NAME_TEXTURE0);
+	shader.locs[SHADER_LOC_MAP_SPECULAR] = rlGetLocationUniform(id, RL_DEFAULT_SHADER_SAMPLER2D_NAME_TEXTURE1);
+	shader.locs[SHADER_LOC_MAP_NORMAL] = rlGetLocationUniform(id, RL_DEFAULT_SHADER_SAMPLER2D_NAME_TEXTURE2);
+
+	return shader;
+}
+
+void ShaderCache::Save(const std::string& path, Shader shader)
+{
+	GLint length = 0;
+	glGetProgramiv(shader.id, GL_PROGRAM_BINARY_LENGTH, &length);
+
+	if (length <= 0)
+	{
+		TraceLog(LOG_WARNING, "SHADERCACHE: The driver returned no binary for %s, nothing is cached", path.c_str());
+		return;
+	}
+
+	std::vector<unsigned char> file(sizeof(ShaderCacheHeader) + length);
+	ShaderCacheHeader header = { SHADER_CACHE_MAGIC, 0, 0 };
+	GLenum format = 0;
+	GLsizei written = 0;
+	glGetProgramBinary(shader.id, length, &written, &format, file.data() + sizeof(ShaderCacheHeader));
+
+	header.format = format;
+	header.length = written;
+	memcpy(file.data(), &header, sizeof(header));
+
+	if (!DirectoryExists(directory.c_str()))
+	{
+		MakeDirectory(directory.c_str());
+	}
+
+	if (!SaveFileData(path.c_str(), file.data(), (int)(sizeof(ShaderCacheHeader) + written)))
+	{
+		TraceLog(LOG_WARNING, "SHADERCACHE: Failed to write %s", path.c_str());
+	}
+}
+
+unsigned int ShaderCache::Link(const std::string& fragmentSource)
+{
+	// rlCompileShader logs the compile errors
+	unsigned int vertex = rlCompileShader(defaultVertexShader, RL_VERTEX_SHADER);
+	unsigned int fragment = rlCompileShader(fragmentSource.c_str(), RL_FRAGMENT_SHADER);
+
+	if (vertex == 0 || fragment == 0)
+	{
+		glDeleteShader(vertex);
+		glDeleteShader(fragment);
+		return 0;
+	}
+
+	GLuint program = glCreateProgram();
+	glAttachShader(program, vertex);
+	glAttachShader(program, fragment);
+
+	// the attribute slots rlgl's batches feed
+	glBindAttribLocation(program, RL_DEFAULT_SHADER_ATTRIB_LOCATION_POSITION, RL_DEFAULT_SHADER_ATTRIB_NAME_POSITION);
+	glBindAttribLocation(program, RL_DEFAULT_SHADER_ATTRIB_LOCATION_TEXCOORD, RL_DEFAULT_SHADER_ATTRIB_NAME_TEXCOORD);
+	glBindAttribLocation(program, RL_DEFAULT_SHADER_ATTRIB_LOCATION_NORMAL, RL_DEFAULT_SHADER_ATTRIB_NAME_NORMAL);
+	glBindAttribLocation(program, RL_DEFAULT_SHADER_ATTRIB_LOCATION_COLOR, RL_DEFAULT_SHADER_ATTRIB_NAME_COLOR);
+	glBindAttribLocation(program, RL_DEFAULT_SHADER_ATTRIB_LOCATION_TANGENT, RL_DEFAULT_SHADER_ATTRIB_NAME_TANGENT);
+	glBindAttribLocation(program, RL_DEFAULT_SHADER_ATTRIB_LOCATION_TEXCOORD2, RL_DEFAULT_SHADER_ATTRIB_NAME_TEXCOORD2);
+
+	glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	glLinkProgram(program);
+
+	glDetachShader(program, vertex);
+	glDetachShader(program, fragment);
+	glDeleteShader(vertex);
+	glDeleteShader(fragment);
+
+	GLint linked = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &linked);
+
+	if (!linked)
+	{
+		char log[4096];
+		glGetProgramInfoLog(program, sizeof(log), nullptr, log);
+		TraceLog(LOG_WARNING, "SHADERCACHE: Link failed\n%s", log);
+		glDeleteProgram(program);
+		return 0;
+	}
+
+	return program;
+}
+
+Shader ShaderCache::Load(const std::string& fragmentSource)
+{
+	GLint numFormats = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &numFormats);
+
+	if (!enabled || numFormats == 0)
+	{
+		return LoadShaderFromMemory(0, fragmentSource.c_str());
+	}
+
+	// binaries only load on the driver that made them, raylib's default vertex shader is linked in too
+	std::string driver = std::string((const char*)glGetString(GL_VENDOR)) + (const char*)glGetString(GL_RENDERER)
+		+ (const char*)glGetString(GL_VERSION) + RAYLIB_VERSION;
+	unsigned long long key = Fnv1a(fragmentSource, Fnv1a(driver));
+	std::string path = TextFormat("%s/%016llx.bin", directory.c_str(), key);
+
+	double start = GetTime();
+
+	if (FileExists(path.c_str()))
+	{
+		int size = 0;
+		unsigned char* data = LoadFileData(path.c_str(), &size);
+		ShaderCacheHeader header = {};
+
+		if (data != nullptr && size >= (int)sizeof(header))
+		{
+			memcpy(&header, data, sizeof(header));
+		}
+
+		if (header.magic == SHADER_CACHE_MAGIC && header.length == size - (int)sizeof(header))
+		{
+			GLuint program = glCreateProgram();
+			glProgramBinary(program, header.format, data + sizeof(header), header.length);
+
+			GLint linked = GL_FALSE;
+			glGetProgramiv(program, GL_LINK_STATUS, &linked);
+
+			if (linked)
+			{
+				UnloadFileData(data);
+				TraceLog(LOG_INFO, "SHADERCACHE: Loaded %016llx in %.1f ms", key, (GetTime() - start) * 1000.0);
+				return FromProgram(program);
+			}
+
+			glDeleteProgram(program);
+		}
+
+		UnloadFileData(data);
+		TraceLog(LOG_WARNING, "SHADERCACHE: %s was rejected, recompiling", path.c_str());
+	}
+
+	unsigned int program = Link(fragmentSource);
+
+	// the default shader stands in for one that failed, as with LoadShaderFromMemory, and is not worth caching
+	if (program == 0)
+	{
+		return Shader{ rlGetShaderIdDefault(), rlGetShaderLocsDefault() };
+	}
+
+	Shader shader = FromProgram(program);
+	Save(path, shader);
+	TraceLog(LOG_INFO, "SHADERCACHE: Compiled %016llx in %.1f ms", key, (GetTime() - start) * 1000.0);
+
+	return shader;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <raylib.h>
+
+// "RRPB" little endian
+#define SHADER_CACHE_MAGIC 0x42505252
+
+// written before the driver's program binary
+struct ShaderCacheHeader
+{
+	unsigned int magic;
+	unsigned int format;
+	int length;
+};
+
+// linked program binaries on disk, keyed by an FNV-1a hash of the fragment source and the driver
+// so each variant only pays for compiling once per machine and driver version
+class ShaderCache
+{
+private:
+	static void Save(const std::string& path, Shader shader);
+	// links the default vertex stage with fragmentSource like LoadShaderFromMemory, but asks the driver to keep
+	// the binary retrievable first, some only hand one out then. 0 when compiling or linking fails
+	static unsigned int Link(const std::string& fragmentSource);
+
+public:
+	// raylib's default vertex shader, so programs linked here draw like ones from LoadShaderFromMemory
+	static const char* defaultVertexShader;
+
+	inline static std::string directory = "shader_cache";
+	inline static bool enabled = true;
+
+	static unsigned long long Fnv1a(const std::string& text, unsigned long long hash = 14695981039346656037ull);
+
+	// wraps a linked program in a Shader with the locations raylib would have looked up
+	static Shader FromProgram(unsigned int id);
+
+	// shader text with every #include "file" line replaced by that file, relative to the including one. files
+	// collects the path of every file read, the included ones too
+	static std::string LoadSource(const std::string& fileName, std::vector<std::string>* files = nullptr);
+	// defines have to follow the #version line
+	static std::string InsertDefines(const std::string& source, const std::string& defines);
+
+	// same as LoadShaderFromMemory with raylib's default vertex shader, compiles and stores the
+	// binary when there is no cached one or the driver rejects it
+	static Shader Load(const std::string& fragmentSource);
+};
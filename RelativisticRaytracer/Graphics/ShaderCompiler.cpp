@@ -0,0 +1,268 @@
+#include "ShaderCompiler.h"
+#include "ShaderCache.h"
+
+#include <raylib.h>
+#include <rlgl.h>
+#include <external/glad.h>
+#define GLFW_INCLUDE_NONE
+#include <external/glfw/include/GLFW/glfw3.h>
+
+bool ShaderCompiler::Start()
+{
+	if (context != nullptr)
+	{
+		return true;
+	}
+
+	GLFWwindow* mainWindow = glfwGetCurrentContext();
+
+	if (mainWindow == nullptr)
+	{
+		return false;
+	}
+
+	// the context hints raylib created its window with are still set, so the versions match
+	glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+	GLFWwindow* window = glfwCreateWindow(1, 1, "shader compiler", nullptr, mainWindow);
+	glfwMakeContextCurrent(mainWindow);
+
+	if (window == nullptr)
+	{
+		TraceLog(LOG_WARNING, "SHADERCOMPILER: Failed to create a shared context");
+		return false;
+	}
+
+	context = window;
+	stopping = false;
+	worker = std::thread(WorkerLoop);
+
+	return true;
+}
+
+void ShaderCompiler::Stop()
+{
+	if (context == nullptr)
+	{
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+
+	jobAvailable.notify_all();
+	worker.join();
+
+	// builds nobody collected still own their programs
+	for (ShaderBuild& build : finished)
+	{
+		for (unsigned int program : build.programs)
+		{
+			glDeleteProgram(program);
+		}
+
+		glDeleteSync((GLsync)build.fence);
+	}
+
+	pending.clear();
+	finished.clear();
+
+	glfwDestroyWindow((GLFWwindow*)context);
+	context = nullptr;
+}
+
+void ShaderCompiler::Submit(int id, const std::string& tag, const std::vector<std::string>& sources, bool compute,
+	const std::string& vertexSource)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		// a newer edit of the same programs makes a queued build pointless
+		for (ShaderBuild& build : pending)
+		{
+			if (build.id == id)
+			{
+				build.tag = tag;
+				build.sources = sources;
+				build.compute = compute;
+				build.vertexSource = vertexSource;
+				return;
+			}
+		}
+
+		pending.push_back({ id, tag, sources, compute, vertexSource, {}, false, nullptr });
+	}
+
+	jobAvailable.notify_one();
+}
+
+std::vector<ShaderBuild> ShaderCompiler::CollectFinished()
+{
+	std::vector<ShaderBuild> ready;
+	std::lock_guard<std::mutex> lock(mutex);
+
+	for (auto it = finished.begin(); it != finished.end();)
+	{
+		// the programs are only complete for this context once the worker's commands have executed
+		GLenum status = glClientWaitSync((GLsync)it->fence, 0, 0);
+
+		if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+		{
+			++it;
+			continue;
+		}
+
+		glDeleteSync((GLsync)it->fence);
+		it->fence = nullptr;
+		ready.push_back(std::move(*it));
+		it = finished.erase(it);
+	}
+
+	return ready;
+}
+
+void ShaderCompiler::WorkerLoop()
+{
+	glfwMakeContextCurrent((GLFWwindow*)context);
+
+	while (true)
+	{
+		ShaderBuild build;
+
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			jobAvailable.wait(lock, [] { return stopping || !pending.empty(); });
+
+			if (stopping)
+			{
+				break;
+			}
+
+			build = std::move(pending.front());
+			pending.pop_front();
+		}
+
+		double start = GetTime();
+		build.linked = true;
+
+		for (const std::string& source : build.sources)
+		{
+			unsigned int program = !build.linked ? 0 : build.compute ? LinkCompute(source) : Link(build.vertexSource, source);
+			build.linked = program != 0;
+			build.programs.push_back(program);
+		}
+
+		if (!build.linked)
+		{
+			for (unsigned int program : build.programs)
+			{
+				if (program != 0) glDeleteProgram(program);
+			}
+
+			build.programs.clear();
+		}
+		else
+		{
+			TraceLog(LOG_INFO, "SHADERCOMPILER: Built %i programs in %.0f ms", (int)build.programs.size(), (GetTime() - start) * 1000.0);
+		}
+
+		build.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		glFlush();
+
+		std::lock_guard<std::mutex> lock(mutex);
+		finished.push_back(std::move(build));
+	}
+
+	glfwMakeContextCurrent(nullptr);
+}
+
+unsigned int ShaderCompiler::CompileStage(unsigned int type, const char* source)
+{
+	GLuint shader = glCreateShader(type);
+	glShaderSource(shader, 1, &source, nullptr);
+	glCompileShader(shader);
+
+	GLint compiled = GL_FALSE;
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+
+	if (!compiled)
+	{
+		char log[4096];
+		glGetShaderInfoLog(shader, sizeof(log), nullptr, log);
+		TraceLog(LOG_WARNING, "SHADERCOMPILER: Compile failed, keeping the running program\n%s", log);
+		glDeleteShader(shader);
+		return 0;
+	}
+
+	return shader;
+}
+
+unsigned int ShaderCompiler::Link(const std::string& vertexSource, const std::string& fragmentSource)
+{
+	GLuint vertex = CompileStage(GL_VERTEX_SHADER, vertexSource.empty() ? ShaderCache::defaultVertexShader : vertexSource.c_str());
+	GLuint fragment = CompileStage(GL_FRAGMENT_SHADER, fragmentSource.c_str());
+
+	if (vertex == 0 || fragment == 0)
+	{
+		glDeleteShader(vertex);
+		glDeleteShader(fragment);
+		return 0;
+	}
+
+	GLuint program = glCreateProgram();
+	glAttachShader(program, vertex);
+	glAttachShader(program, fragment);
+
+	// the attribute slots rlgl's batches feed
+	glBindAttribLocation(program, RL_DEFAULT_SHADER_ATTRIB_LOCATION_POSITION, RL_DEFAULT_SHADER_ATTRIB_NAME_POSITION);
+	glBindAttribLocation(program, RL_DEFAULT_SHADER_ATTRIB_LOCATION_TEXCOORD, RL_DEFAULT_SHADER_ATTRIB_NAME_TEXCOORD);
+	glBindAttribLocation(program, RL_DEFAULT_SHADER_ATTRIB_LOCATION_NORMAL, RL_DEFAULT_SHADER_ATTRIB_NAME_NORMAL);
+	glBindAttribLocation(program, RL_DEFAULT_SHADER_ATTRIB_LOCATION_COLOR, RL_DEFAULT_SHADER_ATTRIB_NAME_COLOR);
+	glBindAttribLocation(program, RL_DEFAULT_SHADER_ATTRIB_LOCATION_TANGENT, RL_DEFAULT_SHADER_ATTRIB_NAME_TANGENT);
+	glBindAttribLocation(program, RL_DEFAULT_SHADER_ATTRIB_LOCATION_TEXCOORD2, RL_DEFAULT_SHADER_ATTRIB_NAME_TEXCOORD2);
+
+	glLinkProgram(program);
+
+	glDetachShader(program, vertex);
+	glDetachShader(program, fragment);
+	glDeleteShader(vertex);
+	glDeleteShader(fragment);
+
+	return CheckLinked(program) ? program : 0;
+}
+
+unsigned int ShaderCompiler::LinkCompute(const std::string& computeSource)
+{
+	GLuint compute = CompileStage(GL_COMPUTE_SHADER, computeSource.c_str());
+
+	if (compute == 0)
+	{
+		return 0;
+	}
+
+	GLuint program = glCreateProgram();
+	glAttachShader(program, compute);
+	glLinkProgram(program);
+	glDetachShader(program, compute);
+	glDeleteShader(compute);
+
+	return CheckLinked(program) ? program : 0;
+}
+
+bool ShaderCompiler::CheckLinked(unsigned int program)
+{
+	GLint linked = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &linked);
+
+	if (!linked)
+	{
+		char log[4096];
+		glGetProgramInfoLog(program, sizeof(log), nullptr, log);
+		TraceLog(LOG_WARNING, "SHADERCOMPILER: Link failed, keeping the running program\n%s", log);
+		glDeleteProgram(program);
+		return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// a set of programs that are swapped in together, programs are 0 until they all linked
+struct ShaderBuild
+{
+	int id;
+	std::string tag;
+	// a fragment shader per program, or a compute shader per program when compute is set
+	std::vector<std::string> sources;
+	bool compute;
+	// vertex stage of every fragment program, raylib's default one when empty
+	std::string vertexSource;
+	std::vector<unsigned int> programs;
+	bool linked;
+	void* fence;
+};
+
+// compiles and links programs on a background thread with its own GL context, shared with the
+// main one, so editing a shader never stalls a frame
+class ShaderCompiler
+{
+private:
+	// GLFWwindow, hidden, created on the main thread as GLFW requires
+	inline static void* context = nullptr;
+	inline static std::thread worker;
+	inline static std::mutex mutex;
+	inline static std::condition_variable jobAvailable;
+	inline static std::deque<ShaderBuild> pending;
+	inline static std::deque<ShaderBuild> finished;
+	inline static bool stopping = false;
+
+	static void WorkerLoop();
+	static unsigned int CompileStage(unsigned int type, const char* source);
+	static unsigned int Link(const std::string& vertexSource, const std::string& fragmentSource);
+	static unsigned int LinkCompute(const std::string& computeSource);
+	// false with the log written when the program did not link, which is then deleted
+	static bool CheckLinked(unsigned int program);
+
+public:
+	// call from the main thread after InitWindow, false when no shared context could be made
+	static bool Start();
+	static void Stop();
+	static bool IsRunning() { return context != nullptr; }
+
+	static void Submit(int id, const std::string& tag, const std::vector<std::string>& sources, bool compute = false,
+		const std::string& vertexSource = "");
+
+	// builds the main context can use now, the worker's GL commands are known to have completed,
+	// failed builds come back with linked false and no programs
+	static std::vector<ShaderBuild> CollectFinished();
+};
@@ -0,0 +1,123 @@
+#include "ThreadPool.h"
+
+#include <atomic>
+#include <algorithm>
+
+ThreadPool::ThreadPool(unsigned int numThreads)
+{
+	// the caller of ParallelFor works too, so one less worker than hardware threads
+	int numWorkers = std::max(1, (int)numThreads - 1);
+
+	for (int i = 0; i < numWorkers; i++)
+	{
+		workers.emplace_back(&ThreadPool::WorkerLoop, this);
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+
+	jobAvailable.notify_all();
+
+	for (std::thread& worker : workers)
+	{
+		worker.join();
+	}
+}
+
+bool ThreadPool::RunPendingJob(std::unique_lock<std::mutex>& lock)
+{
+	if (jobs.empty())
+	{
+		return false;
+	}
+
+	std::function<void()> job = std::move(jobs.front());
+	jobs.pop();
+
+	lock.unlock();
+	job();
+	lock.lock();
+
+	return true;
+}
+
+void ThreadPool::WorkerLoop()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+
+	while (true)
+	{
+		jobAvailable.wait(lock, [this] { return stopping || !jobs.empty(); });
+
+		if (stopping && jobs.empty())
+		{
+			return;
+		}
+
+		RunPendingJob(lock);
+	}
+}
+
+void ThreadPool::ParallelFor(int count, const std::function<void(int begin, int end)>& body, int minChunk)
+{
+	int numChunks = std::min(GetThreadCount(), (count + minChunk - 1) / std::max(1, minChunk));
+
+	if (numChunks <= 1)
+	{
+		if (count > 0) body(0, count);
+		return;
+	}
+
+	int chunkSize = (count + numChunks - 1) / numChunks;
+	std::atomic<int> remaining = numChunks - 1;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		for (int c = 1; c < numChunks; c++)
+		{
+			int begin = c * chunkSize;
+			int end = std::min(count, begin + chunkSize);
+
+			jobs.push([this, &body, &remaining, begin, end]
+				{
+					if (begin < end) body(begin, end);
+
+					if (--remaining == 0)
+					{
+						std::lock_guard<std::mutex> lock(mutex);
+						jobFinished.notify_all();
+					}
+				});
+		}
+	}
+
+	jobAvailable.notify_all();
+
+	body(0, std::min(count, chunkSize));
+
+	std::unique_lock<std::mutex> lock(mutex);
+
+	while (remaining > 0)
+	{
+		if (!RunPendingJob(lock))
+		{
+			jobFinished.wait(lock, [&remaining, this] { return remaining == 0 || !jobs.empty(); });
+		}
+	}
+}
+
+void ThreadPool::Submit(std::function<void()> job)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		jobs.push(std::move(job));
+	}
+
+	jobAvailable.notify_one();
+}
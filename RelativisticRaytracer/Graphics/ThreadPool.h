@@ -0,0 +1,35 @@
+#pragma once
+
+#include <vector>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+class ThreadPool
+{
+private:
+	std::vector<std::thread> workers;
+	std::queue<std::function<void()>> jobs;
+	std::mutex mutex;
+	std::condition_variable jobAvailable;
+	std::condition_variable jobFinished;
+	bool stopping = false;
+
+	void WorkerLoop();
+	bool RunPendingJob(std::unique_lock<std::mutex>& lock);
+
+public:
+	ThreadPool(unsigned int numThreads = std::thread::hardware_concurrency());
+	~ThreadPool();
+
+	int GetThreadCount() { return (int)workers.size() + 1; }
+
+	// splits [0, count) into chunks of at least minChunk items and blocks until every chunk has run,
+	// the calling thread takes part in the work so this is safe to call from inside a job
+	void ParallelFor(int count, const std::function<void(int begin, int end)>& body, int minChunk = 64);
+
+	// queues a job for the workers and returns straight away, the job has to signal its own completion
+	void Submit(std::function<void()> job);
+};
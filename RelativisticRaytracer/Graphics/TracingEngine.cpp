@@ -1,465 +1,2424 @@
 #include "TracingEngine.h"
+#include "Profiler.h"
+#include "ShaderCache.h"
+#include "WavefrontTracer.h"
+#include "GpuBVHBuilder.h"
+#include "EnvironmentMap.h"
 
 #include <rlgl.h>
 #include <raymath.h>
+#include <external/glad.h>
 #include <iostream>
+#include <string>
+#include <cfloat>
+#include <iterator>
+#include <algorithm>
+
+// raylib's batches only bind four textures besides texture0, the raster is bound by hand past them
+#define RASTER_POSITION_UNIT 10
+#define RASTER_NORMAL_UNIT 11
+// the tracer's rays start at the camera, the raster's near plane sits as close as depth precision allows
+#define RASTER_NEAR_PLANE 0.01f
 
 void TracingEngine::Initialize(Vector2 resolution, int maxBounces, int raysPerPixel, float blur)
 {
-	numRenderedFrames = 0;
-	TracingEngine::resolution = resolution;
-	TracingEngine::maxBounces = maxBounces;
-	TracingEngine::raysPerPixel = raysPerPixel;
-	TracingEngine::blur = blur;
+	contexts.push_back(std::make_unique<RenderContext>());
+	activeContext = contexts.back().get();
+	activeContext->resolution = resolution;
+	activeContext->maxBounces = maxBounces;
+	activeContext->raysPerPixel = raysPerPixel;
+	activeContext->blur = blur;
+	activeContext->activeRaysPerPixel = raysPerPixel;
+	activeContext->activeBounces = maxBounces;
 
-	raytracingRenderTexture = LoadRenderTexture(resolution.x, resolution.y);
-	previouseFrameRenderTexture = LoadRenderTexture(resolution.x, resolution.y);
+	LoadRenderTargets(activeContext);
 
-	raytracingShader = LoadShader(0, TextFormat("resources/shaders/raytracer_fragment.glsl", 430));
 	postShader = LoadShader(0, TextFormat("resources/shaders/post_fragment.glsl", 430));
+	upscaleShader = LoadShader(0, TextFormat("resources/shaders/upscale_fragment.glsl", 430));
+
+	ResolvePostParams();
+	ResolveUpscaleParams();
+
+	rasterMaterial = LoadMaterialDefault();
+	rasterShader = Shader{ 0 };
+	SetRasterShader(LoadShader("resources/shaders/raster_vertex.glsl", "resources/shaders/raster_fragment.glsl"));
+
+	sobolDirections = Sampler::GenerateSobolDirections();
+
+	std::vector<float> blueNoise = Sampler::GenerateBlueNoise(BLUE_NOISE_SIZE, 1);
+	blueNoiseTexture.id = rlLoadTexture(blueNoise.data(), BLUE_NOISE_SIZE, BLUE_NOISE_SIZE, PIXELFORMAT_UNCOMPRESSED_R32, 1);
+	blueNoiseTexture.width = BLUE_NOISE_SIZE;
+	blueNoiseTexture.height = BLUE_NOISE_SIZE;
+	blueNoiseTexture.format = PIXELFORMAT_UNCOMPRESSED_R32;
+	blueNoiseTexture.mipmaps = 1;
+	MemoryTracker::Add(MEMORY_GPU_TEXTURES, MemoryTracker::TextureBytes(blueNoiseTexture));
+
+	gravityBodySSBO = rlLoadShaderBuffer(sizeof(GravityBodyBuffer), NULL, RL_DYNAMIC_COPY);
+	traversalStatsSSBO = rlLoadShaderBuffer(sizeof(TraversalStatsBuffer), NULL, RL_DYNAMIC_COPY);
+	MemoryTracker::Add(MEMORY_GPU_ENGINE_BUFFERS, sizeof(GravityBodyBuffer) + sizeof(TraversalStatsBuffer));
+
+	// nothing is known about the scene yet, so this is the variant with every feature
+	LoadTracingShaders(GetSceneVariant());
+
+	threadPool = std::make_unique<ThreadPool>();
+
+	Profiler::Initialize();
+}
+
+void TracingEngine::ResetScene(Vector2 resolution, int maxBounces, int raysPerPixel, float blur)
+{
+	CpuProfileScope scope("ResetScene");
+	double resetStart = GetTime();
+
+	ShaderBufferPool::Release(&sphereBuffer);
+	ShaderBufferPool::Release(&trianglesBuffer);
+	ShaderBufferPool::Release(&meshesBuffer);
+	ShaderBufferPool::Release(&nodesBuffer);
+
+	ClearSceneData();
+
+	if (resolution != activeContext->resolution)
+	{
+		UnloadRenderTargets(activeContext);
+		activeContext->resolution = resolution;
+		LoadRenderTargets(activeContext);
+	}
+
+	RestartView(maxBounces, raysPerPixel, blur);
+	RestartContexts();
+	UpdateMemoryUsage();
+	sceneVersion++;
+
+	lastSceneResetMs = (GetTime() - resetStart) * 1000.0;
+}
+
+void TracingEngine::RestartView(int maxBounces, int raysPerPixel, float blur)
+{
+	activeContext->maxBounces = maxBounces;
+	activeContext->raysPerPixel = raysPerPixel;
+	activeContext->blur = blur;
+	activeContext->activeRaysPerPixel = raysPerPixel;
+	activeContext->activeBounces = maxBounces;
+	activeContext->renderScale = 1;
+	activeContext->previousRenderScale = 1;
+	activeContext->qualityWork = 1;
+
+	// nothing in the targets is history for what is traced next
+	activeContext->numRenderedFrames = -1;
+	activeContext->accumulatedSamples = 0;
+	activeContext->sliceRow = 0;
+	WavefrontTracer::Restart(&activeContext->wavefront);
+
+	UploadShaderConstants();
+}
+
+void TracingEngine::RestartContexts()
+{
+	for (std::unique_ptr<RenderContext>& context : contexts)
+	{
+		context->numRenderedFrames = -1;
+		context->accumulatedSamples = 0;
+		context->activeSamplerType = -1;
+		context->sliceRow = 0;
+		WavefrontTracer::Restart(&context->wavefront);
+	}
+}
+
+RenderContext* TracingEngine::CreateContext(Vector2 resolution, int maxBounces, int raysPerPixel, float blur)
+{
+	// the settings carry over, the targets and history are the new context's own
+	std::unique_ptr<RenderContext> context = std::make_unique<RenderContext>();
+	static_cast<ViewSettings&>(*context) = *activeContext;
+	context->resolution = resolution;
+	LoadRenderTargets(context.get());
+
+	contexts.push_back(std::move(context));
+	activeContext = contexts.back().get();
+	RestartView(maxBounces, raysPerPixel, blur);
+
+	// the variant the other views are traced with can stop short of this view's bounces
+	SelectShaderVariant();
+
+	return activeContext;
+}
+
+void TracingEngine::UseContext(RenderContext* context)
+{
+	if (context == activeContext)
+	{
+		return;
+	}
+
+	// a sliced frame of the context picks up where it stopped, UploadData sends its uniforms again
+	activeContext = context;
+	UploadShaderConstants();
+}
+
+void TracingEngine::DestroyContext(RenderContext* context)
+{
+	if (context == activeContext)
+	{
+		TraceLog(LOG_WARNING, "TRACING: The active render context cannot be destroyed");
+		return;
+	}
+
+	UnloadRenderTargets(context);
+	std::erase_if(contexts, [context](const std::unique_ptr<RenderContext>& c) { return c.get() == context; });
+}
+
+void TracingEngine::ClearSceneData()
+{
+	// cleared rather than shrunk, a scene of similar size fills them again without reallocating
+	models.clear();
+	meshes.clear();
+	triangles.clear();
+	triangleSourceIndices.clear();
+	nodes.clear();
+	dirtyNodes.clear();
+	spheres.clear();
+	gravityBodies.clear();
+	focusRegions.clear();
+
+	// the per mesh bookkeeping points into the arena, so it has to go first
+	meshBVHInfos.clear();
+	sceneArena.release();
+
+	gravityBodyBuffer = {};
+	totalTriangles = 0;
+	totalMeshes = 0;
+	sphereRootNode = -1;
+	sphereBvhDepth = 0;
+}
+
+void TracingEngine::LoadRenderTargets(RenderContext* context)
+{
+	int width = (int)context->resolution.x;
+	int height = (int)context->resolution.y;
+
+	// float targets so long accumulations do not band and partial results can be merged exactly
+	context->accumulationTargets[0] = LoadAccumulationTarget(width, height);
+	context->accumulationTargets[1] = LoadAccumulationTarget(width, height);
+	context->filterRenderTextures[0] = LoadFloatRenderTexture(width, height);
+	context->filterRenderTextures[1] = LoadFloatRenderTexture(width, height);
+	context->upscaleRenderTexture = LoadFloatRenderTexture(width, height);
+	context->presentedTexture = context->accumulationTargets[0].color.texture;
+	// loaded when first drawn, see LoadRasterTarget, LoadPrimaryCache and WavefrontTracer::Render
+	context->rasterTarget = { 0 };
+	context->rasterNormal = { 0 };
+	std::fill(std::begin(context->primaryCacheTextures), std::end(context->primaryCacheTextures), Texture2D{ 0 });
+	context->primaryCacheRecorded = false;
+	context->wavefront = {};
+
+	MemoryTracker::Add(MEMORY_GPU_RENDER_TARGETS, GetRenderTargetBytes(context));
+}
+
+void TracingEngine::UnloadRenderTargets(RenderContext* context)
+{
+	MemoryTracker::Add(MEMORY_GPU_RENDER_TARGETS, -GetRenderTargetBytes(context));
+
+	for (AccumulationTarget& target : context->accumulationTargets)
+	{
+		UnloadRenderTexture(target.color);
+		UnloadTexture(target.normalDepth);
+		UnloadTexture(target.albedo);
+		UnloadTexture(target.emission);
+	}
+
+	UnloadRenderTexture(context->filterRenderTextures[0]);
+	UnloadRenderTexture(context->filterRenderTextures[1]);
+	UnloadRenderTexture(context->upscaleRenderTexture);
+
+	if (context->rasterTarget.id != 0)
+	{
+		UnloadRenderTexture(context->rasterTarget);
+		UnloadTexture(context->rasterNormal);
+	}
+
+	for (Texture2D& texture : context->primaryCacheTextures)
+	{
+		if (texture.id != 0)
+		{
+			UnloadTexture(texture);
+		}
+	}
+
+	if (context->wavefront.accumulation.id != 0)
+	{
+		UnloadRenderTexture(context->wavefront.accumulation);
+	}
+}
+
+void TracingEngine::LoadRasterTarget()
+{
+	activeContext->rasterTarget = LoadFloatRenderTexture(activeContext->resolution.x, activeContext->resolution.y);
+	activeContext->rasterNormal = AttachGBufferTexture(activeContext->rasterTarget, 1);
+
+	MemoryTracker::Add(MEMORY_GPU_RENDER_TARGETS, MemoryTracker::RenderTextureBytes(activeContext->rasterTarget) + MemoryTracker::TextureBytes(activeContext->rasterNormal));
+}
+
+void TracingEngine::LoadPrimaryCache()
+{
+	for (Texture2D& texture : activeContext->primaryCacheTextures)
+	{
+		texture.id = rlLoadTexture(NULL, activeContext->resolution.x, activeContext->resolution.y, PIXELFORMAT_UNCOMPRESSED_R32G32B32A32, 1);
+		texture.width = activeContext->resolution.x;
+		texture.height = activeContext->resolution.y;
+		texture.format = PIXELFORMAT_UNCOMPRESSED_R32G32B32A32;
+		texture.mipmaps = 1;
+
+		MemoryTracker::Add(MEMORY_GPU_RENDER_TARGETS, MemoryTracker::TextureBytes(texture));
+	}
+}
+
+long long TracingEngine::GetRenderTargetBytes(RenderContext* context)
+{
+	long long bytes = 0;
+
+	for (AccumulationTarget& target : context->accumulationTargets)
+	{
+		bytes += MemoryTracker::RenderTextureBytes(target.color);
+		bytes += MemoryTracker::TextureBytes(target.normalDepth);
+		bytes += MemoryTracker::TextureBytes(target.albedo);
+		bytes += MemoryTracker::TextureBytes(target.emission);
+	}
+
+	bytes += MemoryTracker::RenderTextureBytes(context->filterRenderTextures[0]);
+	bytes += MemoryTracker::RenderTextureBytes(context->filterRenderTextures[1]);
+	bytes += MemoryTracker::RenderTextureBytes(context->upscaleRenderTexture);
+	bytes += MemoryTracker::RenderTextureBytes(context->rasterTarget);
+	bytes += MemoryTracker::TextureBytes(context->rasterNormal);
+
+	for (Texture2D& texture : context->primaryCacheTextures)
+	{
+		bytes += MemoryTracker::TextureBytes(texture);
+	}
+
+	bytes += MemoryTracker::RenderTextureBytes(context->wavefront.accumulation);
+
+	return bytes;
+}
+
+void TracingEngine::UpdateMemoryUsage()
+{
+	// the gravity body array is sent whole, however few bodies there are
+	long long gravityBytes = sizeof(GravityBodyBuffer);
+	long long gravityUsedBytes = (long long)std::min(gravityBodies.size(), std::size(gravityBodyBuffer.gravityBodies)) * sizeof(GravityBody);
+
+	MemoryTracker::Set(MEMORY_HOST_GEOMETRY,
+		MemoryTracker::CapacityBytes(triangles) + MemoryTracker::CapacityBytes(triangleSourceIndices) + MemoryTracker::CapacityBytes(meshes) +
+		MemoryTracker::CapacityBytes(spheres) + MemoryTracker::CapacityBytes(gravityBodies) + gravityBytes,
+		MemoryTracker::SizeBytes(triangles) + MemoryTracker::SizeBytes(triangleSourceIndices) + MemoryTracker::SizeBytes(meshes) +
+		MemoryTracker::SizeBytes(spheres) + MemoryTracker::SizeBytes(gravityBodies) + gravityUsedBytes);
+
+	MemoryTracker::Set(MEMORY_HOST_BVH,
+		MemoryTracker::CapacityBytes(nodes) + MemoryTracker::CapacityBytes(dirtyNodes) + MemoryTracker::CapacityBytes(meshBVHInfos),
+		MemoryTracker::SizeBytes(nodes) + MemoryTracker::SizeBytes(dirtyNodes) + MemoryTracker::SizeBytes(meshBVHInfos));
+
+	// raylib uploads what it loads and keeps the host copy, the engine only holds on to the handles
+	long long modelBytes = 0;
+	long long modelGpuBytes = 0;
+
+	for (const Model& model : models)
+	{
+		long long bytes = MemoryTracker::ModelBytes(model);
+		modelBytes += bytes;
+		modelGpuBytes += model.meshCount > 0 && model.meshes[0].vaoId != 0 ? bytes : 0;
+	}
+
+	MemoryTracker::Set(MEMORY_HOST_MODELS, modelBytes);
+	MemoryTracker::Set(MEMORY_GPU_MODELS, modelGpuBytes);
+}
+
+RenderTexture2D TracingEngine::LoadFloatRenderTexture(int width, int height)
+{
+	RenderTexture2D target = { 0 };
+
+	target.id = rlLoadFramebuffer();
+	rlEnableFramebuffer(target.id);
+
+	target.texture.id = rlLoadTexture(NULL, width, height, PIXELFORMAT_UNCOMPRESSED_R32G32B32A32, 1);
+	target.texture.width = width;
+	target.texture.height = height;
+	target.texture.format = PIXELFORMAT_UNCOMPRESSED_R32G32B32A32;
+	target.texture.mipmaps = 1;
+
+	target.depth.id = rlLoadTextureDepth(width, height, true);
+	target.depth.width = width;
+	target.depth.height = height;
+	target.depth.format = 19; // DEPTH_COMPONENT_24BIT, same as LoadRenderTexture
+	target.depth.mipmaps = 1;
+
+	rlFramebufferAttach(target.id, target.texture.id, RL_ATTACHMENT_COLOR_CHANNEL0, RL_ATTACHMENT_TEXTURE2D, 0);
+	rlFramebufferAttach(target.id, target.depth.id, RL_ATTACHMENT_DEPTH, RL_ATTACHMENT_RENDERBUFFER, 0);
+
+	if (!rlFramebufferComplete(target.id))
+	{
+		TraceLog(LOG_ERROR, "TRACING: Float render target %ix%i is incomplete", width, height);
+	}
+
+	rlDisableFramebuffer();
+
+	return target;
+}
+
+AccumulationTarget TracingEngine::LoadAccumulationTarget(int width, int height)
+{
+	AccumulationTarget target;
+	target.color = LoadFloatRenderTexture(width, height);
+	target.normalDepth = AttachGBufferTexture(target.color, 1);
+	target.albedo = AttachGBufferTexture(target.color, 2);
+	target.emission = AttachGBufferTexture(target.color, 3);
+	return target;
+}
+
+Texture2D TracingEngine::AttachGBufferTexture(RenderTexture2D target, int attachment)
+{
+	Texture2D texture = { 0 };
+	texture.id = rlLoadTexture(NULL, target.texture.width, target.texture.height, PIXELFORMAT_UNCOMPRESSED_R32G32B32A32, 1);
+	texture.width = target.texture.width;
+	texture.height = target.texture.height;
+	texture.format = PIXELFORMAT_UNCOMPRESSED_R32G32B32A32;
+	texture.mipmaps = 1;
+
+	rlFramebufferAttach(target.id, texture.id, RL_ATTACHMENT_COLOR_CHANNEL0 + attachment, RL_ATTACHMENT_TEXTURE2D, 0);
+
+	// draw buffers belong to the framebuffer, so this only has to be set once
+	rlEnableFramebuffer(target.id);
+	rlActiveDrawBuffers(attachment + 1);
+	rlDisableFramebuffer();
+
+	return texture;
+}
+
+ShaderVariant TracingEngine::GetSceneVariant()
+{
+	ShaderVariant variant = {};
 
-	tracingParams.cameraPosition = GetShaderLocation(raytracingShader, "cameraPosition");
-	tracingParams.cameraDirection = GetShaderLocation(raytracingShader, "cameraDirection");
-	tracingParams.screenCenter = GetShaderLocation(raytracingShader, "screenCenter");
-	tracingParams.viewParams = GetShaderLocation(raytracingShader, "viewParams");
-	tracingParams.resolution = GetShaderLocation(raytracingShader, "resolution");
-	tracingParams.numRenderedFrames = GetShaderLocation(raytracingShader, "numRenderedFrames");
-	tracingParams.previousFrame = GetShaderLocation(raytracingShader, "previousFrame");
-	tracingParams.raysPerPixel = GetShaderLocation(raytracingShader, "raysPerPixel");
-	tracingParams.maxBounces = GetShaderLocation(raytracingShader, "maxBounces");
-	tracingParams.denoise = GetShaderLocation(raytracingShader, "denoise");
-	tracingParams.blur = GetShaderLocation(raytracingShader, "blur");
-	tracingParams.pause = GetShaderLocation(raytracingShader, "pause");
+	// one program traces every view, so its bounce loop has to reach as far as the deepest of them
+	for (std::unique_ptr<RenderContext>& context : contexts)
+	{
+		variant.maxBounces = std::max(variant.maxBounces, context->maxBounces);
+	}
+
+	variant.gravity = !gravityBodies.empty();
+	variant.spheres = !spheres.empty();
+
+	// before a scene is loaded there is nothing to go by
+	if (meshes.empty() && spheres.empty() && gravityBodies.empty())
+	{
+		variant.gravity = true;
+		variant.spheres = true;
+	}
+
+	// leaves sit at most bvhDepth below the root and every level above leaves one sibling on the
+	// stack, rounded up so small depth changes do not each compile a new variant
+	int depth = 0;
+
+	// GPU builds store the height they measured, DeformRaylibModel reselects when a rebuild comes out deeper
+	for (const RaytracingMesh& mesh : meshes)
+	{
+		depth = std::max(depth, mesh.bvhDepth);
+	}
+
+	depth = std::max(depth, sphereBvhDepth);
+
+	variant.bvhStackSize = std::clamp((depth + 2 + 7) / 8 * 8, 8, 64);
+
+	return variant;
+}
+
+std::string TracingEngine::GetVariantDefines(const ShaderVariant& variant)
+{
+	std::string defines = TextFormat("#define MAX_BOUNCES %i\n#define BVH_STACK_SIZE %i\n#define GRAVITY %i\n#define SPHERES %i\n",
+		variant.maxBounces, variant.bvhStackSize, (int)variant.gravity, (int)variant.spheres);
+
+	if (variant.traversalStats)
+	{
+		defines += "#define TRAVERSAL_STATS\n";
+	}
+
+	return defines;
+}
+
+std::string TracingEngine::GetTracingSource(const ShaderVariant& variant)
+{
+	std::string source = ShaderCache::LoadSource("resources/shaders/raytracer_fragment.glsl");
+	return source.empty() ? source : ShaderCache::InsertDefines(source, GetVariantDefines(variant));
+}
+
+Shader TracingEngine::LoadTracingShader(const ShaderVariant& variant)
+{
+	return ShaderCache::Load(GetTracingSource(variant));
+}
+
+void TracingEngine::LoadTracingShaders(const ShaderVariant& variant)
+{
+	ShaderVariant statsVariant = variant;
+	statsVariant.traversalStats = true;
+
+	activeVariant = variant;
+	activeVariantDefines = GetVariantDefines(variant);
+	SetTracingShaders(LoadTracingShader(variant), LoadTracingShader(statsVariant));
+
+	TraceLog(LOG_INFO, "TRACING: Shader variant %i bounces, stack %i, gravity %s, spheres %s", variant.maxBounces, variant.bvhStackSize,
+		variant.gravity ? "on" : "off", variant.spheres ? "on" : "off");
+}
 
+void TracingEngine::SetTracingShaders(Shader plain, Shader stats)
+{
+	if (raytracingShader.id > 0)
+	{
+		UnloadShader(raytracingShader);
+		UnloadShader(statsShader);
+	}
+
+	raytracingShader = statsShaderActive ? stats : plain;
+	statsShader = statsShaderActive ? plain : stats;
+
+	ResolveTracingParams(raytracingShader, &tracingParams);
+	ResolveTracingParams(statsShader, &statsParams);
+
+	RefreshTracingShader();
+}
+
+void TracingEngine::SelectShaderVariant()
+{
+	ShaderVariant variant = GetSceneVariant();
+
+	if (GetVariantDefines(variant) != activeVariantDefines)
+	{
+		LoadTracingShaders(variant);
+	}
+}
+
+void TracingEngine::ResolveTracingParams(Shader shader, TracingParams* params)
+{
+	params->cameraPosition = GetShaderLocation(shader, "cameraPosition");
+	params->cameraDirection = GetShaderLocation(shader, "cameraDirection");
+	params->screenCenter = GetShaderLocation(shader, "screenCenter");
+	params->viewParams = GetShaderLocation(shader, "viewParams");
+	params->resolution = GetShaderLocation(shader, "resolution");
+	params->previousFrame = GetShaderLocation(shader, "previousFrame");
+	params->raysPerPixel = GetShaderLocation(shader, "raysPerPixel");
+	params->maxBounces = GetShaderLocation(shader, "maxBounces");
+	params->denoise = GetShaderLocation(shader, "denoise");
+	params->blur = GetShaderLocation(shader, "blur");
+	params->pause = GetShaderLocation(shader, "pause");
+	params->numGravityBodies = GetShaderLocation(shader, "numGravityBodies");
+	params->heatmap = GetShaderLocation(shader, "heatmap");
+	params->heatmapRange = GetShaderLocation(shader, "heatmapRange");
+	params->samplerType = GetShaderLocation(shader, "samplerType");
+	params->frameIndex = GetShaderLocation(shader, "frameIndex");
+	params->sobolDirections = GetShaderLocation(shader, "sobolDirections");
+	params->blueNoise = GetShaderLocation(shader, "blueNoise");
+	params->environmentMap = GetShaderLocation(shader, "environmentMap");
+	params->environmentSampling = GetShaderLocation(shader, "environmentSampling");
+	params->previousNormalDepth = GetShaderLocation(shader, "previousNormalDepth");
+	params->previousCameraPosition = GetShaderLocation(shader, "previousCameraPosition");
+	params->previousCameraDirection = GetShaderLocation(shader, "previousCameraDirection");
+	params->cameraMoved = GetShaderLocation(shader, "cameraMoved");
+	params->historyValid = GetShaderLocation(shader, "historyValid");
+	params->maxHistory = GetShaderLocation(shader, "maxHistory");
+	params->renderScale = GetShaderLocation(shader, "renderScale");
+	params->previousRenderScale = GetShaderLocation(shader, "previousRenderScale");
+	params->sampleOffset = GetShaderLocation(shader, "sampleOffset");
+	params->focusRegions = GetShaderLocation(shader, "focusRegions");
+	params->numFocusRegions = GetShaderLocation(shader, "numFocusRegions");
+	params->peripheryDensity = GetShaderLocation(shader, "peripheryDensity");
+	params->sphereRootNode = GetShaderLocation(shader, "sphereRootNode");
+	params->hybridFirstHit = GetShaderLocation(shader, "hybridFirstHit");
+	params->rasterPosition = GetShaderLocation(shader, "rasterPosition");
+	params->rasterNormal = GetShaderLocation(shader, "rasterNormal");
+	params->primaryCacheMode = GetShaderLocation(shader, "primaryCacheMode");
+	params->primaryCacheBounds = GetShaderLocation(shader, "primaryCacheBounds");
+}
+
+void TracingEngine::ResolvePostParams()
+{
 	postParams.resolution = GetShaderLocation(postShader, "resolution");
-	postParams.denoise = GetShaderLocation(postShader, "denoise");
+	postParams.stepWidth = GetShaderLocation(postShader, "stepWidth");
+	postParams.firstPass = GetShaderLocation(postShader, "firstPass");
+	postParams.lastPass = GetShaderLocation(postShader, "lastPass");
+	postParams.colorPhi = GetShaderLocation(postShader, "colorPhi");
+	postParams.normalPhi = GetShaderLocation(postShader, "normalPhi");
+	postParams.depthPhi = GetShaderLocation(postShader, "depthPhi");
+	postParams.gNormalDepth = GetShaderLocation(postShader, "gNormalDepth");
+	postParams.gAlbedo = GetShaderLocation(postShader, "gAlbedo");
+	postParams.gEmission = GetShaderLocation(postShader, "gEmission");
+}
 
-	Vector2 screenCenter = Vector2(resolution.x / 2.0f, resolution.y / 2.0f);
-	SetShaderValue(raytracingShader, tracingParams.screenCenter, &screenCenter, SHADER_UNIFORM_VEC2);
-	SetShaderValue(raytracingShader, tracingParams.resolution, &resolution, SHADER_UNIFORM_VEC2);
+void TracingEngine::ResolveUpscaleParams()
+{
+	upscaleParams.gNormalDepth = GetShaderLocation(upscaleShader, "gNormalDepth");
+	upscaleParams.renderScale = GetShaderLocation(upscaleShader, "renderScale");
+	upscaleParams.renderSize = GetShaderLocation(upscaleShader, "renderSize");
+}
 
-	SetShaderValue(postShader, postParams.resolution, &resolution, SHADER_UNIFORM_VEC2);
+static const char* reloadNames[RELOAD_COUNT] = { "tracing shader", "post shader", "upscale shader", "raster shader",
+	"wavefront passes", "LBVH build passes" };
 
-	SetShaderValue(raytracingShader, tracingParams.raysPerPixel, &raysPerPixel, SHADER_UNIFORM_INT);
-	SetShaderValue(raytracingShader, tracingParams.maxBounces, &maxBounces, SHADER_UNIFORM_INT);
-	SetShaderValue(raytracingShader, tracingParams.blur, &blur, SHADER_UNIFORM_FLOAT);
+// the files each set of programs is built from, before includes are expanded
+static const std::vector<const char*> reloadSources[RELOAD_COUNT] = {
+	{ "resources/shaders/raytracer_fragment.glsl" },
+	{ "resources/shaders/post_fragment.glsl" },
+	{ "resources/shaders/upscale_fragment.glsl" },
+	{ "resources/shaders/raster_vertex.glsl", "resources/shaders/raster_fragment.glsl" },
+	{ "resources/shaders/wavefront_primary.comp", "resources/shaders/wavefront_trace.comp", "resources/shaders/wavefront_bin.comp",
+		"resources/shaders/wavefront_resolve.comp" },
+	{ "resources/shaders/lbvh.comp" }
+};
 
-	gravityBodySSBO = rlLoadShaderBuffer(sizeof(GravityBodyBuffer), NULL, RL_DYNAMIC_COPY);
-	sphereSSBO = rlLoadShaderBuffer(sizeof(SphereBuffer), NULL, RL_DYNAMIC_COPY);
-	meshesSSBO = rlLoadShaderBuffer(sizeof(MeshBuffer), NULL, RL_DYNAMIC_COPY);
-	trianglesSSBO = rlLoadShaderBuffer(sizeof(TriangleBuffer), NULL, RL_DYNAMIC_COPY);
-	nodesSSBO = rlLoadShaderBuffer(sizeof(NodeBuffer), NULL, RL_DYNAMIC_COPY);
+// the sources with everything they include, found again whenever one of them changes
+static std::vector<std::string> reloadFiles[RELOAD_COUNT];
+
+static void FindReloadFiles(int reload)
+{
+	reloadFiles[reload].clear();
+
+	for (const char* source : reloadSources[reload])
+	{
+		ShaderCache::LoadSource(source, &reloadFiles[reload]);
+	}
 }
 
-Vector3 TracingEngine::TriangleCenter(Triangle* triangle)
+static long SourceModTime(int reload)
 {
-	return (triangle->posA + triangle->posB + triangle->posC) / 3;
+	long modTime = 0;
+
+	for (const std::string& file : reloadFiles[reload])
+	{
+		modTime = std::max(modTime, GetFileModTime(file.c_str()));
+	}
+
+	return modTime;
 }
 
-Vector3 TracingEngine::BoundingBoxCenter(PaddedBoundingBox* box)
+void TracingEngine::EnableHotReload()
 {
-	return (box->min + box->max) / 2;
+	if (!ShaderCompiler::Start())
+	{
+		TraceLog(LOG_WARNING, "TRACING: Hot reload needs a shared GL context, shaders will not be watched");
+		return;
+	}
+
+	for (int i = 0; i < RELOAD_COUNT; i++)
+	{
+		FindReloadFiles(i);
+		shaderModTimes[i] = SourceModTime(i);
+	}
+
+	lastShaderPoll = GetTime();
 }
 
-float TracingEngine::BoundingBoxCenterOnAxis(PaddedBoundingBox* box, int axis)
+void TracingEngine::PollShaderReload()
 {
-	switch (axis)
+	// stat is cheap, but not every frame cheap
+	if (GetTime() - lastShaderPoll >= 0.25)
 	{
-	case 0:
-		return BoundingBoxCenter(box).x;
-	case 1:
-		return BoundingBoxCenter(box).y;
-	case 2:
-		return BoundingBoxCenter(box).z;
+		lastShaderPoll = GetTime();
+
+		for (int i = 0; i < RELOAD_COUNT; i++)
+		{
+			long modTime = SourceModTime(i);
+
+			if (modTime == shaderModTimes[i])
+			{
+				continue;
+			}
+
+			// the change can add or drop an include
+			FindReloadFiles(i);
+			shaderModTimes[i] = SourceModTime(i);
+			TraceLog(LOG_INFO, "TRACING: The %s changed, rebuilding", reloadNames[i]);
+
+			switch (i)
+			{
+			case RELOAD_TRACING:
+			{
+				// the variant is part of the tag, a build for a scene that has since changed variant is dropped
+				ShaderVariant statsVariant = activeVariant;
+				statsVariant.traversalStats = true;
+				ShaderCompiler::Submit(i, activeVariantDefines, { GetTracingSource(activeVariant), GetTracingSource(statsVariant) });
+				break;
+			}
+			case RELOAD_POST:
+			case RELOAD_UPSCALE:
+			{
+				std::string source = ShaderCache::LoadSource(reloadSources[i][0]);
+
+				if (!source.empty())
+				{
+					ShaderCompiler::Submit(i, "", { source });
+				}
+
+				break;
+			}
+			case RELOAD_RASTER:
+			{
+				std::string vertex = ShaderCache::LoadSource(reloadSources[i][0]);
+				std::string fragment = ShaderCache::LoadSource(reloadSources[i][1]);
+
+				if (!vertex.empty() && !fragment.empty())
+				{
+					ShaderCompiler::Submit(i, "", { fragment }, false, vertex);
+				}
+
+				break;
+			}
+			case RELOAD_WAVEFRONT:
+			{
+				// nothing to rebuild until the wavefront tracer first runs, it builds from the sources then
+				std::vector<std::string> sources = WavefrontTracer::GetReloadSources();
+
+				if (!sources.empty())
+				{
+					ShaderCompiler::Submit(i, WavefrontTracer::GetLoadedDefines(), sources, true);
+				}
+
+				break;
+			}
+			case RELOAD_LBVH:
+			{
+				// before the first GPU build there is nothing running to replace
+				std::vector<std::string> sources = GpuBVHBuilder::GetReloadSources();
+
+				if (!sources.empty())
+				{
+					ShaderCompiler::Submit(i, "", sources, true);
+				}
+
+				break;
+			}
+			}
+		}
+	}
+
+	for (ShaderBuild& build : ShaderCompiler::CollectFinished())
+	{
+		ApplyShaderBuild(build);
 	}
 }
 
-float TracingEngine::TriangleCenterOnAxis(Triangle* triangle, int axis)
+void TracingEngine::ApplyShaderBuild(ShaderBuild& build)
 {
-	switch (axis)
+	if (!build.linked)
 	{
-	case 0:
-		return TriangleCenter(triangle).x;
-	case 1:
-		return TriangleCenter(triangle).y;
-	case 2:
-		return TriangleCenter(triangle).z;
+		TraceLog(LOG_WARNING, "TRACING: The %s did not build, still running the previous program", reloadNames[build.id]);
+		return;
+	}
+
+	// built for a variant the scene has since moved on from
+	if ((build.id == RELOAD_TRACING && build.tag != activeVariantDefines) ||
+		(build.id == RELOAD_WAVEFRONT && build.tag != WavefrontTracer::GetLoadedDefines()))
+	{
+		for (unsigned int program : build.programs)
+		{
+			rlUnloadShaderProgram(program);
+		}
+
+		return;
+	}
+
+	switch (build.id)
+	{
+	case RELOAD_TRACING:
+		// same SSBOs and sky, only the accumulation starts over
+		SetTracingShaders(ShaderCache::FromProgram(build.programs[0]), ShaderCache::FromProgram(build.programs[1]));
+		break;
+	case RELOAD_POST:
+		UnloadShader(postShader);
+		postShader = ShaderCache::FromProgram(build.programs[0]);
+		ResolvePostParams();
+		break;
+	case RELOAD_UPSCALE:
+		UnloadShader(upscaleShader);
+		upscaleShader = ShaderCache::FromProgram(build.programs[0]);
+		ResolveUpscaleParams();
+		break;
+	case RELOAD_WAVEFRONT:
+		WavefrontTracer::SetPrograms(build.programs, build.tag);
+		break;
+	case RELOAD_RASTER:
+		SetRasterShader(ShaderCache::FromProgram(build.programs[0]));
+		break;
+	case RELOAD_LBVH:
+		// the hierarchies already built stay, the next rebuild uses the new programs
+		GpuBVHBuilder::SetPrograms(build.programs);
+		break;
+	}
+
+	TraceLog(LOG_INFO, "TRACING: Swapped in the rebuilt %s", reloadNames[build.id]);
+}
+
+void TracingEngine::SetRasterShader(Shader shader)
+{
+	if (rasterShader.id != 0)
+	{
+		UnloadShader(rasterShader);
+	}
+
+	rasterShader = shader;
+	rasterParams.meshIndex = GetShaderLocation(rasterShader, "meshIndex");
+	rasterParams.rotation = GetShaderLocation(rasterShader, "rotation");
+	rasterMaterial.shader = rasterShader;
+}
+
+void TracingEngine::UploadShaderConstants()
+{
+	Vector2 screenCenter = Vector2(activeContext->resolution.x / 2.0f, activeContext->resolution.y / 2.0f);
+	SetShaderValue(raytracingShader, tracingParams.screenCenter, &screenCenter, SHADER_UNIFORM_VEC2);
+	SetShaderValue(raytracingShader, tracingParams.resolution, &activeContext->resolution, SHADER_UNIFORM_VEC2);
+
+	SetShaderValue(raytracingShader, tracingParams.blur, &activeContext->blur, SHADER_UNIFORM_FLOAT);
+	SetShaderValue(raytracingShader, tracingParams.sphereRootNode, &sphereRootNode, SHADER_UNIFORM_INT);
+
+	SetShaderValueV(raytracingShader, tracingParams.sobolDirections, sobolDirections.data(), SHADER_UNIFORM_INT, sobolDirections.size());
+
+	int rasterPositionUnit = RASTER_POSITION_UNIT;
+	int rasterNormalUnit = RASTER_NORMAL_UNIT;
+	SetShaderValue(raytracingShader, tracingParams.rasterPosition, &rasterPositionUnit, SHADER_UNIFORM_INT);
+	SetShaderValue(raytracingShader, tracingParams.rasterNormal, &rasterNormalUnit, SHADER_UNIFORM_INT);
+}
+
+void TracingEngine::SwapTracingShader()
+{
+	std::swap(raytracingShader, statsShader);
+	std::swap(tracingParams, statsParams);
+	statsShaderActive = !statsShaderActive;
+
+	RefreshTracingShader();
+}
+
+void TracingEngine::RefreshTracingShader()
+{
+	UploadShaderConstants();
+	UploadSky(raytracingShader);
+	UploadGravityBodies();
+
+	// bindings are global state, but rebind in case the program was relinked with different ones
+	BindSSBOS();
+
+	// the previous program's output is no history for this one, UploadData counts this up to the first frame
+	RestartContexts();
+	sceneVersion++;
+
+	traversalStatsFrames = 0;
+	TraversalStatsBuffer empty{};
+	rlUpdateShaderBuffer(traversalStatsSSBO, &empty, sizeof(TraversalStatsBuffer), 0);
+}
+
+void TracingEngine::ReadTraversalStats()
+{
+	TraversalStatsBuffer buffer;
+	rlReadShaderBuffer(traversalStatsSSBO, &buffer, sizeof(TraversalStatsBuffer), 0);
+
+	// counters are spread over slots so fewer fragments contend for each one
+	unsigned long long totals[4] = { 0, 0, 0, 0 };
+
+	for (int i = 0; i < TRAVERSAL_STAT_SLOTS; i++)
+	{
+		for (int c = 0; c < 4; c++)
+		{
+			totals[c] += buffer.counters[i * 4 + c];
+		}
+	}
+
+	double rays = std::max(1ull, totals[3]);
+	traversalStats.nodesPerRay = totals[0] / rays;
+	traversalStats.trianglesPerRay = totals[1] / rays;
+	traversalStats.bendingPerRay = totals[2] / rays;
+	traversalStats.rays = totals[3];
+
+	TraceLog(LOG_INFO, "TRAVERSAL: %llu rays over %i frames, %.1f nodes/ray, %.1f tris/ray, %.1f bending/ray",
+		totals[3], traversalStatsFrames, traversalStats.nodesPerRay, traversalStats.trianglesPerRay, traversalStats.bendingPerRay);
+
+	TraversalStatsBuffer empty{};
+	rlUpdateShaderBuffer(traversalStatsSSBO, &empty, sizeof(TraversalStatsBuffer), 0);
+	traversalStatsFrames = 0;
+}
+
+void TracingEngine::CycleSampler()
+{
+	activeContext->samplerType = (activeContext->samplerType + 1) % SAMPLER_COUNT;
+	TraceLog(LOG_INFO, "TRACING: Sampler %s", Sampler::GetName(activeContext->samplerType));
+}
+
+void TracingEngine::ToggleFoveation()
+{
+	activeContext->foveation = !activeContext->foveation;
+	TraceLog(LOG_INFO, "TRACING: Foveation %s, %.1f Mrays per frame", activeContext->foveation ? "on" : "off", GetExpectedRays() / 1000000.0);
+}
+
+void TracingEngine::CycleDebugView()
+{
+	if (!debug)
+	{
+		debug = true;
+		heatmap = HEATMAP_NONE;
+	}
+	else if (heatmap < HEATMAP_BENDING)
+	{
+		heatmap++;
+	}
+	else
+	{
+		debug = false;
+		heatmap = HEATMAP_NONE;
+	}
+}
+
+Vector3 TracingEngine::TriangleCenter(Triangle* triangle)
+{
+	return (triangle->posA + triangle->posB + triangle->posC) / 3;
+}
+
+Vector3 TracingEngine::BoundingBoxCenter(PaddedBoundingBox* box)
+{
+	return (box->min + box->max) / 2;
+}
+
+float TracingEngine::BoundingBoxCenterOnAxis(PaddedBoundingBox* box, int axis)
+{
+	switch (axis)
+	{
+	case 0:
+		return BoundingBoxCenter(box).x;
+	case 1:
+		return BoundingBoxCenter(box).y;
+	case 2:
+		return BoundingBoxCenter(box).z;
+	}
+}
+
+float TracingEngine::TriangleCenterOnAxis(Triangle* triangle, int axis)
+{
+	switch (axis)
+	{
+	case 0:
+		return TriangleCenter(triangle).x;
+	case 1:
+		return TriangleCenter(triangle).y;
+	case 2:
+		return TriangleCenter(triangle).z;
+	}
+}
+
+void TracingEngine::SplitNode(int parentIndex, int depth, int maxDepth)
+{
+	if (depth == maxDepth)
+	{
+		return;
+	}
+
+	nodes[parentIndex].childIndex = nodes.size();
+
+	Vector3 size = nodes[parentIndex].bounds.max - nodes[parentIndex].bounds.min;
+	int splitAxis = size.x > std::max(size.y, size.z) ? 0 : size.y > size.z ? 1 : 2;
+	float splitPos = BoundingBoxCenterOnAxis(&nodes[parentIndex].bounds, splitAxis);
+
+	Node childA = { .triangleIndex = nodes[parentIndex].triangleIndex };
+	Node childB = { .triangleIndex = nodes[parentIndex].triangleIndex };
+
+	childA.bounds.min = BoundingBoxCenter(&nodes[parentIndex].bounds);
+	childA.bounds.max = BoundingBoxCenter(&nodes[parentIndex].bounds);
+
+	childB.bounds.min = BoundingBoxCenter(&nodes[parentIndex].bounds);
+	childB.bounds.max = BoundingBoxCenter(&nodes[parentIndex].bounds);
+
+	for (int i = 0; i < nodes[parentIndex].numTriangles; i++)
+	{
+		int triIndex = nodes[parentIndex].triangleIndex + i;
+		bool isSideA = TriangleCenterOnAxis(&triangles[triIndex], splitAxis) < splitPos;
+		Node* child = isSideA ? &childA : &childB;
+
+		GrowToIncludeTriangle(&child->bounds, triangles[triIndex]);
+		child->numTriangles++;
+
+		if (isSideA)
+		{
+			int swap = child->triangleIndex + child->numTriangles - 1;
+			std::swap(triangles[triIndex], triangles[swap]);
+			std::swap(triangleSourceIndices[triIndex], triangleSourceIndices[swap]);
+			childB.triangleIndex++;
+		}
+	}
+
+	int childIndexA = nodes.size();
+	int childIndexB = nodes.size() + 1;
+
+	nodes.push_back(childA);
+	nodes.push_back(childB);
+
+	SplitNode(childIndexA, depth + 1, maxDepth);
+	SplitNode(childIndexB, depth + 1, maxDepth);
+}
+
+float TracingEngine::BoundingBoxArea(PaddedBoundingBox* box)
+{
+	Vector3 size = box->max - box->min;
+	return 2 * (size.x * size.y + size.y * size.z + size.z * size.x);
+}
+
+float TracingEngine::SubtreeCost(int nodeIndex)
+{
+	Node* node = &nodes[nodeIndex];
+
+	if (node->numTriangles == 0)
+	{
+		return 0;
+	}
+
+	float area = BoundingBoxArea(&node->bounds);
+
+	if (node->childIndex == 0)
+	{
+		return area * node->numTriangles;
+	}
+
+	return area + SubtreeCost(node->childIndex) + SubtreeCost(node->childIndex + 1);
+}
+
+void TracingEngine::BuildBVHInfo(int meshIndex)
+{
+	while (meshBVHInfos.size() <= meshIndex)
+	{
+		meshBVHInfos.emplace_back(&sceneArena);
+	}
+
+	// same arena on both sides, so this moves rather than copies
+	MeshBVHInfo& info = meshBVHInfos[meshIndex];
+	info = MeshBVHInfo(&sceneArena);
+
+	std::vector<int> frontier = { meshes[meshIndex].rootNodeIndex };
+	int depth = 0;
+
+	while (!frontier.empty())
+	{
+		std::vector<int> next;
+
+		for (int nodeIndex : frontier)
+		{
+			if (depth == bvhRebuildDepth)
+			{
+				info.subtreeRoots.push_back(nodeIndex);
+				info.subtreeDepths.push_back(depth);
+			}
+
+			if (nodes[nodeIndex].childIndex != 0)
+			{
+				next.push_back(nodes[nodeIndex].childIndex);
+				next.push_back(nodes[nodeIndex].childIndex + 1);
+			}
+		}
+
+		info.levels.emplace_back(frontier.begin(), frontier.end());
+		frontier = next;
+		depth++;
+	}
+
+	// shallow hierarchies are judged as a whole
+	if (info.subtreeRoots.empty())
+	{
+		info.subtreeRoots.push_back(meshes[meshIndex].rootNodeIndex);
+		info.subtreeDepths.push_back(0);
+	}
+
+	for (int root : info.subtreeRoots)
+	{
+		float area = BoundingBoxArea(&nodes[root].bounds);
+		info.subtreeCosts.push_back(area > 0 ? SubtreeCost(root) / area : 0);
+	}
+}
+
+bool TracingEngine::RefitNode(int nodeIndex)
+{
+	Node* node = &nodes[nodeIndex];
+
+	// empty leaves hold nothing to hit, they keep their old bounds and are skipped by their parent
+	if (node->numTriangles == 0)
+	{
+		return false;
+	}
+
+	PaddedBoundingBox bounds{};
+	bounds.min = Vector3(FLT_MAX, FLT_MAX, FLT_MAX);
+	bounds.max = Vector3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+
+	if (node->childIndex == 0)
+	{
+		for (int t = node->triangleIndex; t < node->triangleIndex + node->numTriangles; t++)
+		{
+			GrowToIncludeTriangle(&bounds, triangles[t]);
+		}
+	}
+	else
+	{
+		for (int c = 0; c < 2; c++)
+		{
+			Node* child = &nodes[node->childIndex + c];
+
+			if (child->numTriangles == 0)
+			{
+				continue;
+			}
+
+			GrowToInclude(&bounds, child->bounds.min);
+			GrowToInclude(&bounds, child->bounds.max);
+		}
+	}
+
+	if (Vector3Equals(bounds.min, node->bounds.min) && Vector3Equals(bounds.max, node->bounds.max))
+	{
+		return false;
+	}
+
+	node->bounds.min = bounds.min;
+	node->bounds.max = bounds.max;
+	return true;
+}
+
+void TracingEngine::RebuildSubtree(int nodeIndex, int depth, int maxDepth)
+{
+	int firstDescendant = nodes[nodeIndex].childIndex;
+
+	if (firstDescendant == 0)
+	{
+		return;
+	}
+
+	// SplitNode appends to nodes, so build into a scratch hierarchy and move it over the old descendants,
+	// the node count only depends on the depth so the new subtree fits the old slots exactly
+	std::vector<Node> scratch = { nodes[nodeIndex] };
+	scratch[0].childIndex = 0;
+
+	std::swap(nodes, scratch);
+	SplitNode(0, depth, maxDepth);
+	std::swap(nodes, scratch);
+
+	for (size_t i = 1; i < scratch.size(); i++)
+	{
+		Node node = scratch[i];
+
+		if (node.childIndex != 0)
+		{
+			node.childIndex += firstDescendant - 1;
+		}
+
+		nodes[firstDescendant + i - 1] = node;
+		dirtyNodes[firstDescendant + i - 1] = 1;
+	}
+}
+
+void TracingEngine::RefitBVH(int meshIndex)
+{
+	MeshBVHInfo* info = &meshBVHInfos[meshIndex];
+
+	for (int level = (int)info->levels.size() - 1; level >= 0; level--)
+	{
+		std::pmr::vector<int>& levelNodes = info->levels[level];
+
+		threadPool->ParallelFor((int)levelNodes.size(), [&levelNodes](int begin, int end)
+			{
+				for (int i = begin; i < end; i++)
+				{
+					if (RefitNode(levelNodes[i])) dirtyNodes[levelNodes[i]] = 1;
+				}
+			});
+	}
+
+	std::vector<float> costs(info->subtreeRoots.size());
+
+	threadPool->ParallelFor((int)costs.size(), [info, &costs](int begin, int end)
+		{
+			for (int s = begin; s < end; s++)
+			{
+				float area = BoundingBoxArea(&nodes[info->subtreeRoots[s]].bounds);
+				costs[s] = area > 0 ? SubtreeCost(info->subtreeRoots[s]) / area : 0;
+			}
+		}, 1);
+
+	for (size_t s = 0; s < costs.size(); s++)
+	{
+		if (costs[s] <= info->subtreeCosts[s] * bvhRebuildThreshold)
+		{
+			continue;
+		}
+
+		int root = info->subtreeRoots[s];
+		RebuildSubtree(root, info->subtreeDepths[s], meshes[meshIndex].bvhDepth);
+
+		float area = BoundingBoxArea(&nodes[root].bounds);
+		info->subtreeCosts[s] = area > 0 ? SubtreeCost(root) / area : 0;
+		lastRefitRebuiltSubtrees++;
+	}
+}
+
+void TracingEngine::UploadDirtyNodes()
+{
+	const int maxUploadGap = 8;
+
+	int numNodes = nodes.size();
+	int i = 0;
+
+	while (i < numNodes)
+	{
+		if (!dirtyNodes[i])
+		{
+			i++;
+			continue;
+		}
+
+		// merge runs separated by a few clean nodes into a single upload
+		int start = i;
+		int end = i + 1;
+
+		for (int j = end; j < numNodes && j - end < maxUploadGap; j++)
+		{
+			if (dirtyNodes[j]) end = j + 1;
+		}
+
+		for (int j = start; j < end; j++)
+		{
+			dirtyNodes[j] = 0;
+		}
+
+		rlUpdateShaderBuffer(nodesBuffer.id, &nodes[start], (end - start) * sizeof(Node), start * sizeof(Node));
+
+		lastRefitUploadedNodes += end - start;
+		i = end;
+	}
+}
+
+PaddedBoundingBox TracingEngine::GetMeshPaddedBoundingBox(Mesh mesh)
+{
+	PaddedBoundingBox pb;
+	BoundingBox b = GetMeshBoundingBox(mesh);
+
+	pb.min = b.min;
+	pb.max = b.max;
+
+	return pb;
+}
+
+void TracingEngine::GrowToInclude(PaddedBoundingBox* box, Vector3 point)
+{
+	PaddedBoundingBox temp = *box;
+
+	Vector3 center = BoundingBoxCenter(box);
+
+	box->min = Vector3Min(temp.min, point);
+	box->max = Vector3Max(temp.max, point);
+}
+
+void TracingEngine::GrowToIncludeTriangle(PaddedBoundingBox* box, Triangle triangle)
+{
+	GrowToInclude(box, triangle.posA);
+	GrowToInclude(box, triangle.posB);
+	GrowToInclude(box, triangle.posC);
+}
+
+Vector4 TracingEngine::ColorToVector4(Color color)
+{
+	float colors[4] = { (float)color.r / (float)255, (float)color.g / (float)255,
+					   (float)color.b / (float)255, (float)color.a / (float)255 };
+	return Vector4(colors[0], colors[1], colors[2], colors[3]);
+}
+
+void TracingEngine::UploadSky(Shader shader)
+{
+	unsigned int skyColorZenithLocation = GetShaderLocation(shader, "skyMaterial.skyColorZenith");
+	unsigned int skyColorHorizonLocation = GetShaderLocation(shader, "skyMaterial.skyColorHorizon");
+	unsigned int groundColorLocation = GetShaderLocation(shader, "skyMaterial.groundColor");
+	unsigned int sunColorLocation = GetShaderLocation(shader, "skyMaterial.sunColor");
+	unsigned int sunDirectionLocation = GetShaderLocation(shader, "skyMaterial.sunDirection");
+	unsigned int sunFocusLocation = GetShaderLocation(shader, "skyMaterial.sunFocus");
+	unsigned int sunIntensityLocation = GetShaderLocation(shader, "skyMaterial.sunIntensity");
+
+	Vector4 skyColorZenith = ColorToVector4(skyMaterial.skyColorZenith);
+	SetShaderValue(shader, skyColorZenithLocation, &skyColorZenith, SHADER_UNIFORM_VEC4);   // Set shader uniform value vector
+
+	Vector4 skyColorHorizon = ColorToVector4(skyMaterial.skyColorHorizon);
+	SetShaderValue(shader, skyColorHorizonLocation, &skyColorHorizon, SHADER_UNIFORM_VEC4);   // Set shader uniform value vector
+
+	Vector4 groundColor = ColorToVector4(skyMaterial.groundColor);
+	SetShaderValue(shader, groundColorLocation, &groundColor, SHADER_UNIFORM_VEC4);   // Set shader uniform value vector
+	
+	Vector4 sunColor = ColorToVector4(skyMaterial.sunColor);
+	SetShaderValue(shader, sunColorLocation, &sunColor, SHADER_UNIFORM_VEC4);   // Set shader uniform value vector
+
+	SetShaderValue(shader, sunDirectionLocation, &skyMaterial.sunDirection, SHADER_UNIFORM_VEC3);   // Set shader uniform value vector
+	SetShaderValue(shader, sunFocusLocation, &skyMaterial.sunFocus, SHADER_UNIFORM_FLOAT);
+	SetShaderValue(shader, sunIntensityLocation, &skyMaterial.sunIntensity, SHADER_UNIFORM_FLOAT);
+
+	EnvironmentMap::Bake(skyMaterial);
+	float sunSampleProbability = EnvironmentMap::GetSunSampleProbability();
+	int sampling = environmentSampling;
+	SetShaderValue(shader, GetShaderLocation(shader, "sunSampleProbability"), &sunSampleProbability, SHADER_UNIFORM_FLOAT);
+	SetShaderValue(shader, GetShaderLocation(shader, "environmentSampling"), &sampling, SHADER_UNIFORM_INT);
+}
+
+void TracingEngine::SetSky(SkyMaterial sky)
+{
+	skyMaterial = sky;
+	UploadSky(raytracingShader);
+
+	// the accumulated frames saw the old sky
+	RestartContexts();
+}
+
+void TracingEngine::SetGravityBodies(const std::vector<GravityBody>& bodies)
+{
+	gravityBodies = bodies;
+	UploadGravityBodies();
+	rlUpdateShaderBuffer(gravityBodySSBO, &gravityBodyBuffer, sizeof(GravityBodyBuffer), 0);
+
+	// going from no bodies to some or back needs the other variant
+	SelectShaderVariant();
+
+	// everything was bent the old way
+	RestartContexts();
+	sceneVersion++;
+}
+
+void TracingEngine::GenerateBVHS()
+{
+	int triangleOffset = 0;
+
+	for (int i = 0; i < meshes.size(); i++)
+	{
+		RaytracingMesh mesh = meshes[i];
+
+		PaddedBoundingBox bounds{};
+		bounds.min = Vector3(mesh.boundingMin.x, mesh.boundingMin.y, mesh.boundingMin.z);
+		bounds.max = Vector3(mesh.boundingMax.x, mesh.boundingMax.y, mesh.boundingMax.z);
+
+		Node root = { .bounds = bounds, .triangleIndex = mesh.firstTriangleIndex, .numTriangles = mesh.numTriangles };
+		
+		nodes.push_back(root);
+		
+		meshes[i].rootNodeIndex = nodes.size() - 1;
+
+		triangleOffset += mesh.numTriangles;
+
+		// BuildGpuBVHS fills these in once the triangles are uploaded
+		if (bvhBuilder == BVH_BUILDER_GPU)
+		{
+			nodes.resize(nodes.size() - 1 + GpuBVHBuilder::NodeCount(mesh.numTriangles));
+			continue;
+		}
+
+		SplitNode(nodes.size() - 1, 0, meshes[i].bvhDepth);
+		BuildBVHInfo(i);
+	}
+
+	BuildSphereBVH();
+
+	dirtyNodes.assign(nodes.size(), 0);
+}
+
+void TracingEngine::BuildSphereBVH()
+{
+	sphereRootNode = -1;
+	sphereBvhDepth = 0;
+
+	if (spheres.empty())
+	{
+		return;
+	}
+
+	Node root = { .triangleIndex = 0, .numTriangles = (int)spheres.size() };
+	root.bounds.min = spheres[0].position;
+	root.bounds.max = spheres[0].position;
+
+	for (const Sphere& sphere : spheres)
+	{
+		GrowToInclude(&root.bounds, sphere.position - Vector3One() * sphere.radius);
+		GrowToInclude(&root.bounds, sphere.position + Vector3One() * sphere.radius);
+	}
+
+	nodes.push_back(root);
+	sphereRootNode = nodes.size() - 1;
+
+	SplitSphereNode(sphereRootNode, 0);
+}
+
+void TracingEngine::SplitSphereNode(int parentIndex, int depth)
+{
+	// leaves reuse triangleIndex and numTriangles as the range in spheres
+	int first = nodes[parentIndex].triangleIndex;
+	int count = nodes[parentIndex].numTriangles;
+
+	sphereBvhDepth = std::max(sphereBvhDepth, depth);
+
+	if (count <= SPHERE_LEAF_SIZE)
+	{
+		return;
+	}
+
+	// median of the centres along the longest axis, unlike the fixed depth mesh trees this keeps
+	// the depth at log2 of the sphere count however the spheres are clustered
+	Vector3 size = nodes[parentIndex].bounds.max - nodes[parentIndex].bounds.min;
+	int axis = size.x > std::max(size.y, size.z) ? 0 : size.y > size.z ? 1 : 2;
+	int half = count / 2;
+
+	std::nth_element(spheres.begin() + first, spheres.begin() + first + half, spheres.begin() + first + count,
+		[axis](const Sphere& a, const Sphere& b) { return (&a.position.x)[axis] < (&b.position.x)[axis]; });
+
+	int childIndex = nodes.size();
+	nodes[parentIndex].childIndex = childIndex;
+
+	for (int side = 0; side < 2; side++)
+	{
+		Node child = { .triangleIndex = first + side * half, .numTriangles = side == 0 ? half : count - half };
+		child.bounds.min = spheres[child.triangleIndex].position;
+		child.bounds.max = spheres[child.triangleIndex].position;
+
+		for (int i = child.triangleIndex; i < child.triangleIndex + child.numTriangles; i++)
+		{
+			GrowToInclude(&child.bounds, spheres[i].position - Vector3One() * spheres[i].radius);
+			GrowToInclude(&child.bounds, spheres[i].position + Vector3One() * spheres[i].radius);
+		}
+
+		nodes.push_back(child);
+	}
+
+	SplitSphereNode(childIndex, depth + 1);
+	SplitSphereNode(childIndex + 1, depth + 1);
+}
+
+void TracingEngine::UploadSSBOS()
+{
+	UploadMeshes();
+	UploadTriangles();
+	UploadNodes();
+	UploadSpheres();
+
+	rlUpdateShaderBuffer(gravityBodySSBO, &gravityBodyBuffer, sizeof(GravityBodyBuffer), 0);
+
+	BindSSBOS();
+	sceneVersion++;
+}
+
+void TracingEngine::BindSSBOS()
+{
+	rlEnableShader(raytracingShader.id);
+	ShaderBufferPool::Bind(sphereBuffer, 0);
+	rlBindShaderBuffer(gravityBodySSBO, 1);
+	ShaderBufferPool::Bind(meshesBuffer, 2);
+	ShaderBufferPool::Bind(trianglesBuffer, 3);
+	ShaderBufferPool::Bind(nodesBuffer, 4);
+	rlBindShaderBuffer(traversalStatsSSBO, 5);
+	rlDisableShader();
+}
+
+// in the order BuildSphereBVH left them, the leaves index straight into this
+void TracingEngine::UploadSpheres()
+{
+	ShaderBufferPool::Upload(&sphereBuffer, spheres.data(), spheres.size() * sizeof(Sphere));
+	SetShaderValue(raytracingShader, tracingParams.sphereRootNode, &sphereRootNode, SHADER_UNIFORM_INT);
+}
+
+void TracingEngine::UploadGravityBodies()
+{
+	int numGravityBodies = (int)std::min(gravityBodies.size(), std::size(gravityBodyBuffer.gravityBodies));
+
+	for (int i = 0; i < numGravityBodies; i++)
+	{
+		gravityBodyBuffer.gravityBodies[i] = gravityBodies[i];
+	}
+
+	SetShaderValue(raytracingShader, tracingParams.numGravityBodies, &numGravityBodies, SHADER_UNIFORM_INT);
+}
+
+// the geometry buffers are bound at the scene's size and filled straight from the host vectors
+void TracingEngine::UploadTriangles()
+{
+	ShaderBufferPool::Upload(&trianglesBuffer, triangles.data(), triangles.size() * sizeof(Triangle));
+}
+
+void TracingEngine::UploadMeshes()
+{
+	ShaderBufferPool::Upload(&meshesBuffer, meshes.data(), meshes.size() * sizeof(RaytracingMesh));
+}
+
+void TracingEngine::UploadNodes()
+{
+	ShaderBufferPool::Upload(&nodesBuffer, nodes.data(), nodes.size() * sizeof(Node));
+}
+
+Triangle TracingEngine::ReadRaylibTriangle(Mesh mesh, Matrix transform, Quaternion rotation, int idx1, int idx2, int idx3)
+{
+	Triangle tri;
+
+	// Assign positions from the vertices array
+	tri.posA = *(Vector3*)&mesh.vertices[idx1 * 3] * transform;       // 3 floats per position
+	tri.posB = *(Vector3*)&mesh.vertices[idx2 * 3] * transform;
+	tri.posC = *(Vector3*)&mesh.vertices[idx3 * 3] * transform;
+
+	// Assign normals from the normals array
+	tri.normalA = Vector3RotateByQuaternion(*(Vector3*)&mesh.normals[idx1 * 3], rotation);      // 3 floats per normal
+	tri.normalB = Vector3RotateByQuaternion(*(Vector3*)&mesh.normals[idx2 * 3], rotation);
+	tri.normalC = Vector3RotateByQuaternion(*(Vector3*)&mesh.normals[idx3 * 3], rotation);
+
+	return tri;
+}
+
+int TracingEngine::UploadRaylibModel(Model model, RaytracingMaterial material, bool indexed, int bvhDepth)
+{
+	int firstMeshIndex = meshes.size();
+
+	Vector3 position = Vector3(0, 0, 0);
+	Quaternion rotation = QuaternionIdentity();
+	Vector3 scale = Vector3(1, 1, 1);
+	MatrixDecompose(model.transform, &position, &rotation, &scale);
+
+	for (int m = 0; m < model.meshCount; m++)
+	{
+		Mesh mesh = model.meshes[m];
+
+		BoundingBox bounds = GetMeshBoundingBox(mesh);
+
+		bounds.min += position;
+		bounds.max += position;
+
+		int firstTriIndex = totalTriangles;
+
+		for (int i = 0; i < mesh.triangleCount; i++) {
+			// For each triangle, we have 3 indices (in an indexed mesh)
+			int idx1 = indexed ? mesh.indices[i * 3] : i * 3;
+			int idx2 = indexed ? mesh.indices[i * 3 + 1] : i * 3 + 1;
+			int idx3 = indexed ? mesh.indices[i * 3 + 2] : i * 3 + 2;
+
+			triangles.push_back(ReadRaylibTriangle(mesh, model.transform, rotation, idx1, idx2, idx3));
+			triangleSourceIndices.push_back(i);
+			totalTriangles++;
+		}
+
+		RaytracingMesh rmesh = { firstTriIndex, mesh.triangleCount, 0, bvhDepth, material, Vector4(bounds.min.x, bounds.min.y, bounds.min.z, 0), Vector4(bounds.max.x, bounds.max.y, bounds.max.z, 0)};
+
+		TracingEngine::meshes.push_back(rmesh);
+	}
+
+	models.push_back(model);
+
+	return firstMeshIndex;
+}
+
+void TracingEngine::DeformRaylibModel(int firstMeshIndex, Model model, bool indexed)
+{
+	CpuProfileScope scope("DeformRaylibModel");
+
+	lastRefitUploadedNodes = 0;
+	lastRefitRebuiltSubtrees = 0;
+	bool deeper = false;
+
+	Vector3 position = Vector3(0, 0, 0);
+	Quaternion rotation = QuaternionIdentity();
+	Vector3 scale = Vector3(1, 1, 1);
+	MatrixDecompose(model.transform, &position, &rotation, &scale);
+
+	// the raster draws the engine's copies of the models
+	for (Model& stored : models)
+	{
+		if (stored.meshes == model.meshes)
+		{
+			stored.transform = model.transform;
+		}
+	}
+
+	for (int m = 0; m < model.meshCount; m++)
+	{
+		Mesh mesh = model.meshes[m];
+		int meshIndex = firstMeshIndex + m;
+		int first = meshes[meshIndex].firstTriangleIndex;
+
+		// the raster draws raylib's copy of the mesh
+		if (mesh.vboId != NULL)
+		{
+			UpdateMeshBuffer(mesh, 0, mesh.vertices, mesh.vertexCount * 3 * sizeof(float), 0);
+			UpdateMeshBuffer(mesh, 2, mesh.normals, mesh.vertexCount * 3 * sizeof(float), 0);
+		}
+
+		// the BVH build reordered the triangles, so each slot looks up the raylib triangle it came from
+		threadPool->ParallelFor(meshes[meshIndex].numTriangles, [&mesh, &model, rotation, indexed, first](int begin, int end)
+			{
+				for (int i = first + begin; i < first + end; i++)
+				{
+					int t = triangleSourceIndices[i];
+					int idx1 = indexed ? mesh.indices[t * 3] : t * 3;
+					int idx2 = indexed ? mesh.indices[t * 3 + 1] : t * 3 + 1;
+					int idx3 = indexed ? mesh.indices[t * 3 + 2] : t * 3 + 2;
+
+					triangles[i] = ReadRaylibTriangle(mesh, model.transform, rotation, idx1, idx2, idx3);
+				}
+			});
+
+		if (bvhBuilder == BVH_BUILDER_GPU)
+		{
+			// the GPU sorts its copy of the triangles and leaves the host's in the order it had, so the
+			// host nodes and mesh bounds keep showing the hierarchy of the first build
+			rlUpdateShaderBuffer(trianglesBuffer.id, &triangles[first], meshes[meshIndex].numTriangles * sizeof(Triangle), first * sizeof(Triangle));
+			bool built = GpuBVHBuilder::Build(meshIndex, first, meshes[meshIndex].numTriangles, meshes[meshIndex].rootNodeIndex, trianglesBuffer.id);
+			rlBindShaderBuffer(traversalStatsSSBO, 5);
+
+			if (built)
+			{
+				// the new positions can sort into a deeper tree than the traversal stack was sized for
+				int height = GpuBVHBuilder::ReadHeight();
+				deeper = deeper || height > meshes[meshIndex].bvhDepth;
+				meshes[meshIndex].bvhDepth = height;
+				continue;
+			}
+
+			// the host triangles are still in the order of the host nodes, so those can be refitted instead
+			TraceLog(LOG_WARNING, "TRACING: Falling back to the CPU BVH builder");
+			bvhBuilder = BVH_BUILDER_CPU;
+		}
+
+		RefitBVH(meshIndex);
+
+		PaddedBoundingBox rootBounds = nodes[meshes[meshIndex].rootNodeIndex].bounds;
+		meshes[meshIndex].boundingMin = Vector4(rootBounds.min.x, rootBounds.min.y, rootBounds.min.z, 0);
+		meshes[meshIndex].boundingMax = Vector4(rootBounds.max.x, rootBounds.max.y, rootBounds.max.z, 0);
+
+		rlUpdateShaderBuffer(trianglesBuffer.id, &triangles[first], meshes[meshIndex].numTriangles * sizeof(Triangle), first * sizeof(Triangle));
+		rlUpdateShaderBuffer(meshesBuffer.id, &meshes[meshIndex], sizeof(RaytracingMesh), meshIndex * sizeof(RaytracingMesh));
+	}
+
+	UploadDirtyNodes();
+	sceneVersion++;
+
+	if (deeper)
+	{
+		SelectShaderVariant();
+	}
+}
+
+void TracingEngine::UploadStaticData()
+{
+	CpuProfileScope scope("UploadStaticData");
+
+	UploadSky(raytracingShader);
+	UploadGravityBodies();
+
+	double buildStart = GetTime();
+	GenerateBVHS();
+	lastBVHBuildMs = (GetTime() - buildStart) * 1000.0;
+
+	double uploadStart = GetTime();
+	UploadSSBOS();
+	lastUploadMs = (GetTime() - uploadStart) * 1000.0;
+
+	if (bvhBuilder == BVH_BUILDER_GPU)
+	{
+		BuildGpuBVHS();
+	}
+
+	SelectShaderVariant();
+	UpdateMemoryUsage();
+}
+
+void TracingEngine::BuildGpuBVHS()
+{
+	lastBVHBuildMs = 0;
+	lastBVHReadbackMs = 0;
+
+	std::vector<int> order;
+	std::vector<Triangle> sorted;
+	std::vector<int> sortedSources;
+
+	for (int i = 0; i < meshes.size(); i++)
+	{
+		double buildStart = GetTime();
+
+		if (!GpuBVHBuilder::Build(i, meshes[i].firstTriangleIndex, meshes[i].numTriangles, meshes[i].rootNodeIndex, trianglesBuffer.id))
+		{
+			TraceLog(LOG_WARNING, "TRACING: Falling back to the CPU BVH builder");
+			bvhBuilder = BVH_BUILDER_CPU;
+			nodes.clear();
+			GenerateBVHS();
+			UploadSSBOS();
+			return;
+		}
+
+		glFinish();
+		lastBVHBuildMs += (GetTime() - buildStart) * 1000.0;
+
+		// the host copy is what debug drawing, refits and compiled scenes work from. the sort and state buffers
+		// are shared by every build, so each mesh's order is read before the next mesh overwrites them
+		double readbackStart = GetTime();
+		RaytracingMesh* mesh = &meshes[i];
+		int height = 0;
+		GpuBVHBuilder::ReadOrder(mesh->numTriangles, &order, &height);
+
+		sorted.resize(mesh->numTriangles);
+		sortedSources.resize(mesh->numTriangles);
+
+		for (int k = 0; k < mesh->numTriangles; k++)
+		{
+			sorted[k] = triangles[mesh->firstTriangleIndex + order[k]];
+			sortedSources[k] = triangleSourceIndices[mesh->firstTriangleIndex + order[k]];
+		}
+
+		std::copy(sorted.begin(), sorted.end(), triangles.begin() + mesh->firstTriangleIndex);
+		std::copy(sortedSources.begin(), sortedSources.end(), triangleSourceIndices.begin() + mesh->firstTriangleIndex);
+
+		int numNodes = GpuBVHBuilder::NodeCount(mesh->numTriangles);
+		rlReadShaderBuffer(nodesBuffer.id, &nodes[mesh->rootNodeIndex], numNodes * sizeof(Node), mesh->rootNodeIndex * sizeof(Node));
+		rlReadShaderBuffer(meshesBuffer.id, mesh, sizeof(RaytracingMesh), i * sizeof(RaytracingMesh));
+		// what a compiled scene sizes its stack by
+		mesh->bvhDepth = height;
+
+		BuildBVHInfo(i);
+
+		lastBVHReadbackMs += (GetTime() - readbackStart) * 1000.0;
+
+		TraceLog(LOG_INFO, "TRACING: LBVH over %i triangles, depth %i", mesh->numTriangles, height);
+	}
+
+	// the build borrowed the traversal stats binding
+	rlBindShaderBuffer(traversalStatsSSBO, 5);
+}
+
+void TracingEngine::UploadCompiledData()
+{
+	CpuProfileScope scope("UploadCompiledData");
+
+	UploadSky(raytracingShader);
+	UploadGravityBodies();
+
+	// the hierarchy comes prebuilt, only the host side refit bookkeeping is derived
+	double buildStart = GetTime();
+	for (int i = 0; i < meshes.size(); i++)
+	{
+		BuildBVHInfo(i);
+	}
+	dirtyNodes.assign(nodes.size(), 0);
+	lastBVHBuildMs = (GetTime() - buildStart) * 1000.0;
+
+	double uploadStart = GetTime();
+	UploadSSBOS();
+	lastUploadMs = (GetTime() - uploadStart) * 1000.0;
+
+	SelectShaderVariant();
+	UpdateMemoryUsage();
+}
+
+void TracingEngine::UploadData(Camera* camera)
+{
+	CpuProfileScope scope("UploadData");
+
+	if (ShaderCompiler::IsRunning())
+	{
+		PollShaderReload();
+	}
+
+	if ((heatmap != HEATMAP_NONE) != statsShaderActive)
+	{
+		SwapTracingShader();
+	}
+
+	float camDist = 1.0f / (tanf(camera->fovy * 0.5f * DEG2RAD));
+	Vector3 camDir = Vector3Scale(Vector3Normalize(Vector3Subtract(camera->target, camera->position)), camDist);
+	bool still = camera->position == activeContext->previousCameraPosition && camDir == activeContext->previousCameraDirection;
+	bool slice = activeContext->timeSlicing && activeContext->targetFrameMs > 0 && still && activeContext->denoise && !activeContext->pause &&
+		!statsShaderActive && !WavefrontTracer::enabled && activeContext->samplerType == activeContext->activeSamplerType;
+
+	if (activeContext->sliceRow > 0)
+	{
+		// the rest of the frame is traced with the uniforms it started with
+		if (slice)
+		{
+			UploadFrameUniforms();
+			return;
+		}
+
+		AbandonSlice();
+	}
+
+	FrameUniforms* uniforms = &activeContext->uniforms;
+
+	float planeHeight = 0.01f * tan(camera->fovy * 0.5f * DEG2RAD) * 2;
+	float planeWidth = planeHeight * (activeContext->resolution.x / activeContext->resolution.y);
+	uniforms->viewParams = Vector3(planeWidth, planeHeight, 0.01f);
+
+	// a different sampler would continue someone else's sequence
+	if (activeContext->samplerType != activeContext->activeSamplerType)
+	{
+		activeContext->activeSamplerType = activeContext->samplerType;
+		activeContext->numRenderedFrames = -1;
+	}
+
+	uniforms->samplerType = activeContext->activeSamplerType;
+
+	if (activeContext->denoise)
+	{
+		if (!activeContext->pause)
+		{
+			activeContext->numRenderedFrames++;
+		}
+	}
+	else
+	{
+		activeContext->numRenderedFrames = 0;
+	}
+
+	activeContext->frameIndex++;
+
+	activeContext->frameSliced = slice;
+
+	// the bands hold the frame time instead, so the frame is traced at full quality
+	if (activeContext->frameSliced)
+	{
+		activeContext->slicePreviousRenderScale = activeContext->previousRenderScale;
+		activeContext->renderScale = 1;
+		activeContext->activeRaysPerPixel = activeContext->raysPerPixel;
+		activeContext->activeBounces = activeContext->maxBounces;
+	}
+	else
+	{
+		UpdateQuality();
+	}
+
+	if (activeContext->numRenderedFrames <= 0)
+	{
+		activeContext->accumulatedSamples = 0;
+	}
+
+	uniforms->sampleOffset = activeContext->accumulatedSamples + activeContext->sampleSeed;
+	uniforms->frameIndex = activeContext->frameIndex;
+	uniforms->raysPerPixel = activeContext->activeRaysPerPixel;
+	uniforms->maxBounces = activeContext->activeBounces;
+	uniforms->renderScale = activeContext->renderScale;
+	uniforms->environmentSampling = environmentSampling;
+	uniforms->previousRenderScale = activeContext->previousRenderScale;
+
+	if (activeContext->denoise && !activeContext->pause)
+	{
+		activeContext->accumulatedSamples += activeContext->activeRaysPerPixel;
+	}
+
+	uniforms->historyValid = activeContext->numRenderedFrames > 0;
+	uniforms->cameraPosition = camera->position;
+	uniforms->cameraDirection = camDir;
+
+	// the previous pass was traced from previousCamera, its history is reprojected from there
+	// a different render scale moves every pixel too
+	bool moved = !still || activeContext->renderScale != activeContext->previousRenderScale;
+	uniforms->cameraMoved = moved;
+	uniforms->maxHistory = moved ? activeContext->maxHistoryMoving : FLT_MAX;
+	uniforms->previousCameraPosition = activeContext->previousCameraPosition;
+	uniforms->previousCameraDirection = activeContext->previousCameraDirection;
+	activeContext->previousCameraPosition = camera->position;
+	activeContext->previousCameraDirection = camDir;
+	activeContext->previousRenderScale = activeContext->renderScale;
+
+	ProjectFocusRegions(camera, camDir);
+
+	uniforms->peripheryDensity = activeContext->foveation ? activeContext->peripheryDensity : 1.0f;
+	uniforms->denoise = activeContext->denoise;
+	uniforms->pause = activeContext->pause;
+
+	UpdatePrimaryCache(moved);
+	uniforms->primaryCacheMode = activeContext->primaryCacheMode;
+
+	Rectangle cached = activeContext->primaryCacheRegion;
+	float cachedBottom = activeContext->resolution.y - cached.y - cached.height;
+	uniforms->primaryCacheBounds = Vector4(cached.x, cachedBottom, cached.x + cached.width, cachedBottom + cached.height);
+
+	// the compute tracer finds its own primary hits, a cached primary needs no raster
+	activeContext->rasterActive = hybridFirstHit && !WavefrontTracer::enabled && activeContext->primaryCacheMode != PRIMARY_CACHE_READ &&
+		RasterCoversScene();
+	uniforms->hybridFirstHit = activeContext->rasterActive;
+
+	UploadFrameUniforms();
+
+	if (activeContext->rasterActive)
+	{
+		Profiler::BeginGpuStage("raster");
+		DrawPrimaryRaster(camera, camDir);
+		Profiler::EndGpuStage();
+	}
+}
+
+void TracingEngine::UploadFrameUniforms()
+{
+	FrameUniforms* uniforms = &activeContext->uniforms;
+
+	SetShaderValue(raytracingShader, tracingParams.viewParams, &uniforms->viewParams, SHADER_UNIFORM_VEC3);
+	SetShaderValue(raytracingShader, tracingParams.samplerType, &uniforms->samplerType, SHADER_UNIFORM_INT);
+	SetShaderValue(raytracingShader, tracingParams.sampleOffset, &uniforms->sampleOffset, SHADER_UNIFORM_INT);
+	SetShaderValue(raytracingShader, tracingParams.frameIndex, &uniforms->frameIndex, SHADER_UNIFORM_INT);
+	SetShaderValue(raytracingShader, tracingParams.raysPerPixel, &uniforms->raysPerPixel, SHADER_UNIFORM_INT);
+	SetShaderValue(raytracingShader, tracingParams.maxBounces, &uniforms->maxBounces, SHADER_UNIFORM_INT);
+	SetShaderValue(raytracingShader, tracingParams.renderScale, &uniforms->renderScale, SHADER_UNIFORM_FLOAT);
+	SetShaderValue(raytracingShader, tracingParams.environmentSampling, &uniforms->environmentSampling, SHADER_UNIFORM_INT);
+	SetShaderValue(raytracingShader, tracingParams.previousRenderScale, &uniforms->previousRenderScale, SHADER_UNIFORM_FLOAT);
+	SetShaderValue(raytracingShader, tracingParams.historyValid, &uniforms->historyValid, SHADER_UNIFORM_INT);
+
+	if (statsShaderActive)
+	{
+		SetShaderValue(raytracingShader, tracingParams.heatmap, &heatmap, SHADER_UNIFORM_INT);
+		SetShaderValue(raytracingShader, tracingParams.heatmapRange, &heatmapRanges[heatmap], SHADER_UNIFORM_FLOAT);
+	}
+
+	SetShaderValue(raytracingShader, tracingParams.cameraPosition, &uniforms->cameraPosition, SHADER_UNIFORM_VEC3);
+	SetShaderValue(raytracingShader, tracingParams.cameraDirection, &uniforms->cameraDirection, SHADER_UNIFORM_VEC3);
+	SetShaderValue(raytracingShader, tracingParams.cameraMoved, &uniforms->cameraMoved, SHADER_UNIFORM_INT);
+	SetShaderValue(raytracingShader, tracingParams.maxHistory, &uniforms->maxHistory, SHADER_UNIFORM_FLOAT);
+	SetShaderValue(raytracingShader, tracingParams.previousCameraPosition, &uniforms->previousCameraPosition, SHADER_UNIFORM_VEC3);
+	SetShaderValue(raytracingShader, tracingParams.previousCameraDirection, &uniforms->previousCameraDirection, SHADER_UNIFORM_VEC3);
+
+	int numFocusRegions = (int)activeContext->projectedFocusRegions.size();
+	SetShaderValue(raytracingShader, tracingParams.peripheryDensity, &uniforms->peripheryDensity, SHADER_UNIFORM_FLOAT);
+	SetShaderValue(raytracingShader, tracingParams.numFocusRegions, &numFocusRegions, SHADER_UNIFORM_INT);
+
+	if (numFocusRegions > 0)
+	{
+		SetShaderValueV(raytracingShader, tracingParams.focusRegions, activeContext->projectedFocusRegions.data(), SHADER_UNIFORM_VEC3, numFocusRegions);
+	}
+
+	SetShaderValue(raytracingShader, tracingParams.denoise, &uniforms->denoise, SHADER_UNIFORM_INT);
+	SetShaderValue(raytracingShader, tracingParams.pause, &uniforms->pause, SHADER_UNIFORM_INT);
+	SetShaderValue(raytracingShader, tracingParams.primaryCacheMode, &uniforms->primaryCacheMode, SHADER_UNIFORM_INT);
+	SetShaderValue(raytracingShader, tracingParams.primaryCacheBounds, &uniforms->primaryCacheBounds, SHADER_UNIFORM_VEC4);
+	SetShaderValue(raytracingShader, tracingParams.hybridFirstHit, &uniforms->hybridFirstHit, SHADER_UNIFORM_INT);
+}
+
+void TracingEngine::UpdateQuality()
+{
+	if (activeContext->targetFrameMs <= 0)
+	{
+		activeContext->renderScale = 1;
+		activeContext->activeRaysPerPixel = activeContext->raysPerPixel;
+		activeContext->activeBounces = activeContext->maxBounces;
+		return;
+	}
+
+	// cost is taken as proportional to pixels * rays per pixel * (bounces + 1)
+	float fullWork = (float)activeContext->raysPerPixel * (activeContext->maxBounces + 1);
+	float minWork = activeContext->minRenderScale * activeContext->minRenderScale * (std::min(activeContext->minBounces, activeContext->maxBounces) + 1) / fullWork;
+
+	// timings arrive a few frames after the settings they measured, so only take small steps towards
+	// the target and leave a dead band around it to keep the resolution from flickering between steps
+	float gpuMs = Profiler::GetLatestGpuMs();
+
+	if (gpuMs > 0 && fabsf(gpuMs - activeContext->targetFrameMs) > activeContext->targetFrameMs * 0.05f)
+	{
+		float step = std::clamp(powf(activeContext->targetFrameMs / gpuMs, 0.25f), 0.9f, 1.1f);
+		activeContext->qualityWork = std::clamp(activeContext->qualityWork * step, minWork, 1.0f);
+	}
+
+	// rays per pixel go first as accumulation makes up for them, bounces last as they change the look
+	float work = activeContext->qualityWork * fullWork;
+	activeContext->activeRaysPerPixel = std::clamp((int)(work / (activeContext->maxBounces + 1)), 1, activeContext->raysPerPixel);
+
+	float area = std::clamp(work / (activeContext->activeRaysPerPixel * (activeContext->maxBounces + 1)), activeContext->minRenderScale * activeContext->minRenderScale, 1.0f);
+	activeContext->renderScale = std::max(activeContext->minRenderScale, roundf(sqrtf(area) * 20) / 20);
+
+	int bounces = (int)(work / (activeContext->renderScale * activeContext->renderScale * activeContext->activeRaysPerPixel)) - 1;
+	activeContext->activeBounces = std::clamp(bounces, std::min(activeContext->minBounces, activeContext->maxBounces), activeContext->maxBounces);
+}
+
+void TracingEngine::ProjectFocusRegions(Camera* camera, Vector3 cameraDirection)
+{
+	activeContext->projectedFocusRegions.clear();
+
+	std::vector<FocusRegion> regions = focusRegions;
+
+	for (const GravityBody& body : gravityBodies)
+	{
+		regions.push_back({ Vector3(body.posmass.x, body.posmass.y, body.posmass.z), activeContext->gravityFocusRadius });
+	}
+
+	// the same basis the shader builds its camera rays from
+	Vector3 cw = Vector3Normalize(cameraDirection);
+	Vector3 cu = Vector3Normalize(Vector3CrossProduct(cw, Vector3(0, 1, 0)));
+	Vector3 cv = Vector3CrossProduct(cu, cw);
+	float focalLength = Vector3Length(cameraDirection);
+	Vector2 screenCenter = Vector2(activeContext->resolution.x / 2.0f, activeContext->resolution.y / 2.0f);
+
+	for (const FocusRegion& region : regions)
+	{
+		if (activeContext->projectedFocusRegions.size() >= MAX_FOCUS_REGIONS)
+		{
+			break;
+		}
+
+		Vector3 offset = region.position - camera->position;
+		float distance = Vector3Length(offset);
+
+		// from inside a region everything is in focus
+		if (distance <= region.radius)
+		{
+			activeContext->projectedFocusRegions.push_back(Vector3(screenCenter.x, screenCenter.y, FLT_MAX));
+			continue;
+		}
+
+		float depth = Vector3DotProduct(offset, cw);
+
+		// behind the camera, though its edge may still reach into view
+		if (depth <= 0)
+		{
+			if (depth > -region.radius)
+			{
+				activeContext->projectedFocusRegions.push_back(Vector3(screenCenter.x, screenCenter.y, FLT_MAX));
+			}
+
+			continue;
+		}
+
+		float scale = focalLength * screenCenter.y / depth;
+		Vector2 center = Vector2(Vector3DotProduct(offset, cu), Vector3DotProduct(offset, cv)) * scale + screenCenter;
+
+		// the silhouette radius of the sphere, wider than radius / depth off axis but never by much
+		float radius = region.radius / sqrtf(std::max(distance * distance - region.radius * region.radius, 0.0001f)) * distance * scale;
+		activeContext->projectedFocusRegions.push_back(Vector3(center.x, center.y, radius));
+	}
+}
+
+bool TracingEngine::RasterCoversScene()
+{
+	size_t modelMeshes = 0;
+
+	for (const Model& model : models)
+	{
+		modelMeshes += model.meshCount;
 	}
+
+	return !models.empty() && modelMeshes == meshes.size();
 }
 
-void TracingEngine::SplitNode(int parentIndex, int depth, int maxDepth)
+void TracingEngine::DrawPrimaryRaster(Camera* camera, Vector3 cameraDirection)
 {
-	if (depth == maxDepth)
+	if (activeContext->rasterTarget.id == 0)
 	{
-		return;
+		LoadRasterTarget();
 	}
 
-	nodes[parentIndex].childIndex = nodes.size();
-
-	Vector3 size = nodes[parentIndex].bounds.max - nodes[parentIndex].bounds.min;
-	int splitAxis = size.x > std::max(size.y, size.z) ? 0 : size.y > size.z ? 1 : 2;
-	float splitPos = BoundingBoxCenterOnAxis(&nodes[parentIndex].bounds, splitAxis);
+	// the tracer's camera, the vertical field of view over square pixels and +y as up whatever the camera's up is,
+	// with no far plane so nothing the tracer can still hit is clipped
+	Matrix view = MatrixLookAt(camera->position, camera->position + cameraDirection, Vector3(0, 1, 0));
+	Matrix projection = MatrixPerspective(camera->fovy * DEG2RAD, activeContext->resolution.x / activeContext->resolution.y, RASTER_NEAR_PLANE, 1);
+	projection.m10 = -1;
+	projection.m14 = -2 * RASTER_NEAR_PLANE;
 
-	Node childA = { .triangleIndex = nodes[parentIndex].triangleIndex };
-	Node childB = { .triangleIndex = nodes[parentIndex].triangleIndex };
+	// squeezed into the bottom left like the traced image, so texel centres stay the traced pixel centres
+	projection = MatrixMultiply(MatrixMultiply(projection, MatrixScale(activeContext->renderScale, activeContext->renderScale, 1)), MatrixTranslate(activeContext->renderScale - 1, activeContext->renderScale - 1, 0));
 
-	childA.bounds.min = BoundingBoxCenter(&nodes[parentIndex].bounds);
-	childA.bounds.max = BoundingBoxCenter(&nodes[parentIndex].bounds);
+	BeginTextureMode(activeContext->rasterTarget);
+	ClearBackground(BLANK);
+	rlSetMatrixProjection(projection);
+	rlSetMatrixModelview(view);
+	rlEnableDepthTest();
+	// alpha holds the mesh index
+	rlDisableColorBlend();
 
-	childB.bounds.min = BoundingBoxCenter(&nodes[parentIndex].bounds);
-	childB.bounds.max = BoundingBoxCenter(&nodes[parentIndex].bounds);
+	// triangles are one sided to the tracer too, raylib's back face culling drops the same ones
+	int meshIndex = 0;
 
-	for (int i = 0; i < nodes[parentIndex].numTriangles; i++)
+	for (const Model& model : models)
 	{
-		int triIndex = nodes[parentIndex].triangleIndex + i;
-		bool isSideA = TriangleCenterOnAxis(&triangles[triIndex], splitAxis) < splitPos;
-		Node* child = isSideA ? &childA : &childB;
-
-		GrowToIncludeTriangle(&child->bounds, triangles[triIndex]);
-		child->numTriangles++;
+		Vector3 position;
+		Quaternion rotation;
+		Vector3 scale;
+		MatrixDecompose(model.transform, &position, &rotation, &scale);
+		SetShaderValueMatrix(rasterShader, rasterParams.rotation, QuaternionToMatrix(rotation));
 
-		if (isSideA)
+		for (int m = 0; m < model.meshCount; m++, meshIndex++)
 		{
-			int swap = child->triangleIndex + child->numTriangles - 1;
-			std::swap(triangles[triIndex], triangles[swap]);
-			childB.triangleIndex++;
+			SetShaderValue(rasterShader, rasterParams.meshIndex, &meshIndex, SHADER_UNIFORM_INT);
+			DrawMesh(model.meshes[m], rasterMaterial, model.transform);
 		}
 	}
 
-	int childIndexA = nodes.size();
-	int childIndexB = nodes.size() + 1;
-
-	nodes.push_back(childA);
-	nodes.push_back(childB);
-
-	SplitNode(childIndexA, depth + 1, maxDepth);
-	SplitNode(childIndexB, depth + 1, maxDepth);
+	rlEnableColorBlend();
+	rlDisableDepthTest();
+	EndTextureMode();
 }
 
-PaddedBoundingBox TracingEngine::GetMeshPaddedBoundingBox(Mesh mesh)
+void TracingEngine::UpdatePrimaryCache(bool moved)
 {
-	PaddedBoundingBox pb;
-	BoundingBox b = GetMeshBoundingBox(mesh);
+	// the compute tracer has primary rays of its own and a paused frame traces none
+	if (!primaryCache || WavefrontTracer::enabled || activeContext->pause)
+	{
+		activeContext->primaryCacheMode = PRIMARY_CACHE_OFF;
+		activeContext->primaryCacheRecorded = false;
+	}
+	else
+	{
+		if (activeContext->primaryCacheTextures[0].id == 0)
+		{
+			LoadPrimaryCache();
+		}
 
-	pb.min = b.min;
-	pb.max = b.max;
+		// the last frame recorded or read it from the same camera and render scale, and the scene is unchanged
+		bool valid = activeContext->primaryCacheRecorded && !moved && activeContext->primaryCacheVersion == sceneVersion;
+		activeContext->primaryCacheMode = valid ? PRIMARY_CACHE_READ : PRIMARY_CACHE_RECORD;
+		activeContext->primaryCacheRecorded = true;
+		activeContext->primaryCacheVersion = sceneVersion;
 
-	return pb;
+		// RenderRegion narrows this to its region once the recording pass is set up
+		if (!valid)
+		{
+			activeContext->primaryCacheRegion = GetRenderRegion();
+		}
+	}
 }
 
-void TracingEngine::GrowToInclude(PaddedBoundingBox* box, Vector3 point)
+float TracingEngine::GetSampleRate(Vector2 pixel)
 {
-	PaddedBoundingBox temp = *box;
-
-	Vector3 center = BoundingBoxCenter(box);
+	if (!activeContext->foveation)
+	{
+		return 1;
+	}
 
-	box->min = Vector3Min(temp.min, point);
-	box->max = Vector3Max(temp.max, point);
-}
+	// GL pixel centres, as the shader sees them
+	Vector2 position = Vector2(pixel.x + 0.5f, activeContext->resolution.y - pixel.y - 0.5f);
+	float weight = 0;
 
-void TracingEngine::GrowToIncludeTriangle(PaddedBoundingBox* box, Triangle triangle)
-{
-	GrowToInclude(box, triangle.posA);
-	GrowToInclude(box, triangle.posB);
-	GrowToInclude(box, triangle.posC);
-}
+	for (const Vector3& region : activeContext->projectedFocusRegions)
+	{
+		float t = std::clamp(Vector2Distance(position, Vector2(region.x, region.y)) / region.z - 1, 0.0f, 1.0f);
+		weight = std::max(weight, 1 - t * t * (3 - 2 * t));
+	}
 
-Vector4 TracingEngine::ColorToVector4(Color color)
-{
-	float colors[4] = { (float)color.r / (float)255, (float)color.g / (float)255,
-					   (float)color.b / (float)255, (float)color.a / (float)255 };
-	return Vector4(colors[0], colors[1], colors[2], colors[3]);
+	return activeContext->peripheryDensity + (1 - activeContext->peripheryDensity) * weight;
 }
 
-void TracingEngine::UploadSky()
+double TracingEngine::GetExpectedRays()
 {
-	unsigned int skyColorZenithLocation = GetShaderLocation(raytracingShader, "skyMaterial.skyColorZenith");
-	unsigned int skyColorHorizonLocation = GetShaderLocation(raytracingShader, "skyMaterial.skyColorHorizon");
-	unsigned int groundColorLocation = GetShaderLocation(raytracingShader, "skyMaterial.groundColor");
-	unsigned int sunColorLocation = GetShaderLocation(raytracingShader, "skyMaterial.sunColor");
-	unsigned int sunDirectionLocation = GetShaderLocation(raytracingShader, "skyMaterial.sunDirection");
-	unsigned int sunFocusLocation = GetShaderLocation(raytracingShader, "skyMaterial.sunFocus");
-	unsigned int sunIntensityLocation = GetShaderLocation(raytracingShader, "skyMaterial.sunIntensity");
+	double rays = 0;
 
-	Vector4 skyColorZenith = ColorToVector4(skyMaterial.skyColorZenith);
-	SetShaderValue(raytracingShader, skyColorZenithLocation, &skyColorZenith, SHADER_UNIFORM_VEC4);   // Set shader uniform value vector
+	for (int y = 0; y < (int)activeContext->resolution.y; y++)
+	{
+		for (int x = 0; x < (int)activeContext->resolution.x; x++)
+		{
+			rays += GetSampleRate(Vector2((float)x, (float)y));
+		}
+	}
 
-	Vector4 skyColorHorizon = ColorToVector4(skyMaterial.skyColorHorizon);
-	SetShaderValue(raytracingShader, skyColorHorizonLocation, &skyColorHorizon, SHADER_UNIFORM_VEC4);   // Set shader uniform value vector
+	return rays * activeContext->raysPerPixel;
+}
 
-	Vector4 groundColor = ColorToVector4(skyMaterial.groundColor);
-	SetShaderValue(raytracingShader, groundColorLocation, &groundColor, SHADER_UNIFORM_VEC4);   // Set shader uniform value vector
-	
-	Vector4 sunColor = ColorToVector4(skyMaterial.sunColor);
-	SetShaderValue(raytracingShader, sunColorLocation, &sunColor, SHADER_UNIFORM_VEC4);   // Set shader uniform value vector
+Rectangle TracingEngine::GetRenderRegion()
+{
+	float width = ceilf(activeContext->resolution.x * activeContext->renderScale);
+	float height = ceilf(activeContext->resolution.y * activeContext->renderScale);
 
-	SetShaderValue(raytracingShader, sunDirectionLocation, &skyMaterial.sunDirection, SHADER_UNIFORM_VEC3);   // Set shader uniform value vector
-	SetShaderValue(raytracingShader, sunFocusLocation, &skyMaterial.sunFocus, SHADER_UNIFORM_FLOAT);
-	SetShaderValue(raytracingShader, sunIntensityLocation, &skyMaterial.sunIntensity, SHADER_UNIFORM_FLOAT);
+	// image space has a top left origin, the scaled image sits at the bottom left in GL
+	return Rectangle(0, activeContext->resolution.y - height, width, height);
 }
 
-void TracingEngine::GenerateBVHS()
+void TracingEngine::DrawTracingPass(Rectangle region)
 {
-	int triangleOffset = 0;
+	activeContext->currentTarget = 1 - activeContext->currentTarget;
+	DrawTracingBand(region);
+}
 
-	for (int i = 0; i < meshes.size(); i++)
-	{
-		RaytracingMesh mesh = meshes[i];
+void TracingEngine::DrawTracingBand(Rectangle band)
+{
+	AccumulationTarget* previous = &activeContext->accumulationTargets[1 - activeContext->currentTarget];
+	AccumulationTarget* current = &activeContext->accumulationTargets[activeContext->currentTarget];
 
-		PaddedBoundingBox bounds{};
-		bounds.min = Vector3(mesh.boundingMin.x, mesh.boundingMin.y, mesh.boundingMin.z);
-		bounds.max = Vector3(mesh.boundingMax.x, mesh.boundingMax.y, mesh.boundingMax.z);
+	BeginTextureMode(current->color);
+	BeginScissorMode((int)band.x, (int)band.y, (int)band.width, (int)band.height);
+	ClearBackground(BLACK);
 
-		Node root = { .bounds = bounds, .triangleIndex = mesh.firstTriangleIndex, .numTriangles = mesh.numTriangles };
-		
-		nodes.push_back(root);
-		
-		meshes[i].rootNodeIndex = nodes.size() - 1;
+	rlEnableDepthTest();
+	BeginShaderMode(raytracingShader);
+	// sampler bindings only last for one batch
+	SetShaderValueTexture(raytracingShader, tracingParams.blueNoise, blueNoiseTexture);
+	SetShaderValueTexture(raytracingShader, tracingParams.environmentMap, EnvironmentMap::GetTexture());
+	SetShaderValueTexture(raytracingShader, tracingParams.previousNormalDepth, previous->normalDepth);
 
-		triangleOffset += mesh.numTriangles;
+	if (activeContext->primaryCacheMode != PRIMARY_CACHE_OFF)
+	{
+		// the recording frame's stores have to land before they are read
+		glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
 
-		SplitNode(nodes.size() - 1, 0, meshes[i].bvhDepth);
+		for (int i = 0; i < 3; i++)
+		{
+			glBindImageTexture(i, activeContext->primaryCacheTextures[i].id, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+		}
 	}
 
-	for (int i = 0; i < nodes.size(); i++)
+	if (activeContext->rasterActive)
 	{
-		nodeBuffer.nodes[i] = nodes[i];
+		glActiveTexture(GL_TEXTURE0 + RASTER_POSITION_UNIT);
+		glBindTexture(GL_TEXTURE_2D, activeContext->rasterTarget.texture.id);
+		glActiveTexture(GL_TEXTURE0 + RASTER_NORMAL_UNIT);
+		glBindTexture(GL_TEXTURE_2D, activeContext->rasterNormal.id);
+		glActiveTexture(GL_TEXTURE0);
 	}
-}
-
-void TracingEngine::UploadSSBOS()
-{
-	rlUpdateShaderBuffer(sphereSSBO, &sphereBuffer, sizeof(SphereBuffer), 0);
-	rlUpdateShaderBuffer(meshesSSBO, &meshBuffer, sizeof(MeshBuffer), 0);
-	rlUpdateShaderBuffer(trianglesSSBO, &triangleBuffer, sizeof(TriangleBuffer), 0);
-	rlUpdateShaderBuffer(nodesSSBO, &nodeBuffer, sizeof(NodeBuffer), 0);
-	rlUpdateShaderBuffer(gravityBodySSBO, &gravityBodyBuffer, sizeof(GravityBodyBuffer), 0);
 
-	rlEnableShader(raytracingShader.id);
-	rlBindShaderBuffer(gravityBodySSBO, 1);
-	rlBindShaderBuffer(meshesSSBO, 2);
-	rlBindShaderBuffer(trianglesSSBO, 3);
-	rlBindShaderBuffer(nodesSSBO, 4);
-	rlDisableShader();
+	// alpha holds history length and hit distance, blending would scale the outputs by it
+	rlDisableColorBlend();
+	DrawTextureRec(previous->color.texture, Rectangle(0, 0, (float)activeContext->resolution.x, (float)-activeContext->resolution.y), Vector2(0, 0), WHITE);
+	//DrawRectangleRec(Rectangle(0, 0, (float)resolution.x, (float)resolution.y), WHITE);
+	
+	EndShaderMode();
+	rlEnableColorBlend();
+	EndScissorMode();
+	EndTextureMode();
 }
 
-void TracingEngine::UploadSpheres()
+bool TracingEngine::DrawTracingSlice(Rectangle region)
 {
-	for (size_t i = 0; i < spheres.size(); i++)
+	// the whole frame reads the history of the last finished one, so the targets only swap at its start
+	if (activeContext->sliceRow == 0)
 	{
-		sphereBuffer.spheres[i] = spheres[i];
+		activeContext->currentTarget = 1 - activeContext->currentTarget;
 	}
-}
 
-void TracingEngine::UploadGravityBodies()
-{
-	for (size_t i = 0; i < gravityBodies.size(); i++)
+	// same small steps as UpdateQuality, the timing is of a band a few frames back
+	float gpuMs = Profiler::GetLatestGpuMs();
+
+	if (gpuMs > 0 && fabsf(gpuMs - activeContext->targetFrameMs) > activeContext->targetFrameMs * 0.05f)
 	{
-		gravityBodyBuffer.gravityBodies[i] = gravityBodies[i];
+		float step = std::clamp(sqrtf(activeContext->targetFrameMs / gpuMs), 0.8f, 1.25f);
+		activeContext->sliceRows = std::clamp(activeContext->sliceRows * step, 1.0f, region.height);
 	}
-}
 
-void TracingEngine::UploadTriangles()
-{
-	for (size_t i = 0; i < triangles.size(); i++)
+	int rows = std::min((int)activeContext->sliceRows, (int)region.height - activeContext->sliceRow);
+	DrawTracingBand(Rectangle(region.x, region.y + activeContext->sliceRow, region.width, (float)rows));
+	activeContext->sliceRow += rows;
+
+	if (activeContext->sliceRow >= (int)region.height)
 	{
-		triangleBuffer.triangles[i] = triangles[i];
+		activeContext->sliceRow = 0;
+		return true;
 	}
+
+	return false;
 }
 
-void TracingEngine::UploadMeshes()
+void TracingEngine::AbandonSlice()
 {
-	for (size_t i = 0; i < meshes.size(); i++)
+	// UploadData counts the frame when it starts, the next one is counted again from the last finished frame
+	activeContext->currentTarget = 1 - activeContext->currentTarget;
+	activeContext->numRenderedFrames--;
+	activeContext->accumulatedSamples -= activeContext->activeRaysPerPixel;
+	activeContext->previousRenderScale = activeContext->slicePreviousRenderScale;
+	activeContext->sliceRow = 0;
+
+	// only the bands traced so far were recorded, a reading frame leaves the cache whole
+	if (activeContext->primaryCacheMode == PRIMARY_CACHE_RECORD)
 	{
-		meshBuffer.meshes[i] = meshes[i];
+		activeContext->primaryCacheRecorded = false;
 	}
 }
 
-void TracingEngine::UploadRaylibModel(Model model, RaytracingMaterial material, bool indexed, int bvhDepth)
+Texture2D TracingEngine::ApplyFilter()
 {
-	for (int m = 0; m < model.meshCount; m++)
-	{
-		Mesh mesh = model.meshes[m];
-
-		BoundingBox bounds = GetMeshBoundingBox(mesh);
-		Vector3 position;
-		Quaternion rotation;
-		Vector3 scale;
-		MatrixDecompose(model.transform, &position, &rotation, &scale);
+	Rectangle source = Rectangle(0, 0, (float)activeContext->resolution.x, (float)-activeContext->resolution.y);
+	AccumulationTarget* current = &activeContext->accumulationTargets[activeContext->currentTarget];
+	Texture2D input = current->color.texture;
 
-		bounds.min += position;
-		bounds.max += position;
+	// taps clamp to the scaled image rather than reading outside it
+	Rectangle region = GetRenderRegion();
+	Vector2 size = Vector2(region.width, region.height);
+	SetShaderValue(postShader, postParams.resolution, &size, SHADER_UNIFORM_VEC2);
 
-		int firstTriIndex = totalTriangles;
+	for (int i = 0; i < activeContext->filterIterations; i++)
+	{
+		RenderTexture2D* target = &activeContext->filterRenderTextures[i % 2];
 
-		if (indexed)
-		{
-			for (int i = 0; i < mesh.triangleCount; i++) {
-				Triangle tri;
+		int stepWidth = 1 << i;
+		int firstPass = i == 0;
+		int lastPass = i == activeContext->filterIterations - 1;
+		// later passes reach further, so they get stricter about luminance
+		float colorPhi = activeContext->filterColorPhi / (float)stepWidth;
 
-				// For each triangle, we have 3 indices (in an indexed mesh)
-				int idx1 = mesh.indices[i * 3];
-				int idx2 = mesh.indices[i * 3 + 1];
-				int idx3 = mesh.indices[i * 3 + 2];
+		BeginTextureMode(*target);
+		BeginScissorMode((int)region.x, (int)region.y, (int)region.width, (int)region.height);
+		BeginShaderMode(postShader);
+		SetShaderValueTexture(postShader, postParams.gNormalDepth, current->normalDepth);
+		SetShaderValueTexture(postShader, postParams.gAlbedo, current->albedo);
+		SetShaderValueTexture(postShader, postParams.gEmission, current->emission);
+		SetShaderValue(postShader, postParams.stepWidth, &stepWidth, SHADER_UNIFORM_INT);
+		SetShaderValue(postShader, postParams.firstPass, &firstPass, SHADER_UNIFORM_INT);
+		SetShaderValue(postShader, postParams.lastPass, &lastPass, SHADER_UNIFORM_INT);
+		SetShaderValue(postShader, postParams.colorPhi, &colorPhi, SHADER_UNIFORM_FLOAT);
+		SetShaderValue(postShader, postParams.normalPhi, &activeContext->filterNormalPhi, SHADER_UNIFORM_FLOAT);
+		SetShaderValue(postShader, postParams.depthPhi, &activeContext->filterDepthPhi, SHADER_UNIFORM_FLOAT);
+		DrawTextureRec(input, source, Vector2(0, 0), WHITE);
+		EndShaderMode();
+		EndScissorMode();
+		EndTextureMode();
 
-				// Assign positions from the vertices array
-				Vector3 temp1 = *(Vector3*)&mesh.vertices[idx1 * 3] * model.transform;       // 3 floats per position
-				Vector3 temp2 = *(Vector3*)&mesh.vertices[idx2 * 3] * model.transform;
-				Vector3 temp3 = *(Vector3*)&mesh.vertices[idx3 * 3] * model.transform;
+		input = target->texture;
+	}
 
-				tri.posA = temp1;
-				tri.posB = temp2;
-				tri.posC = temp3;
+	return input;
+}
 
-				Quaternion rotation = QuaternionIdentity();
-				Vector3 position = Vector3(0, 0, 0);
-				Vector3 scale = Vector3(1, 1, 1);
-				MatrixDecompose(model.transform, &position, &rotation, &scale);
+Texture2D TracingEngine::Upscale(Texture2D input)
+{
+	Rectangle region = GetRenderRegion();
+	Vector2 size = Vector2(region.width, region.height);
+
+	BeginTextureMode(activeContext->upscaleRenderTexture);
+	BeginShaderMode(upscaleShader);
+	SetShaderValueTexture(upscaleShader, upscaleParams.gNormalDepth, activeContext->accumulationTargets[activeContext->currentTarget].normalDepth);
+	SetShaderValue(upscaleShader, upscaleParams.renderScale, &activeContext->renderScale, SHADER_UNIFORM_FLOAT);
+	SetShaderValue(upscaleShader, upscaleParams.renderSize, &size, SHADER_UNIFORM_VEC2);
+	// the unfiltered accumulation keeps its history length in alpha
+	rlDisableColorBlend();
+	DrawTextureRec(input, Rectangle(0, 0, (float)activeContext->resolution.x, (float)-activeContext->resolution.y), Vector2(0, 0), WHITE);
+	EndShaderMode();
+	rlEnableColorBlend();
+	EndTextureMode();
 
-				// Assign normals from the normals array
-				Vector3 tempA = Vector3RotateByQuaternion(*(Vector3*)&mesh.normals[idx1 * 3], rotation);      // 3 floats per normal
-				Vector3 tempB = Vector3RotateByQuaternion(*(Vector3*)&mesh.normals[idx2 * 3], rotation);
-				Vector3 tempC = Vector3RotateByQuaternion(*(Vector3*)&mesh.normals[idx3 * 3], rotation);
+	return activeContext->upscaleRenderTexture.texture;
+}
 
-				tri.normalA = tempA;
-				tri.normalB = tempB;
-				tri.normalC = tempC;
+bool TracingEngine::Render(Camera* camera)
+{
+	Texture2D presented;
+	bool finished = true;
 
-				triangles.push_back(tri);
-				totalTriangles++;
-			}
+	if (WavefrontTracer::enabled)
+	{
+		presented = WavefrontTracer::Render(camera);
+	}
+	else
+	{
+		Profiler::BeginGpuStage("tracing");
+		if (activeContext->frameSliced)
+		{
+			finished = DrawTracingSlice(GetRenderRegion());
 		}
 		else
 		{
-			for (int i = 0; i < mesh.triangleCount; i++) {
-				Triangle tri;
-
-				// For each triangle, we have 3 indices (in an indexed mesh)
-				int idx1 = i * 3;
-				int idx2 = i * 3 + 1;
-				int idx3 = i * 3 + 2;
-
-				// Assign positions from the vertices array
-				Vector3 temp1 = *(Vector3*)&mesh.vertices[idx1 * 3] * model.transform;       // 3 floats per position
-				Vector3 temp2 = *(Vector3*)&mesh.vertices[idx2 * 3] * model.transform;
-				Vector3 temp3 = *(Vector3*)&mesh.vertices[idx3 * 3] * model.transform;
+			DrawTracingPass(GetRenderRegion());
+		}
+		Profiler::EndGpuStage();
 
-				tri.posA = temp1;
-				tri.posB = temp2;
-				tri.posC = temp3;
+		// half a frame would show the bands, the last finished one stays up, filter and upscale targets included
+		if (!finished)
+		{
+			presented = activeContext->presentedTexture;
+		}
+		else
+		{
+			presented = activeContext->accumulationTargets[activeContext->currentTarget].color.texture;
+
+			// heatmaps are shown as they are
+			if (activeContext->filter && !statsShaderActive)
+			{
+				Profiler::BeginGpuStage("filter");
+				presented = ApplyFilter();
+				Profiler::EndGpuStage();
+			}
 
-				Quaternion rotation = QuaternionIdentity();
-				Vector3 position = Vector3(0, 0, 0);
-				Vector3 scale = Vector3(1, 1, 1);
-				MatrixDecompose(model.transform, &position, &rotation, &scale);
+			if (activeContext->renderScale < 1)
+			{
+				Profiler::BeginGpuStage("upscale");
+				presented = Upscale(presented);
+				Profiler::EndGpuStage();
+			}
+		}
+	}
 
-				// Assign normals from the normals array
-				Vector3 tempA = Vector3RotateByQuaternion(*(Vector3*)&mesh.normals[idx1 * 3], rotation);      // 3 floats per normal
-				Vector3 tempB = Vector3RotateByQuaternion(*(Vector3*)&mesh.normals[idx2 * 3], rotation);
-				Vector3 tempC = Vector3RotateByQuaternion(*(Vector3*)&mesh.normals[idx3 * 3], rotation);
+	activeContext->presentedTexture = presented;
 
-				tri.normalA = tempA;
-				tri.normalB = tempB;
-				tri.normalC = tempC;
+	BeginDrawing();
+	ClearBackground(BLACK);
 
-				triangles.push_back(tri);
-				totalTriangles++;
-			}
-		}
+	Profiler::BeginGpuStage("present");
 
-		RaytracingMesh rmesh = { firstTriIndex, mesh.triangleCount, 0, bvhDepth, material, Vector4(bounds.min.x, bounds.min.y, bounds.min.z, 0), Vector4(bounds.max.x, bounds.max.y, bounds.max.z, 0)};
+	// the unfiltered accumulation keeps its history length in alpha
+	rlDisableColorBlend();
+	DrawTextureRec(presented, Rectangle(0, 0, (float)activeContext->resolution.x, (float)-activeContext->resolution.y), Vector2(0, 0), WHITE);
+	rlDrawRenderBatchActive();
+	rlEnableColorBlend();
 
-		TracingEngine::meshes.push_back(rmesh);
+	if (debug)
+	{
+		DrawDebug(camera);
 	}
 
-	models.push_back(model);
-}
+	Profiler::EndGpuStage();
+	EndDrawing();
 
-void TracingEngine::UploadStaticData()
-{
-	UploadSpheres();
-	UploadSky();
-	UploadGravityBodies();
+	if (statsShaderActive && ++traversalStatsFrames >= 16)
+	{
+		ReadTraversalStats();
+	}
 
-	GenerateBVHS();
-	UploadTriangles();
-	UploadMeshes();
+	Profiler::EndFrame();
 
-	UploadSSBOS();
+	return finished;
 }
 
-void TracingEngine::UploadData(Camera* camera)
+void TracingEngine::RenderRegion(Camera* camera, Rectangle region, int frames)
 {
-	float planeHeight = 0.01f * tan(camera->fovy * 0.5f * DEG2RAD) * 2;
-	float planeWidth = planeHeight * (resolution.x / resolution.y);
-	Vector3 viewParams = Vector3(planeWidth, planeHeight, 0.01f);
-	SetShaderValue(raytracingShader, tracingParams.viewParams, &viewParams, SHADER_UNIFORM_VEC3);
+	bool wasDenoising = activeContext->denoise;
+	bool wasPaused = activeContext->pause;
+	bool wasSlicing = activeContext->timeSlicing;
 
-	if (denoise)
-	{
-		if (!pause)
-		{
-			numRenderedFrames++;
-		}
-	}
-	else
+	if (activeContext->sliceRow > 0)
 	{
-		numRenderedFrames = 0;
+		AbandonSlice();
 	}
 
-	SetShaderValue(raytracingShader, tracingParams.numRenderedFrames, &numRenderedFrames, SHADER_UNIFORM_INT);
+	activeContext->denoise = true;
+	activeContext->pause = false;
+	// each pass here traces the region whole
+	activeContext->timeSlicing = false;
 
-	SetShaderValue(raytracingShader, tracingParams.cameraPosition, &camera->position, SHADER_UNIFORM_VEC3);
+	// UploadData counts up before the first pass, so the first frame gets the full weight and ignores old history
+	activeContext->numRenderedFrames = -1;
+	// the cache only holds what the passes cover, the first records the region and the rest read it
+	activeContext->primaryCacheRecorded = false;
 
-	float camDist = 1.0f / (tanf(camera->fovy * 0.5f * DEG2RAD));
-	Vector3 camDir = Vector3Scale(Vector3Normalize(Vector3Subtract(camera->target, camera->position)), camDist);
-	SetShaderValue(raytracingShader, tracingParams.cameraDirection, &(camDir), SHADER_UNIFORM_VEC3);
+	for (int f = 0; f < frames; f++)
+	{
+		UploadData(camera);
+
+		// the scissor keeps the recording pass to the region, reads of rays blurred past it trace instead
+		if (activeContext->primaryCacheMode == PRIMARY_CACHE_RECORD)
+		{
+			activeContext->primaryCacheRegion = region;
+		}
 
-	SetShaderValue(raytracingShader, tracingParams.denoise, &denoise, SHADER_UNIFORM_INT);
-	SetShaderValue(raytracingShader, tracingParams.pause, &pause, SHADER_UNIFORM_INT);
+		DrawTracingPass(region);
+	}
 
-	SetShaderValue(postShader, postParams.denoise, &denoise, SHADER_UNIFORM_INT);
+	activeContext->denoise = wasDenoising;
+	activeContext->pause = wasPaused;
+	activeContext->timeSlicing = wasSlicing;
+	activeContext->primaryCacheRecorded = false;
 }
 
-void TracingEngine::Render(Camera* camera)
+void TracingEngine::ReadRegion(Rectangle region, float* rgb)
 {
-	BeginTextureMode(raytracingRenderTexture);
-	ClearBackground(BLACK);
+	int x = (int)region.x;
+	int width = (int)region.width;
+	int height = (int)region.height;
+	// GL rows start at the bottom
+	int y = (int)activeContext->resolution.y - (int)region.y - height;
 
-	rlEnableDepthTest();
-	BeginShaderMode(raytracingShader);
-
-	DrawTextureRec(previouseFrameRenderTexture.texture, Rectangle(0, 0, (float)resolution.x, (float)-resolution.y), Vector2(0, 0), WHITE);
-	//DrawRectangleRec(Rectangle(0, 0, (float)resolution.x, (float)resolution.y), WHITE);
-	
-	EndShaderMode();
-	EndTextureMode();
+	std::vector<float> rgba(width * height * 4);
 
-	BeginDrawing();
-	ClearBackground(BLACK);
+	rlDrawRenderBatchActive();
+	rlEnableFramebuffer(activeContext->accumulationTargets[activeContext->currentTarget].color.id);
+	glReadPixels(x, y, width, height, GL_RGBA, GL_FLOAT, rgba.data());
+	rlDisableFramebuffer();
 
-	if (denoise && pause)
-	{
-		BeginShaderMode(postShader);
-		DrawTextureRec(raytracingRenderTexture.texture, Rectangle(0, 0, (float)resolution.x, (float)-resolution.y), Vector2(0, 0), WHITE);
-		EndShaderMode();
-	}
-	else
+	for (int row = 0; row < height; row++)
 	{
-		DrawTextureRec(raytracingRenderTexture.texture, Rectangle(0, 0, (float)resolution.x, (float)-resolution.y), Vector2(0, 0), WHITE);
-	}
+		const float* source = &rgba[(height - 1 - row) * width * 4];
+		float* destination = &rgb[row * width * 3];
 
-	if (debug)
-	{
-		DrawDebug(camera);
+		for (int i = 0; i < width; i++)
+		{
+			destination[i * 3 + 0] = source[i * 4 + 0];
+			destination[i * 3 + 1] = source[i * 4 + 1];
+			destination[i * 3 + 2] = source[i * 4 + 2];
+		}
 	}
-
-	EndDrawing();
-
-	BeginTextureMode(previouseFrameRenderTexture);
-	ClearBackground(WHITE);
-	DrawTextureRec(raytracingRenderTexture.texture, Rectangle(0, 0, (float)resolution.x, (float)-resolution.y), Vector2(0, 0), WHITE);
-	EndTextureMode();
 }
 
 void TracingEngine::DrawDebugBounds(PaddedBoundingBox* box, Color color)
@@ -492,15 +2451,87 @@ void TracingEngine::DrawDebug(Camera* camera)
 	DrawFPS(10, 10);
 	DrawText(TextFormat("triangles: %i", triangles.size()), 10, 30, 20, RED);
 	DrawText(TextFormat("nodes: %i", nodes.size()), 10, 50, 20, RED);
+	if (lastRefitUploadedNodes > 0) DrawText(TextFormat("refit: %i nodes uploaded, %i subtrees rebuilt", lastRefitUploadedNodes, lastRefitRebuiltSubtrees), 10, 110, 20, RED);
+
+	if (debug && !statsShaderActive) DrawText("DEBUG MODE ACTIVE", 10, 70, 20, WHITE);
+	if (!activeContext->pause && activeContext->denoise) DrawText("TEMPORAL DENOISING ACTIVE", 10, 90, 20, WHITE);
+	if (activeContext->pause && activeContext->denoise) DrawText("STATIC DENOISING ACTIVE", 10, 90, 20, WHITE);
+	if (activeContext->filter && !statsShaderActive) DrawText(TextFormat("A-TROUS FILTER: %i passes", activeContext->filterIterations), 300, 70, 20, WHITE);
+	if (activeContext->pause && !activeContext->denoise) DrawText("PAUSED", 10, 90, 20, WHITE);
+	if (activeContext->frameSliced) DrawText(TextFormat("TIME SLICED: %i rows per band", (int)activeContext->sliceRows), 300, 90, 20, WHITE);
+	if (activeContext->rasterActive) DrawText("HYBRID FIRST HIT", 300, 50, 20, WHITE);
+	if (activeContext->primaryCacheMode == PRIMARY_CACHE_READ) DrawText("PRIMARY RAYS CACHED", 300, 30, 20, WHITE);
+
+	if (statsShaderActive)
+	{
+		static const char* heatmapNames[] = { "", "NODE VISITS", "TRIANGLE TESTS", "BENDING EVALUATIONS" };
+		DrawText(TextFormat("HEATMAP: %s (0 - %.0f per sample)", heatmapNames[heatmap], heatmapRanges[heatmap]), 10, 70, 20, WHITE);
+		DrawText(TextFormat("%.1f nodes/ray, %.1f tris/ray, %.1f bending/ray", traversalStats.nodesPerRay, traversalStats.trianglesPerRay, traversalStats.bendingPerRay), 10, 110, 20, WHITE);
+	}
+
+	Profiler::DrawGraph(10, 140, 480, 120);
+
+	UpdateMemoryUsage();
+	MemoryTracker::DrawOverlay(10, 270);
+}
+
+Image TracingEngine::CaptureFrame(bool filtered)
+{
+	// the current target only holds the bands traced so far
+	if (activeContext->sliceRow > 0)
+	{
+		AbandonSlice();
+	}
 
-	if (debug) DrawText("DEBUG MODE ACTIVE", 10, 70, 20, WHITE);
-	if (!pause && denoise) DrawText("TEMPORAL DENOISING ACTIVE", 10, 90, 20, WHITE);
-	if (pause && denoise) DrawText("STATIC DENOISING ACTIVE", 10, 90, 20, WHITE);
-	if (pause && !denoise) DrawText("PAUSED", 10, 90, 20, WHITE);
+	Texture2D texture = filtered ? ApplyFilter() : activeContext->accumulationTargets[activeContext->currentTarget].color.texture;
+	Image image = LoadImageFromTexture(activeContext->renderScale < 1 ? Upscale(texture) : texture);
+	ImageFlipVertical(&image);
+	ImageFormat(&image, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8);
+	return image;
 }
 
 void TracingEngine::Unload()
 {
-	UnloadRenderTexture(raytracingRenderTexture);
+	ShaderCompiler::Stop();
+
+	// what the engine held at the end, and the most it ever held
+	UpdateMemoryUsage();
+	MemoryTracker::LogReport();
+
+	WavefrontTracer::Unload();
+	GpuBVHBuilder::Unload();
+
+	for (std::unique_ptr<RenderContext>& context : contexts)
+	{
+		UnloadRenderTargets(context.get());
+	}
+
+	contexts.clear();
+	activeContext = nullptr;
+
 	UnloadShader(raytracingShader);
+	UnloadShader(statsShader);
+	UnloadShader(postShader);
+	UnloadShader(upscaleShader);
+	UnloadShader(rasterShader);
+	// the shader is already gone, UnloadMaterial would unload it again
+	MemFree(rasterMaterial.maps);
+	MemoryTracker::Add(MEMORY_GPU_TEXTURES, -MemoryTracker::TextureBytes(blueNoiseTexture));
+	UnloadTexture(blueNoiseTexture);
+	EnvironmentMap::Unload();
+
+	ShaderBufferPool::Release(&sphereBuffer);
+	ShaderBufferPool::Release(&trianglesBuffer);
+	ShaderBufferPool::Release(&meshesBuffer);
+	ShaderBufferPool::Release(&nodesBuffer);
+	ShaderBufferPool::Unload();
+	rlUnloadShaderBuffer(gravityBodySSBO);
+	rlUnloadShaderBuffer(traversalStatsSSBO);
+	MemoryTracker::Add(MEMORY_GPU_ENGINE_BUFFERS, -(long long)(sizeof(GravityBodyBuffer) + sizeof(TraversalStatsBuffer)));
+
+	ClearSceneData();
+
+	threadPool.reset();
+
+	Profiler::Unload();
 }
\ No newline at end of file
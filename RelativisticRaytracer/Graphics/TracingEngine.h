@@ -1,8 +1,19 @@
 #pragma once
 
 #include <vector>
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <memory_resource>
 #include <raylib.h>
 
+#include "ThreadPool.h"
+#include "Sampler.h"
+#include "ShaderCompiler.h"
+#include "ShaderBufferPool.h"
+#include "MemoryTracker.h"
+#include "WavefrontTracer.h"
+
 struct TracingParams
 {
 	int cameraPosition,
@@ -12,18 +23,87 @@ struct TracingParams
 		resolution,
 		currentFrame,
 		previousFrame,
-		numRenderedFrames,
 		raysPerPixel,
 		maxBounces,
 		denoise,
 		blur,
-		pause;
+		pause,
+		numGravityBodies,
+		heatmap,
+		heatmapRange,
+		samplerType,
+		frameIndex,
+		sobolDirections,
+		blueNoise,
+		environmentMap,
+		environmentSampling,
+		previousNormalDepth,
+		previousCameraPosition,
+		previousCameraDirection,
+		cameraMoved,
+		historyValid,
+		maxHistory,
+		renderScale,
+		previousRenderScale,
+		sampleOffset,
+		focusRegions,
+		numFocusRegions,
+		peripheryDensity,
+		sphereRootNode,
+		hybridFirstHit,
+		rasterPosition,
+		rasterNormal,
+		primaryCacheMode,
+		primaryCacheBounds;
+};
+
+struct UpscaleParams
+{
+	int
+		gNormalDepth,
+		renderScale,
+		renderSize;
+};
+
+struct RasterParams
+{
+	int meshIndex,
+		rotation;
 };
 
 struct PostParams
 {
 	int resolution,
-		denoise;
+		stepWidth,
+		firstPass,
+		lastPass,
+		colorPhi,
+		normalPhi,
+		depthPhi,
+		gNormalDepth,
+		gAlbedo,
+		gEmission;
+};
+
+// colour with the per pixel history length in alpha, plus the G-buffer the same pass writes
+struct AccumulationTarget
+{
+	RenderTexture2D color;
+	Texture2D normalDepth;
+	Texture2D albedo;
+	// light given off where the primary ray hit, the filter leaves it out of the albedo round trip
+	Texture2D emission;
+};
+
+// compile time specialisation of raytracer_fragment.glsl, picked from the scene by TracingEngine
+struct ShaderVariant
+{
+	// loop bound of the bounce loop, the maxBounces uniform can still stop it earlier
+	int maxBounces;
+	int bvhStackSize;
+	bool gravity;
+	bool spheres;
+	bool traversalStats;
 };
 
 struct SkyMaterial
@@ -40,7 +120,9 @@ struct SkyMaterial
 struct RaytracingMaterial
 {
 	Vector4 color;
+	// rgb and strength
 	Vector4 emission;
+	// y smoothness, z chance of taking the GGX lobe instead of the lambert one (smoothness when 0)
 	Vector4 e_s_b_b;
 };
 
@@ -95,71 +177,287 @@ struct Node
 	float padding;
 };
 
+// lots of small arrays per mesh, allocated from the scene arena and dropped with it on ResetScene
+struct MeshBVHInfo
+{
+	std::pmr::vector<std::pmr::vector<int>> levels;
+	std::pmr::vector<int> subtreeRoots;
+	std::pmr::vector<int> subtreeDepths;
+	std::pmr::vector<float> subtreeCosts;
+
+	MeshBVHInfo(std::pmr::memory_resource* arena) : levels(arena), subtreeRoots(arena), subtreeDepths(arena), subtreeCosts(arena) {}
+};
+
 struct GravityBody
 {
 	Vector4 posmass;
 };
 
+// a world space sphere that is traced at the full sample rate when foveation is on
+struct FocusRegion
+{
+	Vector3 position;
+	float radius;
+};
+
+#define MAX_FOCUS_REGIONS 16
+
 struct GravityBodyBuffer
 {
-	GravityBody gravityBodies[1];
+	GravityBody gravityBodies[8];
+};
+
+// leaves of the sphere hierarchy are split until they hold at most this many spheres
+#define SPHERE_LEAF_SIZE 4
+
+// node visits, triangle tests, bending evaluations and rays, spread over slots by pixel
+#define TRAVERSAL_STAT_SLOTS 256
+
+// the shader keeps every counter as a low and a high 32 bit word, which read back as one little endian 64 bit
+// counter, so deep hierarchies at full resolution do not wrap between the reads every 16 frames
+struct TraversalStatsBuffer
+{
+	unsigned long long counters[TRAVERSAL_STAT_SLOTS * 4];
+};
+
+struct TraversalStats
+{
+	double nodesPerRay;
+	double trianglesPerRay;
+	double bendingPerRay;
+	unsigned long long rays;
+};
+
+enum TraversalHeatmap
+{
+	HEATMAP_NONE,
+	HEATMAP_NODES,
+	HEATMAP_TRIANGLES,
+	HEATMAP_BENDING
+};
+
+// what the tracer does with the per pixel primary ray cache, see TracingEngine::UpdatePrimaryCache
+enum PrimaryCacheMode
+{
+	PRIMARY_CACHE_OFF,
+	PRIMARY_CACHE_RECORD,
+	PRIMARY_CACHE_READ
+};
+
+enum BVHBuilder
+{
+	// median splits to each mesh's bvhDepth, refitted when deformed
+	BVH_BUILDER_CPU,
+	// linear BVH in compute shaders, one triangle per leaf, rebuilt when deformed
+	BVH_BUILDER_GPU
 };
 
-struct SphereBuffer
+// programs rebuilt together when their source changes on disk
+enum ShaderReload
 {
-	Sphere spheres[4];
+	RELOAD_TRACING,
+	RELOAD_POST,
+	RELOAD_UPSCALE,
+	RELOAD_RASTER,
+	RELOAD_WAVEFRONT,
+	RELOAD_LBVH,
+	RELOAD_COUNT
 };
 
-struct TriangleBuffer
+// what can be tuned per view, CreateContext starts a new view from the active one's
+struct ViewSettings
 {
-	Triangle triangles[500000];
+	bool denoise = false;
+	bool pause = false;
+
+	// a-trous filter guided by the G-buffer, runs every frame on top of the accumulation, phis
+	// are the edge stopping widths for luminance, normal (as an exponent) and relative depth
+	bool filter = true;
+	int filterIterations = 5;
+	float filterColorPhi = 0.6f;
+	float filterNormalPhi = 64.0f;
+	float filterDepthPhi = 0.05f;
+
+	// history kept per pixel while the camera moves, more reacts slower to lighting changes and
+	// smears further where reprojection is only approximate, such as around gravity bodies
+	float maxHistoryMoving = 32;
+
+	// GPU milliseconds per frame to hold by lowering rays per pixel, then resolution, then bounces, 0 keeps full quality
+	float targetFrameMs = 0;
+	float minRenderScale = 0.5f;
+	int minBounces = 2;
+	// with targetFrameMs set, frames accumulated with a still camera are traced at full quality in bands of rows
+	// across several Render calls instead of at lowered quality, the last finished frame stays on screen meanwhile
+	bool timeSlicing = false;
+
+	// outside the focus regions only this fraction of the rays per pixel is traced, down to skipping pixels
+	// on some frames, accumulation and the filter fill in the rest
+	bool foveation = false;
+	float peripheryDensity = 0.25f;
+	// bending falls off with the squared distance, past this it is under two degrees
+	float gravityFocusRadius = 6.0f;
+
+	// restarts accumulation when changed, see SamplerType
+	int samplerType = SAMPLER_SOBOL;
+	// added to the sample index of accumulated frames, a reference render takes a sequence of its own
+	// so the curves compared against it do not replay the samples it was made from
+	int sampleSeed = 0;
 };
 
-struct MeshBuffer
+// the tracing shader's per frame uniforms as UploadData worked them out, every band of a sliced frame
+// sends them again since another view's frames can have replaced them in between
+struct FrameUniforms
 {
-	RaytracingMesh meshes[10];
+	Vector3 viewParams;
+	Vector3 cameraPosition;
+	Vector3 cameraDirection;
+	Vector3 previousCameraPosition;
+	Vector3 previousCameraDirection;
+	int samplerType;
+	int sampleOffset;
+	int frameIndex;
+	int raysPerPixel;
+	int maxBounces;
+	float renderScale;
+	float previousRenderScale;
+	int environmentSampling;
+	int historyValid;
+	int cameraMoved;
+	float maxHistory;
+	float peripheryDensity;
+	int denoise;
+	int pause;
+	int hybridFirstHit;
+	int primaryCacheMode;
+	// min and max corner of the recorded pixels, GL pixels with a bottom left origin
+	Vector4 primaryCacheBounds;
 };
 
-struct NodeBuffer
+// one view of the scene with its own render targets, camera history, quality and slice progress and
+// settings. TracingEngine renders whichever context is active, geometry, BVHs and shaders are shared
+struct RenderContext : ViewSettings
 {
-	Node nodes[1000000];
+	Vector2 resolution;
+	int maxBounces;
+	int raysPerPixel;
+	float blur;
+
+	// ping-ponged, each pass reprojects the other one's history into the current one
+	AccumulationTarget accumulationTargets[2] = {};
+	int currentTarget = 0;
+	RenderTexture2D filterRenderTextures[2] = {};
+	RenderTexture2D upscaleRenderTexture = { 0 };
+	// what the last Render put on screen, the accumulation, filter or upscale target
+	Texture2D presentedTexture = { 0 };
+
+	// first surface of every pixel rasterized from the models, position and mesh index here and the normal
+	// in rasterNormal, only loaded once hybridFirstHit is used
+	RenderTexture2D rasterTarget = { 0 };
+	Texture2D rasterNormal = { 0 };
+	// the raster was drawn for the frame being traced
+	bool rasterActive = false;
+
+	// bent direction, first hit and hit normal of every pixel's primary ray, images the tracer records once and
+	// then reads instead of bending and traversing, only loaded once primaryCache is used
+	Texture2D primaryCacheTextures[3] = {};
+	// a whole frame recorded the cache, from the camera and render scale of the frame before this one
+	bool primaryCacheRecorded = false;
+	// sceneVersion when it was recorded
+	int primaryCacheVersion = -1;
+	// the image space region the recording frame traced, RenderRegion records less than the whole image
+	Rectangle primaryCacheRegion = {};
+	int primaryCacheMode = PRIMARY_CACHE_OFF;
+
+	// the compute tracer's running mean of this view
+	WavefrontView wavefront;
+
+	Vector3 previousCameraPosition = {};
+	Vector3 previousCameraDirection = {};
+	// picked by UpdateQuality each frame, the accumulation only covers the bottom left renderScale of the targets
+	float renderScale = 1;
+	float previousRenderScale = 1;
+	int activeRaysPerPixel;
+	int activeBounces;
+	// fraction of the work of a full quality frame the controller is aiming for
+	float qualityWork = 1;
+	// camera samples already in the accumulation, so changing rays per pixel continues the sequence
+	int accumulatedSamples = 0;
+	int numRenderedFrames = -1;
+	int frameIndex = 0;
+	// the sampler the accumulation was started with, -1 before the first frame
+	int activeSamplerType = -1;
+	// gravity bodies and focusRegions projected for the current camera, GL pixel centre and radius
+	std::vector<Vector3> projectedFocusRegions;
+	FrameUniforms uniforms = {};
+
+	// the accumulation frame being traced is split into bands over several Render calls, sliceRow is
+	// the first row of the next band and 0 between frames
+	bool frameSliced = false;
+	int sliceRow = 0;
+	// rows per band, steered towards targetFrameMs
+	float sliceRows = 32;
+	// previousRenderScale before the sliced frame started, to go back to if it is abandoned
+	float slicePreviousRenderScale = 1;
 };
 
 class TracingEngine
 {
+	friend class SceneFile;
+	friend class WavefrontTracer;
+	friend class EnvironmentMap;
+
 private:
 	inline static Shader raytracingShader;
+	inline static Shader statsShader;
+	inline static TracingParams statsParams;
+	inline static bool statsShaderActive = false;
+	inline static ShaderVariant activeVariant;
+	inline static std::string activeVariantDefines;
 	inline static Shader postShader;
 
-	inline static RenderTexture2D raytracingRenderTexture;
-	inline static RenderTexture2D previouseFrameRenderTexture;
+	// modification times of the watched sources, indexed by ShaderReload
+	inline static long shaderModTimes[RELOAD_COUNT];
+	inline static double lastShaderPoll = 0;
+
+	inline static Shader upscaleShader;
+	inline static UpscaleParams upscaleParams;
+	inline static Shader rasterShader;
+	inline static RasterParams rasterParams;
+	inline static Material rasterMaterial;
+	// counts up whenever the geometry, gravity bodies or tracing program change
+	inline static int sceneVersion = 0;
 	inline static TracingParams tracingParams;
 	inline static PostParams postParams;
-	inline static Vector2 resolution;
-
-	inline static int numRenderedFrames;
-	inline static int maxBounces;
-	inline static int raysPerPixel;
-	inline static float blur;
 
 	inline static std::vector<Node> nodes;
+	inline static std::vector<MeshBVHInfo> meshBVHInfos;
+	// host allocations that live exactly as long as the scene, released in one go, counted as MEMORY_HOST_BVH_REFIT
+	inline static MemoryTracker::Resource sceneArenaMemory{ MEMORY_HOST_BVH_REFIT };
+	inline static std::pmr::monotonic_buffer_resource sceneArena{ &sceneArenaMemory };
+	inline static std::vector<char> dirtyNodes;
+	inline static std::unique_ptr<ThreadPool> threadPool;
 
 	inline static Node root;
 
 	inline static int gravityBodySSBO;
-	inline static int sphereSSBO;
-	inline static int trianglesSSBO;
-	inline static int meshesSSBO;
-	inline static int nodesSSBO;
+	// sized to the scene, from ShaderBufferPool so a reset scene's buffers go to the next one
+	inline static PooledBuffer sphereBuffer = { 0, 0, 0 };
+	inline static PooledBuffer trianglesBuffer = { 0, 0, 0 };
+	inline static PooledBuffer meshesBuffer = { 0, 0, 0 };
+	inline static PooledBuffer nodesBuffer = { 0, 0, 0 };
+	inline static int traversalStatsSSBO;
+	inline static int traversalStatsFrames = 0;
 
 	inline static GravityBodyBuffer gravityBodyBuffer;
-	inline static MeshBuffer meshBuffer;
-	inline static TriangleBuffer triangleBuffer;
-	inline static NodeBuffer nodeBuffer;
 	inline static int totalTriangles = 0;
 	inline static int totalMeshes = 0;
 
-	inline static SphereBuffer sphereBuffer;
+	// spheres share the node buffer with the meshes, in a tree of their own, -1 without spheres
+	inline static int sphereRootNode = -1;
+	inline static int sphereBvhDepth = 0;
+
+	inline static Texture2D blueNoiseTexture;
+	inline static std::vector<int> sobolDirections;
 
 	static PaddedBoundingBox GetMeshPaddedBoundingBox(Mesh mesh);
 	static void GrowToInclude(PaddedBoundingBox* box, Vector3 point);
@@ -168,42 +466,197 @@ private:
 	static Vector3 BoundingBoxCenter(PaddedBoundingBox* box);
 	static float BoundingBoxCenterOnAxis(PaddedBoundingBox* box, int axis);
 	static float TriangleCenterOnAxis(Triangle* triangle, int axis);
+	static float BoundingBoxArea(PaddedBoundingBox* box);
 	static void SplitNode(int parentIndex, int depth, int maxDepth);
+	static void SplitSphereNode(int parentIndex, int depth);
+	static void BuildSphereBVH();
+
+	static Triangle ReadRaylibTriangle(Mesh mesh, Matrix transform, Quaternion rotation, int idx1, int idx2, int idx3);
+	static void BuildBVHInfo(int meshIndex);
+	static float SubtreeCost(int nodeIndex);
+	static bool RefitNode(int nodeIndex);
+	static void RefitBVH(int meshIndex);
+	static void RebuildSubtree(int nodeIndex, int depth, int maxDepth);
+	static void UploadDirtyNodes();
 
 	static Vector4 ColorToVector4(Color color);
 
+	static RenderTexture2D LoadFloatRenderTexture(int width, int height);
+	// everything sized by the context's resolution
+	static void LoadRenderTargets(RenderContext* context);
+	static void LoadRasterTarget();
+	static void LoadPrimaryCache();
+	static void UnloadRenderTargets(RenderContext* context);
+	// host side of the scene, the arena included
+	static void ClearSceneData();
+	// everything the render targets of a context take up on the GPU
+	static long long GetRenderTargetBytes(RenderContext* context);
+	// measures the host containers and the raylib models, GPU objects are counted where they are loaded
+	static void UpdateMemoryUsage();
+	// new settings and no history for the active context
+	static void RestartView(int maxBounces, int raysPerPixel, float blur);
+
+	// every view, the one being rendered is activeContext
+	inline static std::vector<std::unique_ptr<RenderContext>> contexts;
+	inline static RenderContext* activeContext = nullptr;
+
+	// the active context's uniforms of the frame it is tracing
+	static void UploadFrameUniforms();
+	// every context's history was traced from something that is gone
+	static void RestartContexts();
+	// moves on to the other accumulation target and traces the region into it
+	static void DrawTracingPass(Rectangle region);
+	// traces part of the region into the current target, history comes from the other one
+	static void DrawTracingBand(Rectangle band);
+	// the next band of a sliced frame, true once it finished the frame
+	static bool DrawTracingSlice(Rectangle region);
+	// drops the bands traced so far and goes back to the last finished frame
+	static void AbandonSlice();
+	static AccumulationTarget LoadAccumulationTarget(int width, int height);
+	static Texture2D AttachGBufferTexture(RenderTexture2D target, int attachment);
+	static Texture2D ApplyFilter();
+	static Texture2D Upscale(Texture2D input);
+	static void UpdateQuality();
+	static Rectangle GetRenderRegion();
+	static void ProjectFocusRegions(Camera* camera, Vector3 cameraDirection);
+	// every mesh comes from a raylib model the raster can draw, scenes loaded compiled have none
+	static bool RasterCoversScene();
+	static void DrawPrimaryRaster(Camera* camera, Vector3 cameraDirection);
+	// records the cache on the first frame of a still camera and reads it on the ones after
+	static void UpdatePrimaryCache(bool moved);
+
+	static ShaderVariant GetSceneVariant();
+	static std::string GetVariantDefines(const ShaderVariant& variant);
+	static std::string GetTracingSource(const ShaderVariant& variant);
+	static Shader LoadTracingShader(const ShaderVariant& variant);
+	// loads the plain and stats programs of a variant, replacing the current ones
+	static void LoadTracingShaders(const ShaderVariant& variant);
+	// takes ownership of both, the old pair is unloaded
+	static void SetTracingShaders(Shader plain, Shader stats);
+	// reloads the programs when the uploaded scene needs a different variant
+	static void SelectShaderVariant();
+	static void RefreshTracingShader();
+	static void ResolveTracingParams(Shader shader, TracingParams* params);
+	static void ResolvePostParams();
+	static void ResolveUpscaleParams();
+	static void PollShaderReload();
+	// takes ownership of the program, the old one is unloaded
+	static void SetRasterShader(Shader shader);
+	static void ApplyShaderBuild(ShaderBuild& build);
+	static void UploadShaderConstants();
+	static void SwapTracingShader();
+	static void ReadTraversalStats();
+
 	static void GenerateBVHS();
+	// builds every mesh with GpuBVHBuilder and reads the result back into the host copy
+	static void BuildGpuBVHS();
 
 	static void UploadSpheres();
 	static void UploadGravityBodies();
 	static void UploadMeshes();
 	static void UploadTriangles();
+	static void UploadNodes();
 
-	static void UploadSky();
+	static void UploadSky(Shader shader);
 	static void UploadSSBOS();
+	static void BindSSBOS();
 
 	inline static std::vector<Model> models;
 	inline static std::vector<RaytracingMesh> meshes;
 	inline static std::vector<Triangle> triangles;
+	inline static std::vector<int> triangleSourceIndices;
 
 public:
 	inline static std::vector<GravityBody> gravityBodies;
+	inline static std::vector<FocusRegion> focusRegions;
 	inline static std::vector<Sphere> spheres;
 
 	inline static bool debug = false;
-	inline static bool denoise = false;
-	inline static bool pause = false;
+
+	// heatmaps switch to the instrumented shader variant, ranges are counts per camera sample mapped to full red
+	inline static int heatmap = HEATMAP_NONE;
+	inline static float heatmapRanges[4] = { 1, 128, 256, 64 };
+	inline static TraversalStats traversalStats;
 
 	inline static SkyMaterial skyMaterial;
+	// escaped rays read the sky baked by EnvironmentMap and diffuse bounces sample the sun and sky directly,
+	// off evaluates the sky analytically on every miss, both converge to the same image
+	inline static bool environmentSampling = true;
 
-	static void Initialize(Vector2 resolution, int maxBounces, int raysPerPixel, float blur);
+	// primary rays start from the first surface rasterized from the models instead of traversing the BVHs,
+	// pixels whose rays are bent by gravity bodies are traced in full
+	inline static bool hybridFirstHit = false;
+
+	// with a still camera only the first frame bends and traces the primary rays, the frames accumulated after it
+	// start from that frame's hits and only pay for the bounces
+	inline static bool primaryCache = false;
+
+	// a refit subtree is rebuilt once its SAH cost grows past this factor of the cost it was built with
+	inline static float bvhRebuildThreshold = 1.5f;
+	inline static int bvhRebuildDepth = 3;
+	inline static int lastRefitUploadedNodes = 0;
+	inline static int lastRefitRebuiltSubtrees = 0;
 
-	static void UploadRaylibModel(Model model, RaytracingMaterial material, bool indexed, int bvhDepth);
+	// picked before UploadStaticData, see BVHBuilder
+	inline static int bvhBuilder = BVH_BUILDER_CPU;
+
+	inline static double lastBVHBuildMs = 0;
+	// GPU builds only, copying the hierarchy and triangle order back to the host
+	inline static double lastBVHReadbackMs = 0;
+	inline static double lastUploadMs = 0;
+	inline static double lastSceneResetMs = 0;
+
+	static void Initialize(Vector2 resolution, int maxBounces, int raysPerPixel, float blur);
+	// drops the scene so the next one can be uploaded without Unload and Initialize, geometry buffers go back
+	// to ShaderBufferPool, the host arrays keep their capacity and the render targets are kept at the same resolution.
+	// models are only forgotten, whoever loaded them unloads them
+	static void ResetScene(Vector2 resolution, int maxBounces, int raysPerPixel, float blur);
+
+	// a view with its own targets and camera history, starting from the active one's settings, and made active.
+	// Initialize creates the first one, the engine owns them all
+	static RenderContext* CreateContext(Vector2 resolution, int maxBounces, int raysPerPixel, float blur);
+	// everything up to the next UseContext renders into and is configured for this context, a sliced frame
+	// or wavefront accumulation of the context carries on where it left off
+	static void UseContext(RenderContext* context);
+	static RenderContext* GetContext() { return activeContext; }
+	// any but the active one
+	static void DestroyContext(RenderContext* context);
+
+	static int UploadRaylibModel(Model model, RaytracingMaterial material, bool indexed, int bvhDepth);
+	static void DeformRaylibModel(int firstMeshIndex, Model model, bool indexed);
 	static void UploadStaticData();
+	static void UploadCompiledData();
 	static void UploadData(Camera* camera);
-	static void Render(Camera* camera);
+	// replaces skyMaterial after the scene was uploaded and restarts accumulation
+	static void SetSky(SkyMaterial sky);
+	// moves, adds or removes gravity bodies after the scene was uploaded
+	static void SetGravityBodies(const std::vector<GravityBody>& bodies);
+	// false while a sliced frame is still being traced and the last finished one is shown again
+	static bool Render(Camera* camera);
+	// offline accumulation of a sub-rectangle without presenting, region is in image space with a top left origin
+	static void RenderRegion(Camera* camera, Rectangle region, int frames);
+	// linear rgb floats of the accumulated region, rows top to bottom
+	static void ReadRegion(Rectangle region, float* rgb);
 	static void DrawDebugBounds(PaddedBoundingBox* box, Color color);
 	static void DrawDebug(Camera* camera);
+	static void CycleDebugView();
+	static void CycleSampler();
+	static void ToggleFoveation();
+	// watches the shader sources and swaps in rebuilt programs without reloading the scene
+	static void EnableHotReload();
+
+	static Image CaptureFrame(bool filtered = false);
+	static Vector2 GetResolution() { return activeContext->resolution; }
+	static int GetRaysPerPixel() { return activeContext->raysPerPixel; }
+	static float GetRenderScale() { return activeContext->renderScale; }
+	// finished accumulation frames since the last restart, a sliced frame counts once its last band is traced
+	static int GetAccumulatedFrames() { return std::max(activeContext->numRenderedFrames - (activeContext->sliceRow > 0 ? 1 : 0), 0); }
+	static Texture2D GetPresentedTexture() { return activeContext->presentedTexture; }
+	// fraction of the full sample rate a pixel gets, pixel in image space with a top left origin
+	static float GetSampleRate(Vector2 pixel);
+	// rays per frame the current foveation settings trace over the whole image, on average
+	static double GetExpectedRays();
+	static int GetTriangleCount() { return (int)triangles.size(); }
 
 	static void Unload();
 };
\ No newline at end of file
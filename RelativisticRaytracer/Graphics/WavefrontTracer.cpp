@@ -0,0 +1,362 @@
+#include "WavefrontTracer.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <rlgl.h>
+#include <raymath.h>
+#include <external/glad.h>
+
+#include "TracingEngine.h"
+#include "ShaderCache.h"
+#include "Profiler.h"
+#include "EnvironmentMap.h"
+#include "MemoryTracker.h"
+
+// texture units the blue noise and the baked sky sit on, past the ones raylib's batches use
+#define WAVEFRONT_BLUE_NOISE_UNIT 8
+#define WAVEFRONT_ENVIRONMENT_UNIT 9
+
+// for the log, in the order of GetPasses
+static const char* passNames[] = { "primary", "trace", "trace with cache stats", "resolve", "bin histogram", "bin scan", "bin scatter" };
+
+std::vector<Shader*> WavefrontTracer::GetPasses()
+{
+	return { &primaryShader, &traceShader, &traceStatsShader, &resolveShader,
+		&binShaders[BIN_HISTOGRAM], &binShaders[BIN_SCAN], &binShaders[BIN_SCATTER] };
+}
+
+std::vector<std::string> WavefrontTracer::GetPassSources(const std::string& defines)
+{
+	std::string primary = ShaderCache::LoadSource("resources/shaders/wavefront_primary.comp");
+	std::string trace = ShaderCache::LoadSource("resources/shaders/wavefront_trace.comp");
+	std::string resolve = ShaderCache::LoadSource("resources/shaders/wavefront_resolve.comp");
+	std::string bin = ShaderCache::LoadSource("resources/shaders/wavefront_bin.comp");
+
+	return {
+		ShaderCache::InsertDefines(primary, defines),
+		ShaderCache::InsertDefines(trace, defines),
+		ShaderCache::InsertDefines(trace, defines + "#define NODE_CACHE_STATS\n"),
+		ShaderCache::InsertDefines(resolve, ""),
+		ShaderCache::InsertDefines(bin, "#define BIN_HISTOGRAM\n"),
+		ShaderCache::InsertDefines(bin, "#define BIN_SCAN\n"),
+		ShaderCache::InsertDefines(bin, "#define BIN_SCATTER\n")
+	};
+}
+
+unsigned int WavefrontTracer::LoadComputeProgram(const std::string& source, int pass)
+{
+	unsigned int shader = rlCompileShader(source.c_str(), RL_COMPUTE_SHADER);
+
+	if (shader == 0)
+	{
+		TraceLog(LOG_ERROR, "TRACING: Wavefront %s pass failed to compile", passNames[pass]);
+		return 0;
+	}
+
+	unsigned int program = rlLoadComputeShaderProgram(shader);
+	glDeleteShader(shader);
+
+	if (program == 0)
+	{
+		TraceLog(LOG_ERROR, "TRACING: Wavefront %s pass failed to link", passNames[pass]);
+	}
+
+	return program;
+}
+
+bool WavefrontTracer::LoadPrograms()
+{
+	const std::string& defines = TracingEngine::activeVariantDefines;
+	std::vector<std::string> sources = GetPassSources(defines);
+	std::vector<unsigned int> programs;
+
+	for (int i = 0; i < (int)sources.size(); i++)
+	{
+		unsigned int program = LoadComputeProgram(sources[i], i);
+
+		if (program == 0)
+		{
+			for (unsigned int built : programs)
+			{
+				rlUnloadShaderProgram(built);
+			}
+
+			// the running passes were built for another variant, there is nothing to fall back to
+			TraceLog(LOG_ERROR, "TRACING: Wavefront passes failed to build, the wavefront tracer is turned off");
+			UnloadPrograms();
+			return false;
+		}
+
+		programs.push_back(program);
+	}
+
+	SetPrograms(programs, defines);
+	return true;
+}
+
+void WavefrontTracer::SetPrograms(const std::vector<unsigned int>& programs, const std::string& defines)
+{
+	UnloadPrograms();
+
+	std::vector<Shader*> passes = GetPasses();
+
+	for (int i = 0; i < (int)passes.size(); i++)
+	{
+		*passes[i] = ShaderCache::FromProgram(programs[i]);
+	}
+
+	loadedDefines = defines;
+	loaded = true;
+
+	// what the views accumulated came from the old programs
+	for (std::unique_ptr<RenderContext>& context : TracingEngine::contexts)
+	{
+		Restart(&context->wavefront);
+	}
+}
+
+void WavefrontTracer::UnloadPrograms()
+{
+	for (Shader* program : GetPasses())
+	{
+		if (program->id != 0)
+		{
+			UnloadShader(*program);
+		}
+
+		*program = Shader{ 0 };
+	}
+
+	loaded = false;
+}
+
+void WavefrontTracer::LoadBuffers(unsigned int pixels)
+{
+	UnloadBuffers();
+
+	raysSSBO = rlLoadShaderBuffer(pixels * sizeof(WavefrontRay), NULL, RL_DYNAMIC_COPY);
+	binnedRaysSSBO = rlLoadShaderBuffer(pixels * sizeof(WavefrontRay), NULL, RL_DYNAMIC_COPY);
+	binsSSBO = rlLoadShaderBuffer(2 * WAVEFRONT_BINS * sizeof(unsigned int), NULL, RL_DYNAMIC_COPY);
+	countersSSBO = rlLoadShaderBuffer(sizeof(WavefrontCounters), NULL, RL_DYNAMIC_COPY);
+	radianceSSBO = rlLoadShaderBuffer(pixels * sizeof(Vector4), NULL, RL_DYNAMIC_COPY);
+
+	long long rayBytes = (long long)pixels * (2 * sizeof(WavefrontRay) + sizeof(Vector4));
+	MemoryTracker::Set(MEMORY_GPU_WAVEFRONT, rayBytes + 2 * WAVEFRONT_BINS * sizeof(unsigned int) + sizeof(WavefrontCounters));
+
+	bufferPixels = pixels;
+}
+
+void WavefrontTracer::UnloadBuffers()
+{
+	int* buffers[] = { &raysSSBO, &binnedRaysSSBO, &binsSSBO, &countersSSBO, &radianceSSBO };
+
+	for (int* buffer : buffers)
+	{
+		if (*buffer != 0)
+		{
+			rlUnloadShaderBuffer(*buffer);
+			*buffer = 0;
+		}
+	}
+
+	MemoryTracker::Set(MEMORY_GPU_WAVEFRONT, 0);
+}
+
+void WavefrontTracer::SetSceneUniforms(Shader shader, Camera* camera)
+{
+	Vector2 resolution = TracingEngine::activeContext->resolution;
+	Vector2 screenCenter = Vector2(resolution.x / 2.0f, resolution.y / 2.0f);
+	float camDist = 1.0f / (tanf(camera->fovy * 0.5f * DEG2RAD));
+	Vector3 camDir = Vector3Scale(Vector3Normalize(Vector3Subtract(camera->target, camera->position)), camDist);
+	int numGravityBodies = (int)std::min(TracingEngine::gravityBodies.size(), std::size(TracingEngine::gravityBodyBuffer.gravityBodies));
+	int blueNoiseUnit = WAVEFRONT_BLUE_NOISE_UNIT;
+	int environmentUnit = WAVEFRONT_ENVIRONMENT_UNIT;
+
+	SetShaderValue(shader, GetShaderLocation(shader, "resolution"), &resolution, SHADER_UNIFORM_VEC2);
+	SetShaderValue(shader, GetShaderLocation(shader, "screenCenter"), &screenCenter, SHADER_UNIFORM_VEC2);
+	SetShaderValue(shader, GetShaderLocation(shader, "cameraPosition"), &camera->position, SHADER_UNIFORM_VEC3);
+	SetShaderValue(shader, GetShaderLocation(shader, "cameraDirection"), &camDir, SHADER_UNIFORM_VEC3);
+	SetShaderValue(shader, GetShaderLocation(shader, "blur"), &TracingEngine::activeContext->blur, SHADER_UNIFORM_FLOAT);
+	SetShaderValue(shader, GetShaderLocation(shader, "numGravityBodies"), &numGravityBodies, SHADER_UNIFORM_INT);
+	SetShaderValue(shader, GetShaderLocation(shader, "sphereRootNode"), &TracingEngine::sphereRootNode, SHADER_UNIFORM_INT);
+	SetShaderValue(shader, GetShaderLocation(shader, "samplerType"), &TracingEngine::activeContext->samplerType, SHADER_UNIFORM_INT);
+	SetShaderValue(shader, GetShaderLocation(shader, "frameIndex"), &TracingEngine::activeContext->frameIndex, SHADER_UNIFORM_INT);
+	SetShaderValue(shader, GetShaderLocation(shader, "sampleOffset"), &sampleIndex, SHADER_UNIFORM_INT);
+	SetShaderValue(shader, GetShaderLocation(shader, "maxBounces"), &TracingEngine::activeContext->activeBounces, SHADER_UNIFORM_INT);
+	SetShaderValue(shader, GetShaderLocation(shader, "blueNoise"), &blueNoiseUnit, SHADER_UNIFORM_INT);
+	SetShaderValue(shader, GetShaderLocation(shader, "environmentMap"), &environmentUnit, SHADER_UNIFORM_INT);
+	SetShaderValueV(shader, GetShaderLocation(shader, "sobolDirections"), TracingEngine::sobolDirections.data(), SHADER_UNIFORM_INT, (int)TracingEngine::sobolDirections.size());
+	TracingEngine::UploadSky(shader);
+}
+
+void WavefrontTracer::GetSceneBounds(Vector3* min, Vector3* max)
+{
+	*min = Vector3(FLT_MAX, FLT_MAX, FLT_MAX);
+	*max = Vector3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+
+	// the root nodes cover everything a secondary ray can start from
+	for (const RaytracingMesh& mesh : TracingEngine::meshes)
+	{
+		*min = Vector3Min(*min, Vector3(mesh.boundingMin.x, mesh.boundingMin.y, mesh.boundingMin.z));
+		*max = Vector3Max(*max, Vector3(mesh.boundingMax.x, mesh.boundingMax.y, mesh.boundingMax.z));
+	}
+
+	if (TracingEngine::sphereRootNode >= 0)
+	{
+		const Node& root = TracingEngine::nodes[TracingEngine::sphereRootNode];
+		*min = Vector3Min(*min, root.bounds.min);
+		*max = Vector3Max(*max, root.bounds.max);
+	}
+
+	if (min->x > max->x)
+	{
+		*min = Vector3Zero();
+		*max = Vector3One();
+	}
+}
+
+void WavefrontTracer::Dispatch(Shader shader, unsigned int groupsX, unsigned int groupsY)
+{
+	rlEnableShader(shader.id);
+	rlComputeShaderDispatch(groupsX, groupsY, 1);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+}
+
+Texture2D WavefrontTracer::Render(Camera* camera)
+{
+	RenderContext* context = TracingEngine::activeContext;
+	WavefrontView* view = &context->wavefront;
+
+	if (!loaded || loadedDefines != TracingEngine::activeVariantDefines)
+	{
+		if (!LoadPrograms())
+		{
+			enabled = false;
+			return context->accumulationTargets[context->currentTarget].color.texture;
+		}
+	}
+
+	Vector2 resolution = context->resolution;
+	unsigned int width = (unsigned int)resolution.x;
+	unsigned int height = (unsigned int)resolution.y;
+	unsigned int pixelGroups = (width * height + 255) / 256;
+
+	if (width * height > bufferPixels)
+	{
+		LoadBuffers(width * height);
+	}
+
+	if (view->accumulation.id == 0)
+	{
+		// unloaded and counted with the context's other targets
+		view->accumulation = TracingEngine::LoadFloatRenderTexture((int)width, (int)height);
+		view->accumulatedFrames = 0;
+		MemoryTracker::Add(MEMORY_GPU_RENDER_TARGETS, MemoryTracker::RenderTextureBytes(view->accumulation));
+	}
+
+	if (context->pause && view->accumulatedFrames > 0)
+	{
+		return view->accumulation.texture;
+	}
+
+	// without denoise every frame starts over on fresh samples, like the fragment tracer
+	if (camera->position != view->lastCameraPosition || camera->target != view->lastCameraTarget || !context->denoise)
+	{
+		view->accumulatedFrames = 0;
+	}
+
+	sampleIndex = context->denoise ? view->accumulatedFrames : context->frameIndex;
+
+	view->lastCameraPosition = camera->position;
+	view->lastCameraTarget = camera->target;
+
+	// whatever raylib batched still has to run before the passes
+	rlDrawRenderBatchActive();
+
+	WavefrontCounters counters = {};
+	rlUpdateShaderBuffer(countersSSBO, &counters, sizeof(counters), 0);
+
+	rlBindShaderBuffer(countersSSBO, 5);
+	rlBindShaderBuffer(raysSSBO, 6);
+	rlBindShaderBuffer(binnedRaysSSBO, 7);
+	rlBindShaderBuffer(binsSSBO, 8);
+	rlBindShaderBuffer(radianceSSBO, 9);
+
+	glActiveTexture(GL_TEXTURE0 + WAVEFRONT_BLUE_NOISE_UNIT);
+	glBindTexture(GL_TEXTURE_2D, TracingEngine::blueNoiseTexture.id);
+	glActiveTexture(GL_TEXTURE0 + WAVEFRONT_ENVIRONMENT_UNIT);
+	glBindTexture(GL_TEXTURE_2D, EnvironmentMap::GetTexture().id);
+	glActiveTexture(GL_TEXTURE0);
+
+	Profiler::BeginGpuStage("wavefront primary");
+	SetSceneUniforms(primaryShader, camera);
+	Dispatch(primaryShader, (width + 7) / 8, (height + 7) / 8);
+	Profiler::EndGpuStage();
+
+	if (binning)
+	{
+		Vector3 sceneMin, sceneMax;
+		GetSceneBounds(&sceneMin, &sceneMax);
+
+		Profiler::BeginGpuStage("binning");
+		Shader histogram = binShaders[BIN_HISTOGRAM];
+		SetShaderValue(histogram, GetShaderLocation(histogram, "sceneMin"), &sceneMin, SHADER_UNIFORM_VEC3);
+		SetShaderValue(histogram, GetShaderLocation(histogram, "sceneMax"), &sceneMax, SHADER_UNIFORM_VEC3);
+
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, binsSSBO);
+		glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+		Dispatch(histogram, pixelGroups, 1);
+		Dispatch(binShaders[BIN_SCAN], 1, 1);
+		Dispatch(binShaders[BIN_SCATTER], pixelGroups, 1);
+		Profiler::EndGpuStage();
+	}
+	else
+	{
+		// trace straight from the primary pass's order
+		rlBindShaderBuffer(raysSSBO, 7);
+	}
+
+	Shader trace = cacheStats ? traceStatsShader : traceShader;
+
+	Profiler::BeginGpuStage("wavefront trace");
+	SetSceneUniforms(trace, camera);
+	Dispatch(trace, (width * height + 63) / 64, 1);
+	Profiler::EndGpuStage();
+
+	Profiler::BeginGpuStage("wavefront resolve");
+	SetShaderValue(resolveShader, GetShaderLocation(resolveShader, "resolution"), &resolution, SHADER_UNIFORM_VEC2);
+	SetShaderValue(resolveShader, GetShaderLocation(resolveShader, "accumulatedFrames"), &view->accumulatedFrames, SHADER_UNIFORM_INT);
+	rlBindImageTexture(view->accumulation.texture.id, 0, PIXELFORMAT_UNCOMPRESSED_R32G32B32A32, false);
+	rlEnableShader(resolveShader.id);
+	rlComputeShaderDispatch((width + 7) / 8, (height + 7) / 8, 1);
+	glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT | GL_FRAMEBUFFER_BARRIER_BIT);
+	Profiler::EndGpuStage();
+
+	rlDisableShader();
+
+	// the fragment tracer's stats buffer lives on 5
+	rlBindShaderBuffer(TracingEngine::traversalStatsSSBO, 5);
+
+	view->accumulatedFrames++;
+	stats.frames++;
+
+	if (cacheStats)
+	{
+		// a synchronous read, the numbers are for measuring and not for the live view
+		rlReadShaderBuffer(countersSSBO, &counters, sizeof(counters), 0);
+		stats.rays += counters.rayCount;
+		stats.nodeFetches += counters.nodeFetches;
+		stats.nodeCacheHits += counters.nodeCacheHits;
+	}
+
+	return view->accumulation.texture;
+}
+
+void WavefrontTracer::Unload()
+{
+	UnloadPrograms();
+	UnloadBuffers();
+	bufferPixels = 0;
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <raylib.h>
+
+// direction cells times origin cells, see binKey in wavefront_bin.comp
+#define WAVEFRONT_BINS 32768
+
+// std430 layout of WavefrontRay in wavefront_common.glsl
+struct WavefrontRay
+{
+	Vector3 origin;
+	unsigned int pixel;
+	Vector3 direction;
+	unsigned int key;
+	Vector3 throughput;
+	unsigned int sampleIndex;
+	unsigned int dimension;
+	unsigned int pcgState;
+	unsigned int padding[2];
+};
+
+struct WavefrontCounters
+{
+	unsigned int rayCount;
+	unsigned int nodeFetches;
+	unsigned int nodeCacheHits;
+	unsigned int padding;
+};
+
+// summed over the frames since ResetStats, node counts are only gathered with cacheStats on
+struct WavefrontStats
+{
+	int frames;
+	unsigned long long rays;
+	unsigned long long nodeFetches;
+	unsigned long long nodeCacheHits;
+};
+
+// the running mean of one render context, its target is loaded on the first frame the context traces
+struct WavefrontView
+{
+	RenderTexture2D accumulation = { 0 };
+	int accumulatedFrames = 0;
+	Vector3 lastCameraPosition = {};
+	Vector3 lastCameraTarget = {};
+};
+
+// traces in compute passes instead of the fragment shader, the camera rays first, then the
+// secondary rays they queue, optionally sorted by direction and origin so the invocations of a
+// workgroup walk the same BVH nodes. one sample per pixel into a running mean that restarts when
+// the camera moves, no reprojection, filter or foveation. scene buffers stay on bindings 0 to 4,
+// the counters take 5 while it runs, the rays 6 and 7, bins 8 and radiance 9
+class WavefrontTracer
+{
+private:
+	enum BinStage
+	{
+		BIN_HISTOGRAM,
+		BIN_SCAN,
+		BIN_SCATTER,
+		BIN_STAGE_COUNT
+	};
+
+	inline static Shader primaryShader;
+	inline static Shader binShaders[BIN_STAGE_COUNT];
+	inline static Shader traceShader;
+	inline static Shader traceStatsShader;
+	inline static Shader resolveShader;
+	// variant defines the programs were built with, they follow the fragment tracer's
+	inline static std::string loadedDefines;
+	inline static bool loaded = false;
+
+	inline static int raysSSBO = 0;
+	inline static int binnedRaysSSBO = 0;
+	inline static int binsSSBO = 0;
+	inline static int countersSSBO = 0;
+	inline static int radianceSSBO = 0;
+	// the ray and radiance buffers are shared by every context, sized to the largest one traced so far
+	inline static unsigned int bufferPixels = 0;
+
+	inline static int sampleIndex = 0;
+	inline static WavefrontStats stats;
+
+	// every pass's program, in the order of GetPassSources
+	static std::vector<Shader*> GetPasses();
+	static std::vector<std::string> GetPassSources(const std::string& defines);
+	static unsigned int LoadComputeProgram(const std::string& source, int pass);
+	static bool LoadPrograms();
+	static void UnloadPrograms();
+	static void LoadBuffers(unsigned int pixels);
+	static void UnloadBuffers();
+	static void SetSceneUniforms(Shader shader, Camera* camera);
+	static void GetSceneBounds(Vector3* min, Vector3* max);
+	static void Dispatch(Shader shader, unsigned int groupsX, unsigned int groupsY);
+
+public:
+	inline static bool enabled = false;
+	// sorts the queued rays by direction and origin before tracing them
+	inline static bool binning = true;
+	// runs the trace pass with the node cache simulation and reads the counters back every frame
+	inline static bool cacheStats = false;
+
+	// traces one frame of the active render context and returns its accumulated image, float rgba at its resolution
+	static Texture2D Render(Camera* camera);
+
+	// the next frame starts a new running mean, for when the scene changes under an unmoved camera
+	static void Restart(WavefrontView* view) { view->accumulatedFrames = 0; }
+	static void ResetStats() { stats = {}; }
+	static WavefrontStats GetStats() { return stats; }
+	// the sources of the running passes, to rebuild them off the main thread, none before the first frame
+	static std::vector<std::string> GetReloadSources() { return loaded ? GetPassSources(loadedDefines) : std::vector<std::string>(); }
+	static const std::string& GetLoadedDefines() { return loadedDefines; }
+	// takes ownership of programs built from GetReloadSources, the old ones are unloaded
+	static void SetPrograms(const std::vector<unsigned int>& programs, const std::string& defines);
+
+	static void Unload();
+};
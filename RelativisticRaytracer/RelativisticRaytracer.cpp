@@ -3,52 +3,180 @@
 
 #include "RelativisticRaytracer.h"
 #include "Graphics/TracingEngine.h"
+#include "Graphics/Profiler.h"
+#include "Graphics/SceneFile.h"
+#include "Graphics/DistributedRenderer.h"
+#include "Graphics/FrameWriter.h"
+#include "Graphics/WavefrontTracer.h"
 
 #include <raymath.h>
 #include <raylib.h>
 
+#include <cstring>
+#include <cstdio>
+#include <cstdarg>
+#include <algorithm>
+#include <chrono>
+
 using namespace std;
 
-int main()
+// workers stream tiles over stdout, so their log has to go elsewhere
+static void TraceLogToStderr(int logLevel, const char* text, va_list args)
+{
+	vfprintf(stderr, text, args);
+	fputc('\n', stderr);
+}
+
+static int RunDistributed(const char* executable, const char* scenePath, const SceneSettings& settings, int maxWorkers, bool scaling, int frames, int tileSize, const char* outputPath)
+{
+	std::vector<float> image;
+	double singleWorkerMs = 0;
+
+	// a scaling run doubles the worker count up to the maximum so speedup can be read off against one worker
+	for (int numWorkers = scaling ? 1 : maxWorkers; numWorkers <= maxWorkers; numWorkers = numWorkers < maxWorkers ? std::min(numWorkers * 2, maxWorkers) : numWorkers + 1)
+	{
+		std::string command = TextFormat("\"%s\" \"%s\" --worker --workers %i --frames %i --tile %i", executable, scenePath, numWorkers, frames, tileSize);
+		DistributedResult result;
+
+		if (!DistributedRenderer::RunCoordinator(command, settings.width, settings.height, numWorkers, &image, &result))
+		{
+			return 1;
+		}
+
+		if (numWorkers == 1) singleWorkerMs = result.wallMs;
+
+		if (singleWorkerMs > 0)
+		{
+			double speedup = singleWorkerMs / result.wallMs;
+			TraceLog(LOG_INFO, "DISTRIBUTED: %i workers, %.2fx speedup, %.0f%% scaling efficiency", numWorkers, speedup, speedup / numWorkers * 100);
+		}
+	}
+
+	Image output = DistributedRenderer::ToImage(image, settings.width, settings.height);
+	bool exported = ExportImage(output, outputPath);
+	UnloadImage(output);
+
+	return exported ? 0 : 1;
+}
+
+int main(int argc, char** argv)
 {
-	InitWindow(2048, 1024, "raylib raytracer");
+	const char* scenePath = "resources/scenes/relativistic.scene";
+	const char* compilePath = nullptr;
+	const char* outputPath = "render.png";
+	const char* sequencePattern = nullptr;
+
+	int distributeWorkers = 0;
+	bool scaling = false;
+	bool worker = false;
+	int workerIndex = 0;
+	int numWorkers = 1;
+	int frames = 64;
+	int tileSize = 256;
+	float targetFrameMs = 0;
+	bool timeSlicing = false;
+	bool hybridFirstHit = false;
+	bool primaryCache = false;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--compile") == 0 && i + 1 < argc) compilePath = argv[++i];
+		else if (strcmp(argv[i], "--distribute") == 0 && i + 1 < argc) distributeWorkers = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--scaling") == 0) scaling = true;
+		else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) outputPath = argv[++i];
+		else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) frames = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--tile") == 0 && i + 1 < argc) tileSize = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--target-ms") == 0 && i + 1 < argc) targetFrameMs = (float)atof(argv[++i]);
+		else if (strcmp(argv[i], "--time-slice") == 0) timeSlicing = true;
+		else if (strcmp(argv[i], "--hybrid") == 0) hybridFirstHit = true;
+		else if (strcmp(argv[i], "--primary-cache") == 0) primaryCache = true;
+		else if (strcmp(argv[i], "--sequence") == 0 && i + 1 < argc) sequencePattern = argv[++i];
+		else if (strcmp(argv[i], "--worker") == 0) worker = true;
+		else if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc) numWorkers = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--worker-index") == 0 && i + 1 < argc) workerIndex = atoi(argv[++i]);
+		else scenePath = argv[i];
+	}
+
+	if (worker) SetTraceLogCallback(TraceLogToStderr);
+
+	// raylib's clock only starts with the window
+	auto startTime = std::chrono::steady_clock::now();
+
+	// the window size comes from the scene, so the settings are read before anything is created
+	bool compiled = SceneFile::IsCompiled(scenePath);
+	SceneDescription scene;
+	CompiledSceneHeader header;
+
+	if (compiled ? !SceneFile::ReadCompiledHeader(scenePath, &header) : !SceneFile::LoadDescription(scenePath, &scene))
+	{
+		return 1;
+	}
+
+	SceneSettings settings = compiled ? header.settings : scene.settings;
+
+	if (distributeWorkers > 0)
+	{
+		return RunDistributed(argv[0], scenePath, settings, distributeWorkers, scaling, frames, tileSize, outputPath);
+	}
+
+	if (compilePath != nullptr || worker) SetConfigFlags(FLAG_WINDOW_HIDDEN);
+
+	InitWindow(settings.width, settings.height, "raylib raytracer");
 	SetTargetFPS(80);
 
 	float deltaTime = 0;
 
-	Camera camera = Camera();
-	camera.position = Vector3(15, 8, 15);
-	camera.target = Vector3(0, 0.5f, 0);
-	camera.up = Vector3(0, 1, 0);
-	camera.fovy = 45;
+	Camera camera = settings.camera;
 	camera.projection = CAMERA_PERSPECTIVE;
 
-	DisableCursor();
+	TracingEngine::Initialize(Vector2(settings.width, settings.height), settings.maxBounces, settings.raysPerPixel, settings.blur);
 
-	TracingEngine::Initialize(Vector2(2048, 1024), 7, 10, 0.001f);
+	std::vector<Model> models;
 
-	TracingEngine::skyMaterial = SkyMaterial{ DARKGRAY, DARKGRAY, DARKGRAY, DARKGRAY, Vector3(-0.5f, -1, -0.5f), 1, 0.5 };
+	if (compiled)
+	{
+		// the header was fine but the rest is corrupt or truncated, SceneFile logged why
+		if (!SceneFile::LoadCompiled(scenePath))
+		{
+			TracingEngine::Unload();
+			CloseWindow();
+
+			return 1;
+		}
+	}
+	else SceneFile::Build(scene, &models);
 
-	RaytracingMaterial red = { Vector4(1,1,1,1), Vector4(1,0,0,10), Vector4(0,0,0,0) };
-	RaytracingMaterial red2 = { Vector4(1,0.6f,0.6f,0), Vector4(0,0,0,0), Vector4(0,0,0,0) };
-	RaytracingMaterial green = { Vector4(1,1,1,1), Vector4(0,0,1,10), Vector4(0,0,0,0) };
-	RaytracingMaterial blue = { Vector4(1,1,1,1), Vector4(0,1,0,10), Vector4(0,0,0,0) };
-	RaytracingMaterial white = { Vector4(1,1,1,1), Vector4(0,0,0,0), Vector4(0,0,0,0) };
-	RaytracingMaterial grey = { Vector4(0.5f,0.5f,0.5f,1), Vector4(0,0,0,0), Vector4(0,0,0,0) };
-	RaytracingMaterial light = { Vector4(1,0.6f,0.6f,1), Vector4(1,0.8,0.6,1.5), Vector4(0,0,0,0) };
-	RaytracingMaterial metal = { Vector4(1,1,1,1), Vector4(0,0,0,0), Vector4(0,1,0,0) };
+	if (worker)
+	{
+		bool ok = DistributedRenderer::RunWorker(&camera, frames, tileSize, workerIndex, numWorkers, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count(), stdout);
 
-	TracingEngine::gravityBodies.push_back({ {0,5,0,10} });
+		for (Model& model : models) UnloadModel(model);
+		TracingEngine::Unload();
+		CloseWindow();
 
-	Model model = LoadModel("resources/meshes/monkey.obj");
-	model.transform = MatrixTranslate(0, 3, 0);
-	TracingEngine::UploadRaylibModel(model, red2, false, 8);
+		return ok ? 0 : 1;
+	}
+
+	if (compilePath != nullptr)
+	{
+		bool saved = SceneFile::SaveCompiled(compilePath, settings);
+
+		for (Model& model : models) UnloadModel(model);
+		TracingEngine::Unload();
+		CloseWindow();
+
+		return saved ? 0 : 1;
+	}
+
+	TracingEngine::GetContext()->targetFrameMs = targetFrameMs;
+	TracingEngine::GetContext()->timeSlicing = timeSlicing;
+	TracingEngine::hybridFirstHit = hybridFirstHit;
+	TracingEngine::primaryCache = primaryCache;
+	TracingEngine::EnableHotReload();
 
-	Model ring = LoadModelFromMesh(GenMeshTorus(1, 4.0f, 16, 32));
-	ring.transform = MatrixScale(1, 1, 0.1f) * MatrixRotateX(PI / 2) * MatrixTranslate(0, 5, 0);
-	TracingEngine::UploadRaylibModel(ring, light, false, 10);
+	if (sequencePattern != nullptr) FrameWriter::Begin(sequencePattern, settings.width, settings.height);
 
-	TracingEngine::UploadStaticData();
+	DisableCursor();
 
 	while (!WindowShouldClose())
 	{
@@ -57,17 +185,29 @@ int main()
 
 		TracingEngine::UploadData(&camera);
 
-		if (IsKeyPressed(KEY_ONE)) TracingEngine::debug = !TracingEngine::debug;
-		if (IsKeyPressed(KEY_R)) TracingEngine::denoise = !TracingEngine::denoise;
-		if (IsKeyPressed(KEY_P)) TracingEngine::pause = !TracingEngine::pause;
-
-		TracingEngine::Render(&camera);
+		if (IsKeyPressed(KEY_ONE)) TracingEngine::CycleDebugView();
+		if (IsKeyPressed(KEY_TWO)) TracingEngine::CycleSampler();
+		if (IsKeyPressed(KEY_THREE)) TracingEngine::ToggleFoveation();
+		if (IsKeyPressed(KEY_FOUR)) WavefrontTracer::enabled = !WavefrontTracer::enabled;
+		if (IsKeyPressed(KEY_FIVE)) WavefrontTracer::binning = !WavefrontTracer::binning;
+		if (IsKeyPressed(KEY_SIX)) TracingEngine::environmentSampling = !TracingEngine::environmentSampling;
+		if (IsKeyPressed(KEY_SEVEN)) TracingEngine::GetContext()->timeSlicing = !TracingEngine::GetContext()->timeSlicing;
+		if (IsKeyPressed(KEY_EIGHT)) TracingEngine::hybridFirstHit = !TracingEngine::hybridFirstHit;
+		if (IsKeyPressed(KEY_NINE)) TracingEngine::primaryCache = !TracingEngine::primaryCache;
+		if (IsKeyPressed(KEY_R)) TracingEngine::GetContext()->denoise = !TracingEngine::GetContext()->denoise;
+		if (IsKeyPressed(KEY_F)) TracingEngine::GetContext()->filter = !TracingEngine::GetContext()->filter;
+		if (IsKeyPressed(KEY_P)) TracingEngine::GetContext()->pause = !TracingEngine::GetContext()->pause;
+		if (IsKeyPressed(KEY_T)) Profiler::ExportChromeTrace("frame_trace.json");
+
+		// a sliced frame is only written once its last band is traced
+		if (TracingEngine::Render(&camera)) FrameWriter::Capture(TracingEngine::GetPresentedTexture());
 
 		deltaTime += GetFrameTime();
 	}
 
-	UnloadModel(model);
-	UnloadModel(ring);
+	FrameWriter::End();
+
+	for (Model& model : models) UnloadModel(model);
 
 	TracingEngine::Unload();
 
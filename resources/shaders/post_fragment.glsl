@@ -1,80 +1,94 @@
 #version 430
 
-#define INV_SQRT_OF_2PI 0.39894228040143267793994605993439  // 1.0/SQRT_OF_2PI
-#define INV_PI 0.31830988618379067153776752674503
+// one iteration of an edge-avoiding a-trous wavelet filter (Dammertz et al. 2010), run with
+// stepWidth 1, 2, 4 ... so five passes of 25 taps cover a 64 pixel wide footprint
 
 in vec2 fragTexCoord;
 
 uniform sampler2D texture0;
+uniform sampler2D gNormalDepth;
+uniform sampler2D gAlbedo;
+uniform sampler2D gEmission;
 
 uniform vec2 resolution;
+uniform int stepWidth;
+// the first pass divides the albedo out so texture detail is not blurred, the last multiplies it back.
+// the primary hit's emission is taken out before and added back after, it needs no filtering
+uniform bool firstPass;
+uniform bool lastPass;
+
+uniform float colorPhi;
+uniform float normalPhi;
+uniform float depthPhi;
 
 out vec4 out_color;
 
-//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-//  Copyright (c) 2018-2019 Michele Morrone
-//  All rights reserved.
-//
-//  https://michelemorrone.eu - https://BrutPitt.com
-//
-//  me@michelemorrone.eu - brutpitt@gmail.com
-//  twitter: @BrutPitt - github: BrutPitt
-//  
-//  https://github.com/BrutPitt/glslSmartDeNoise/
-//
-//  This software is distributed under the terms of the BSD 2-Clause license
-//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-
-#define INV_SQRT_OF_2PI 0.39894228040143267793994605993439  // 1.0/SQRT_OF_2PI
-#define INV_PI 0.31830988618379067153776752674503
-
-//  smartDeNoise - parameters
-//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-//
-//  sampler2D tex     - sampler image / texture
-//  vec2 uv           - actual fragment coord
-//  float sigma  >  0 - sigma Standard Deviation
-//  float kSigma >= 0 - sigma coefficient 
-//      kSigma * sigma  -->  radius of the circular kernel
-//  float threshold   - edge sharpening threshold 
-
-vec4 smartDeNoise(sampler2D tex, vec2 uv, float sigma, float kSigma, float threshold)
+const float kernel[3] = float[](3.0 / 8.0, 1.0 / 4.0, 1.0 / 16.0);
+
+// the same clamped albedo divides and multiplies, so a channel with no albedo comes back unchanged
+vec3 loadAlbedo(ivec2 texel)
+{
+	return max(texelFetch(gAlbedo, texel, 0).rgb, vec3(0.01));
+}
+
+vec3 loadIllumination(ivec2 texel)
+{
+	vec3 color = texelFetch(texture0, texel, 0).rgb;
+	return firstPass ? max(color - texelFetch(gEmission, texel, 0).rgb, vec3(0)) / loadAlbedo(texel) : color;
+}
+
+float luminance(vec3 color)
+{
+	return dot(color, vec3(0.2126, 0.7152, 0.0722));
+}
+
+void main()
 {
-    float radius = round(kSigma * sigma);
-    float radQ = radius * radius;
+	ivec2 texel = ivec2(gl_FragCoord.xy);
+	ivec2 maxTexel = ivec2(resolution) - 1;
 
-    float invSigmaQx2 = .5 / (sigma * sigma);      // 1.0 / (sigma^2 * 2.0)
-    float invSigmaQx2PI = INV_PI * invSigmaQx2;    // 1.0 / (sqrt(PI) * sigma)
+	vec3 centerColor = loadIllumination(texel);
+	vec4 centerNormalDepth = texelFetch(gNormalDepth, texel, 0);
+	bool centerSky = centerNormalDepth.w <= 0;
 
-    float invThresholdSqx2 = .5 / (threshold * threshold);     // 1.0 / (sigma^2 * 2.0)
-    float invThresholdSqrt2PI = INV_SQRT_OF_2PI / threshold;   // 1.0 / (sqrt(2*PI) * sigma)
+	vec3 sum = vec3(0);
+	float weightSum = 0;
 
-    vec4 centrPx = texture(tex, uv);
+	for (int y = -2; y <= 2; y++)
+	{
+		for (int x = -2; x <= 2; x++)
+		{
+			ivec2 tap = clamp(texel + ivec2(x, y) * stepWidth, ivec2(0), maxTexel);
 
-    float zBuff = 0.0;
-    vec4 aBuff = vec4(0.0);
-    vec2 size = vec2(textureSize(tex, 0));
+			vec3 color = loadIllumination(tap);
+			vec4 normalDepth = texelFetch(gNormalDepth, tap, 0);
+			bool sky = normalDepth.w <= 0;
 
-    for (float x = -radius; x <= radius; x++) {
-        float pt = sqrt(radQ - x * x);  // pt = yRadius: have circular trend
-        for (float y = -pt; y <= pt; y++) {
-            vec2 d = vec2(x, y);
+			// sky only mixes with sky, surfaces are stopped by normal and relative depth differences
+			float geometryWeight = 0;
 
-            float blurFactor = exp(-dot(d, d) * invSigmaQx2) * invSigmaQx2PI;
+			if (sky == centerSky)
+			{
+				geometryWeight = sky ? 1.0 : pow(max(0, dot(centerNormalDepth.xyz, normalDepth.xyz)), normalPhi)
+					* exp(-abs(centerNormalDepth.w - normalDepth.w) / (depthPhi * centerNormalDepth.w * stepWidth));
+			}
 
-            vec4 walkPx = texture(tex, uv + d / size);
+			float colorDifference = luminance(abs(centerColor - color));
+			float colorWeight = exp(-colorDifference * colorDifference / (colorPhi * colorPhi));
 
-            vec4 dC = walkPx - centrPx;
-            float deltaFactor = exp(-dot(dC, dC) * invThresholdSqx2) * invThresholdSqrt2PI * blurFactor;
+			float weight = kernel[abs(x)] * kernel[abs(y)] * geometryWeight * colorWeight;
 
-            zBuff += deltaFactor;
-            aBuff += deltaFactor * walkPx;
-        }
-    }
-    return aBuff / zBuff;
-}
+			sum += color * weight;
+			weightSum += weight;
+		}
+	}
 
-void main()
-{
-    out_color = smartDeNoise(texture0, fragTexCoord, 5.0, 2.0, 0.04);
-}
\ No newline at end of file
+	vec3 filtered = weightSum > 0 ? sum / weightSum : centerColor;
+
+	if (lastPass)
+	{
+		filtered = filtered * loadAlbedo(texel) + texelFetch(gEmission, texel, 0).rgb;
+	}
+
+	out_color = vec4(filtered, 1);
+}
@@ -0,0 +1,18 @@
+#version 430
+
+in vec3 fragPosition;
+in vec3 fragNormal;
+
+// the mesh being drawn in the tracer's meshes buffer
+uniform int meshIndex;
+
+// world position with the mesh index + 1 in alpha, cleared to 0 where nothing was drawn, and the
+// interpolated normal, read by rasterFirstHit in raytracer_fragment.glsl
+layout(location = 0) out vec4 out_position;
+layout(location = 1) out vec4 out_normal;
+
+void main()
+{
+	out_position = vec4(fragPosition, meshIndex + 1);
+	out_normal = vec4(normalize(fragNormal), 0);
+}
@@ -0,0 +1,20 @@
+#version 430
+
+// raylib's default attribute and matrix names, DrawMesh fills them in
+in vec3 vertexPosition;
+in vec3 vertexNormal;
+
+uniform mat4 mvp;
+uniform mat4 matModel;
+// the model's rotation alone, normals are turned the same way ReadRaylibTriangle turns them for the tracer
+uniform mat4 rotation;
+
+out vec3 fragPosition;
+out vec3 fragNormal;
+
+void main()
+{
+	fragPosition = vec3(matModel * vec4(vertexPosition, 1));
+	fragNormal = mat3(rotation) * vertexNormal;
+	gl_Position = mvp * vec4(vertexPosition, 1);
+}
@@ -0,0 +1,769 @@
+// shared by the fragment tracer and the wavefront compute passes, included after the variant
+// defines, the fallbacks are the variant that handles any scene
+
+#ifndef MAX_BOUNCES
+#define MAX_BOUNCES 16
+#endif
+#ifndef BVH_STACK_SIZE
+#define BVH_STACK_SIZE 32
+#endif
+#ifndef GRAVITY
+#define GRAVITY 1
+#endif
+#ifndef SPHERES
+#define SPHERES 1
+#endif
+
+#define PI 3.1415927
+
+uniform vec3 viewParams;
+uniform vec2 resolution;
+
+uniform vec3 cameraPosition;
+uniform vec3 cameraDirection;
+uniform vec2 screenCenter;
+
+uniform float blur;
+
+uniform int numGravityBodies;
+// root of the sphere hierarchy in nodes, -1 when there are no spheres
+uniform int sphereRootNode;
+
+// see Sampler.h
+#define SAMPLER_PCG 0
+#define SAMPLER_SOBOL 1
+#define SAMPLER_BLUE_NOISE 2
+#define SAMPLER_LEGACY 3
+
+uniform int samplerType;
+uniform int frameIndex;
+uniform int sobolDirections[4 * 32];
+uniform sampler2D blueNoise;
+
+struct SkyMaterial
+{
+	vec4 skyColorZenith;
+	vec4 skyColorHorizon;
+	vec4 groundColor;
+	vec4 sunColor;
+	vec3 sunDirection;
+	float sunFocus;
+	float sunIntensity;
+};
+
+// matches RaytracingMaterial, the last vec4 is e_s_b_b on the host
+struct RayTracingMaterial
+{
+	vec4 color;
+	vec4 emission;
+	float emissionStrength;
+	float smoothness;
+	float specularProbability;
+	float unused;
+};
+
+struct GravityBody
+{
+	vec4 posmass;
+};
+
+struct Sphere
+{
+	vec3 position;
+	float radius;
+	RayTracingMaterial material;
+};
+
+struct Triangle
+{
+	vec3 posA;
+	vec3 posB;
+	vec3 posC;
+	vec3 normalA;
+	vec3 normalB;
+	vec3 normalC;
+};
+
+struct Mesh
+{
+	int firstTriangleIndex;
+	int numTriangles;
+	int rootNodeIndex;
+	int bvhDepth;
+	RayTracingMaterial material;
+	vec3 boundingMin;
+	vec3 boundingMax;
+};
+
+struct BoundingBox
+{
+	vec3 min;
+	vec3 max;
+};
+
+struct Node
+{
+	BoundingBox bounds;
+	int triangleIndex;
+	int numTriangles;
+	int childIndex;
+};
+
+layout(std430, binding = 0) readonly restrict buffer SphereBuffer {
+	Sphere spheres[];
+};
+
+layout(std430, binding = 1) readonly restrict buffer GravityBodyBuffer {
+	GravityBody gravityBodies[];
+};
+
+layout(std430, binding = 2) readonly restrict buffer ObjectBuffer {
+	Mesh meshes[];
+};
+
+layout(std430, binding = 3) readonly restrict buffer TriangleBuffer
+{
+	Triangle triangles[];
+};
+
+layout(std430, binding = 4) readonly restrict buffer NodeBuffer
+{
+	Node nodes[];
+};
+
+
+uniform SkyMaterial skyMaterial;
+
+// bins over the elevation of the sky without the sun, see EnvironmentMap.h
+#define ENVIRONMENT_MAP_SIZE 1024
+
+// rgb is the sky at each bin's center, alpha the luminance CDF where the bin starts
+uniform sampler2D environmentMap;
+// baked sky for escaped rays and direct sampling of the sun and sky at diffuse bounces
+uniform bool environmentSampling;
+uniform float sunSampleProbability;
+
+#ifdef TRAVERSAL_STATS
+#define TRAVERSAL_STAT_SLOTS 256u
+
+// every counter is a low and a high word, read on the host as one 64 bit counter
+layout(std430, binding = 5) restrict buffer TraversalStatsBuffer
+{
+	uint traversalStats[];
+};
+
+void addTraversalStat(uint counter, uint value)
+{
+	uint low = atomicAdd(traversalStats[counter * 2u], value);
+
+	// the low word wrapped, carry into the high one
+	if (low + value < low)
+	{
+		atomicAdd(traversalStats[counter * 2u + 1u], 1u);
+	}
+}
+
+int statNodeVisits = 0;
+int statTriangleTests = 0;
+int statBendingEvaluations = 0;
+int statRays = 0;
+
+#define COUNT_STAT(counter) counter++
+#else
+#define COUNT_STAT(counter)
+#endif
+
+// lets a pass observe which nodes the traversal reads, see wavefront_trace.comp
+#ifndef ON_NODE_FETCH
+#define ON_NODE_FETCH(index)
+#endif
+
+struct Ray
+{
+	vec3 origin;
+	vec3 direction;
+	vec3 invDirection;
+};
+
+struct HitInfo
+{
+	bool didHit;
+	float distance;
+	vec3 hitPoint;
+	vec3 hitNormal;
+	RayTracingMaterial material;
+	// what was hit, the mesh index + 1 or minus the sphere index + 1
+	int object;
+};
+
+vec3 CalcRayDir(vec2 nCoord) {
+	vec3 horizontal = normalize(cross(cameraDirection, vec3(.0, 1.0, .0)));
+	vec3 vertical = normalize(cross(horizontal, cameraDirection));
+	return normalize(cameraDirection + horizontal * nCoord.x + vertical * nCoord.y);
+}
+
+mat3 setCamera()
+{
+	vec3 cw = normalize(cameraDirection);
+	vec3 cp = vec3(0.0, 1.0, 0.0);
+	vec3 cu = normalize(cross(cw, cp));
+	vec3 cv = (cross(cu, cw));
+	return mat3(cu, cv, cw);
+}
+
+HitInfo RayTriangle(Ray ray, Triangle tri)
+{
+	vec3 edgeAB = tri.posB - tri.posA;
+	vec3 edgeAC = tri.posC - tri.posA;
+	vec3 normalVector = cross(edgeAB, edgeAC);
+	vec3 ao = ray.origin - tri.posA;
+	vec3 dao = cross(ao, ray.direction);
+
+	float determinant = -dot(ray.direction, normalVector);
+	float invDet = 1 / determinant;
+
+	float dst = dot(ao, normalVector) * invDet;
+	float u = dot(edgeAC, dao) * invDet;
+	float v = -dot(edgeAB, dao) * invDet;
+	float w = 1 - u - v;
+
+	HitInfo hitInfo;
+	hitInfo.didHit = determinant >= 1E-6 && dst >= 0 && u >= 0 && v >= 0 && w >= 0;
+	hitInfo.hitPoint = ray.origin + ray.direction * dst;
+	hitInfo.hitNormal = normalize(tri.normalA * w + tri.normalB * u + tri.normalC * v);
+	hitInfo.distance = dst;
+	return hitInfo;
+}
+
+HitInfo RaySphere(Ray ray, vec3 center, float radius)
+{
+	HitInfo hitInfo;
+	hitInfo.didHit = false;
+	vec3 offsetRayOrigin = ray.origin - center;
+
+	float a = dot(ray.direction, ray.direction);
+	float b = 2.0 * dot(offsetRayOrigin, ray.direction);
+	float c = dot(offsetRayOrigin, offsetRayOrigin) - (radius * radius);
+
+	float discriminant = b * b - 4.0 * a * c;
+
+	if (discriminant >= 0.0)
+	{
+		float distance = (-b - sqrt(discriminant)) / (2.0 * a);
+
+		if (distance >= 0.0)
+		{
+			hitInfo.didHit = true;
+			hitInfo.distance = distance;
+			hitInfo.hitPoint = ray.origin + (ray.direction * distance);
+			hitInfo.hitNormal = normalize(hitInfo.hitPoint - center);
+		}
+	}
+
+	return hitInfo;
+}
+
+float RayBoundingBox(Ray ray, vec3 boundingMin, vec3 boundingMax) {
+	vec3 tMin = (boundingMin - ray.origin) * ray.invDirection;
+	vec3 tMax = (boundingMax - ray.origin) * ray.invDirection;
+	vec3 t1 = min(tMin, tMax);
+	vec3 t2 = max(tMin, tMax);
+	float dstFar = min(min(t2.x, t2.y), t2.z);
+	float dstNear = max(max(t1.x, t1.y), t1.z);
+
+	bool didHit = dstFar >= dstNear && dstFar > 0;
+	return didHit ? dstNear : 100000000;
+}
+
+// leaves index triangles, or spheres for the sphere tree, which carry their own material
+HitInfo RayBVH(Ray ray, int nodeOffset, bool sphereLeaves)
+{
+	int nodeStack[BVH_STACK_SIZE];
+	int stackIndex = 0;
+	nodeStack[stackIndex++] = nodeOffset;
+
+	HitInfo result;
+	result.didHit = false;
+	result.distance = 100000000;
+
+	while (stackIndex > 0)
+	{
+		int nodeIndex = nodeStack[--stackIndex];
+		Node node = nodes[nodeIndex];
+		COUNT_STAT(statNodeVisits);
+		ON_NODE_FETCH(nodeIndex);
+
+#if SPHERES
+		if (node.childIndex == 0 && sphereLeaves)
+		{
+			for (int s = node.triangleIndex; s < node.triangleIndex + node.numTriangles; s++)
+			{
+				Sphere sphere = spheres[s];
+				COUNT_STAT(statTriangleTests);
+
+				HitInfo hitInfo = RaySphere(ray, sphere.position, sphere.radius);
+
+				if (hitInfo.didHit && hitInfo.distance < result.distance)
+				{
+					result = hitInfo;
+					result.material = sphere.material;
+					result.object = -(s + 1);
+				}
+			}
+		}
+		else
+#endif
+		if (node.childIndex == 0)
+		{
+			for (int t = node.triangleIndex; t < node.triangleIndex + node.numTriangles; t++)
+			{
+				Triangle tri = triangles[t];
+				COUNT_STAT(statTriangleTests);
+
+				HitInfo hitInfo = RayTriangle(ray, tri);
+
+				if (hitInfo.didHit && hitInfo.distance < result.distance)
+				{
+					result = hitInfo;
+				}
+			}
+		}
+		else
+		{
+			int childIndexA = node.childIndex + 0;
+			int childIndexB = node.childIndex + 1;
+			Node childA = nodes[childIndexA];
+			Node childB = nodes[childIndexB];
+
+			float dstA = RayBoundingBox(ray, childA.bounds.min, childA.bounds.max);
+			float dstB = RayBoundingBox(ray, childB.bounds.min, childB.bounds.max);
+
+			bool isNearestA = dstA <= dstB;
+			float dstNear = isNearestA ? dstA : dstB;
+			float dstFar = isNearestA ? dstB : dstA;
+			int childIndexNear = isNearestA ? childIndexA : childIndexB;
+			int childIndexFar = isNearestA ? childIndexB : childIndexA;
+
+			if (dstFar < result.distance) nodeStack[stackIndex++] = childIndexFar;
+			if (dstNear < result.distance) nodeStack[stackIndex++] = childIndexNear;
+		}
+	}
+
+	return result;
+}
+
+HitInfo CalculateRayCollision(Ray ray, int bounce)
+{
+	HitInfo closestHit;
+	closestHit.didHit = false;
+	COUNT_STAT(statRays);
+
+	closestHit.distance = 100000000;
+
+#if SPHERES
+	if (sphereRootNode >= 0)
+	{
+		closestHit = RayBVH(ray, sphereRootNode, true);
+	}
+#endif
+
+	for (int i = 0; i < meshes.length(); i++)
+	{
+		RayTracingMaterial mat = meshes[i].material;
+		HitInfo hit = RayBVH(ray, meshes[i].rootNodeIndex, false);
+
+		if (hit.didHit && hit.distance < closestHit.distance)
+		{
+			closestHit.didHit = true;
+			closestHit.distance = hit.distance;
+			closestHit.hitNormal = hit.hitNormal;
+			closestHit.hitPoint = ray.origin + ray.direction * hit.distance;
+			closestHit.material = mat;
+			closestHit.object = i + 1;
+		}
+	}
+
+	return closestHit;
+}
+
+struct SamplerState
+{
+	uvec2 coord;
+	uint seed;
+	uint sampleIndex;
+	uint dimension;
+	uint pcgState;
+};
+
+uint hash(uint x)
+{
+	uint state = x * 747796405u + 2891336453u;
+	uint word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+	return (word >> 22u) ^ word;
+}
+
+// 24 bits so the result never rounds up to 1
+float uintToUnitFloat(uint x)
+{
+	return float(x >> 8u) / 16777216.0;
+}
+
+SamplerState createSampler(uvec2 coord, uint pixel, uint sampleBase)
+{
+	SamplerState rng;
+	rng.coord = coord;
+	rng.seed = hash(pixel);
+	rng.sampleIndex = 0u;
+	rng.dimension = 0u;
+	rng.pcgState = hash(pixel ^ hash(sampleBase));
+
+	// the original seed, every pixel on the first row and column shares one and each pair of factors collides
+	if (samplerType == SAMPLER_LEGACY)
+	{
+		rng.pcgState = uint(int((float(coord.y) + 0.5) * (float(coord.x) + 0.5))) + sampleBase * 719393u;
+	}
+
+	return rng;
+}
+
+// every camera sample restarts at dimension 0 so the same dimension always means the same decision
+void beginSample(inout SamplerState rng, uint sampleIndex)
+{
+	rng.sampleIndex = sampleIndex;
+	rng.dimension = 0u;
+}
+
+uint sobol(uint index, uint dimension)
+{
+	uint x = 0u;
+
+	for (uint bit = 0u; index != 0u; bit++, index >>= 1u)
+	{
+		if ((index & 1u) != 0u) x ^= uint(sobolDirections[dimension * 32u + bit]);
+	}
+
+	return x;
+}
+
+uint laineKarrasPermutation(uint x, uint seed)
+{
+	x += seed;
+	x ^= x * 0x6c50b47cu;
+	x ^= x * 0xb82f1e52u;
+	x ^= x * 0xc7afe638u;
+	x ^= x * 0x8d22f6e6u;
+	return x;
+}
+
+uint nestedUniformScramble(uint x, uint seed)
+{
+	return bitfieldReverse(laineKarrasPermutation(bitfieldReverse(x), seed));
+}
+
+// hash based owen scrambling, dimensions come in 4D sets that share a shuffled index
+float sampleSobol(SamplerState rng)
+{
+	uint setSeed = hash(rng.seed ^ hash(rng.dimension / 4u));
+	uint dimension = rng.dimension % 4u;
+	uint index = nestedUniformScramble(rng.sampleIndex, setSeed);
+	return uintToUnitFloat(nestedUniformScramble(sobol(index, dimension), hash(setSeed + dimension)));
+}
+
+// each dimension reads the tile at its own offset, successive samples step by the golden ratio
+float sampleBlueNoise(SamplerState rng)
+{
+	uint offset = hash(rng.dimension + 0x9e3779b9u);
+	ivec2 texel = ivec2((rng.coord + uvec2(offset, offset >> 8u)) & 63u);
+	return fract(texelFetch(blueNoise, texel, 0).r + float(rng.sampleIndex) * 0.61803398875);
+}
+
+float random(inout SamplerState rng)
+{
+	float value;
+
+	if (samplerType == SAMPLER_SOBOL)
+	{
+		value = sampleSobol(rng);
+	}
+	else if (samplerType == SAMPLER_BLUE_NOISE)
+	{
+		value = sampleBlueNoise(rng);
+	}
+	else
+	{
+		// pcg and legacy step the same hash, only their seeds differ
+		rng.pcgState = hash(rng.pcgState);
+		value = uintToUnitFloat(rng.pcgState);
+	}
+
+	rng.dimension++;
+	return value;
+}
+
+// two dimensions per direction so consecutive dimensions stay well stratified
+vec3 randomDirection(inout SamplerState rng)
+{
+	float z = 1 - 2 * random(rng);
+	float phi = 2 * PI * random(rng);
+	float r = sqrt(max(0, 1 - z * z));
+	return vec3(r * cos(phi), r * sin(phi), z);
+}
+
+// orthonormal basis around n without branches on the normal's direction (Duff et al.)
+mat3 tangentFrame(vec3 n)
+{
+	float s = n.z >= 0 ? 1.0 : -1.0;
+	float a = -1 / (s + n.z);
+	float b = n.x * n.y * a;
+	return mat3(vec3(1 + s * n.x * n.x * a, s * b, -s * n.x), vec3(b, s + n.y * n.y * a, -n.y), n);
+}
+
+// pdf cos / PI, so a lambertian surface's weight is just its albedo
+vec3 sampleCosineHemisphere(vec3 normal, inout SamplerState rng)
+{
+	float u1 = random(rng);
+	float u2 = random(rng);
+	float r = sqrt(u1);
+	float phi = 2 * PI * u2;
+	return tangentFrame(normal) * vec3(r * cos(phi), r * sin(phi), sqrt(max(0, 1 - u1)));
+}
+
+float smithG1(float nDotX, float alpha)
+{
+	float alpha2 = alpha * alpha;
+	return 2 * nDotX / (nDotX + sqrt(alpha2 + (1 - alpha2) * nDotX * nDotX));
+}
+
+// samples the half vector from D * cos, the returned weight is brdf * cos / pdf
+vec3 sampleGGX(vec3 normal, vec3 view, float roughness, vec3 f0, inout SamplerState rng, out vec3 weight)
+{
+	float alpha = max(roughness * roughness, 0.001);
+	float u1 = random(rng);
+	float u2 = random(rng);
+
+	float cosTheta = sqrt((1 - u1) / (1 + (alpha * alpha - 1) * u1));
+	float sinTheta = sqrt(max(0, 1 - cosTheta * cosTheta));
+	float phi = 2 * PI * u2;
+	vec3 halfVector = tangentFrame(normal) * vec3(sinTheta * cos(phi), sinTheta * sin(phi), cosTheta);
+
+	vec3 direction = reflect(-view, halfVector);
+
+	float nDotL = dot(normal, direction);
+	float nDotV = max(dot(normal, view), 0.0001);
+	float nDotH = max(dot(normal, halfVector), 0.0001);
+	float vDotH = max(dot(view, halfVector), 0);
+
+	if (nDotL <= 0)
+	{
+		weight = vec3(0);
+		return direction;
+	}
+
+	vec3 fresnel = f0 + (1 - f0) * pow(1 - vDotH, 5);
+	float g = smithG1(nDotV, alpha) * smithG1(nDotL, alpha);
+	weight = fresnel * g * vDotH / (nDotV * nDotH);
+	return direction;
+}
+
+vec3 getSunLight(vec3 direction)
+{
+	float sun = pow(max(0, dot(direction, -skyMaterial.sunDirection)), skyMaterial.sunFocus) * skyMaterial.sunIntensity;
+	float sunMask = float(direction.y >= 0);
+	return sun * sunMask * skyMaterial.sunColor.rgb;
+}
+
+// texture coordinate of an elevation in environmentMap, texel i is centered on bin i
+float environmentCoordinate(float y)
+{
+	return (clamp(y, -1, 1) + 1) * 0.5 * ENVIRONMENT_MAP_SIZE / (ENVIRONMENT_MAP_SIZE + 1);
+}
+
+vec3 getEnvironmentLight(Ray ray)
+{
+	if (environmentSampling)
+	{
+		// the sky is flat past y = 0.4 and below y = -0.01, so clamping unnormalized bent directions changes nothing
+		vec3 sky = textureLod(environmentMap, vec2(environmentCoordinate(ray.direction.y), 0.5), 0).rgb;
+		return sky + getSunLight(ray.direction);
+	}
+
+	float skyGradientT = pow(smoothstep(0.0, 0.4, ray.direction.y), 0.35);
+	vec3 skyGradient = mix(skyMaterial.skyColorHorizon.rgb, skyMaterial.skyColorZenith.rgb, skyGradientT);
+
+	float groundToSkyT = smoothstep(-0.01, 0.0, ray.direction.y);
+	return mix(skyMaterial.groundColor.rgb, skyGradient, groundToSkyT) + getSunLight(ray.direction);
+}
+
+float environmentCdf(int bin)
+{
+	return texelFetch(environmentMap, ivec2(bin, 0), 0).a;
+}
+
+// solid angle pdf of sampleEnvironment for a unit direction, the sun lobe is cos^sunFocus around the sun and the
+// sky is tabulated over elevation and uniform around it
+float environmentPdf(vec3 direction)
+{
+	vec3 sun = normalize(-skyMaterial.sunDirection);
+	float sunPdf = (skyMaterial.sunFocus + 1) / (2 * PI) * pow(max(0, dot(direction, sun)), skyMaterial.sunFocus);
+
+	int bin = clamp(int((direction.y + 1) * 0.5 * ENVIRONMENT_MAP_SIZE), 0, ENVIRONMENT_MAP_SIZE - 1);
+	// the bin's share of the CDF over its height of 2 / size in y, and y is uniform in solid angle over 2 PI
+	float skyPdf = (environmentCdf(bin + 1) - environmentCdf(bin)) * ENVIRONMENT_MAP_SIZE / (4 * PI);
+
+	return mix(skyPdf, sunPdf, sunSampleProbability);
+}
+
+// a direction toward the sun or the bright parts of the sky, pdf is environmentPdf of it
+vec3 sampleEnvironment(inout SamplerState rng, out float pdf)
+{
+	float u0 = random(rng);
+	float u1 = random(rng);
+	float u2 = random(rng);
+	float phi = 2 * PI * u2;
+	vec3 direction;
+
+	if (u0 < sunSampleProbability)
+	{
+		float cosTheta = pow(u1, 1 / (skyMaterial.sunFocus + 1));
+		float sinTheta = sqrt(max(0, 1 - cosTheta * cosTheta));
+		direction = tangentFrame(normalize(-skyMaterial.sunDirection)) * vec3(sinTheta * cos(phi), sinTheta * sin(phi), cosTheta);
+	}
+	else
+	{
+		// the bin whose CDF range holds u1, cdf(low) <= u1 < cdf(high) throughout
+		int low = 0;
+		int high = ENVIRONMENT_MAP_SIZE;
+
+		while (high - low > 1)
+		{
+			int middle = (low + high) / 2;
+
+			if (environmentCdf(middle) <= u1)
+			{
+				low = middle;
+			}
+			else
+			{
+				high = middle;
+			}
+		}
+
+		float cdfLow = environmentCdf(low);
+		float cdfHigh = environmentCdf(low + 1);
+		float t = cdfHigh > cdfLow ? (u1 - cdfLow) / (cdfHigh - cdfLow) : 0.5;
+		float y = -1 + (low + t) * 2.0 / ENVIRONMENT_MAP_SIZE;
+		float r = sqrt(max(0, 1 - y * y));
+		direction = vec3(r * cos(phi), y, r * sin(phi));
+	}
+
+	pdf = environmentPdf(direction);
+	return direction;
+}
+
+// power heuristic weight of a strategy with pdf a against one with pdf b
+float misWeight(float a, float b)
+{
+	return a * a / max(a * a + b * b, 1e-20);
+}
+
+float angleBetweenVectors(vec3 vecA, vec3 vecB) 
+{
+	return acos(dot(vecA, vecB) / (length(vecA) * length(vecB)));
+}
+
+bool isSingularity(Ray ray)
+{
+#if GRAVITY
+	for (int i = 0; i < numGravityBodies; i++)
+	{
+		COUNT_STAT(statBendingEvaluations);
+		vec3 source = gravityBodies[i].posmass.xyz;
+
+		vec3 toSourceVector = source - ray.origin;
+
+		float distance = distance(source, ray.origin);
+
+		float closestDistance = distance * sin(angleBetweenVectors(toSourceVector, ray.direction));
+		float rayLength = distance * cos(angleBetweenVectors(toSourceVector, ray.direction));
+
+		vec3 closestPoint = ray.origin + (ray.direction * rayLength);
+		vec3 closestPointToSourceVector = source - closestPoint;
+
+		vec3 changeVector = normalize(closestPointToSourceVector) * (1 / (closestDistance * closestDistance));
+
+		vec3 newRayDirection = ray.direction + changeVector;
+
+		if (angleBetweenVectors(newRayDirection, ray.direction) > 0.729548)
+		{
+			return true;
+		}
+	}
+#endif
+
+	return false;
+}
+
+Ray calculateBending(Ray ray) 
+{
+#if GRAVITY
+	for (int i = 0; i < numGravityBodies; i++)
+	{
+		COUNT_STAT(statBendingEvaluations);
+		vec3 source = gravityBodies[i].posmass.xyz;
+
+		vec3 toSourceVector = source - ray.origin;
+
+		float distance = distance(source, ray.origin);
+
+		float closestDistance = distance * sin(angleBetweenVectors(toSourceVector, ray.direction));
+		float rayLength = distance * cos(angleBetweenVectors(toSourceVector, ray.direction));
+
+		vec3 closestPoint = ray.origin + (ray.direction * rayLength);
+		vec3 closestPointToSourceVector = source - closestPoint;
+
+		vec3 changeVector = normalize(closestPointToSourceVector) * (1 / (closestDistance * closestDistance));
+
+		vec3 newRayDirection = ray.direction + changeVector;
+
+		ray.direction = newRayDirection;
+		ray.invDirection = 1 / ray.direction;
+	}
+#endif
+
+	return ray;
+}
+
+Ray offsetRay(Ray ray, float offsetStrength, inout SamplerState rng)
+{
+	ray.direction += randomDirection(rng) * offsetStrength;
+	ray.invDirection = 1/ray.direction;
+	return ray;
+}
+
+// continues the path off a surface and returns the throughput weight, the material is a mix of a
+// lambert and a GGX lobe, picking one with the mix weight as its probability cancels that weight,
+// older materials without one use smoothness. diffusePdf is the lambert lobe's pdf of the new direction, or
+// 0 when the GGX lobe was picked
+vec3 scatterRay(inout Ray ray, HitInfo hitInfo, vec3 normal, vec3 view, inout SamplerState rng, out float diffusePdf)
+{
+	RayTracingMaterial material = hitInfo.material;
+	float specularProbability = material.specularProbability > 0 ? material.specularProbability : material.smoothness;
+	bool specular = random(rng) < specularProbability;
+
+	vec3 weight = material.color.rgb;
+
+	if (specular)
+	{
+		ray.direction = sampleGGX(normal, view, 1 - material.smoothness, material.color.rgb, rng, weight);
+		diffusePdf = 0;
+	}
+	else
+	{
+		ray.direction = sampleCosineHemisphere(normal, rng);
+		diffusePdf = max(dot(normal, ray.direction), 0) / PI;
+	}
+
+	ray.origin = hitInfo.hitPoint;
+	ray.invDirection = 1 / ray.direction;
+	return weight;
+}
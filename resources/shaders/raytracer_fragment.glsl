@@ -1,474 +1,483 @@
 #version 430
 
-#define PI 3.1415927
+// variant defines are inserted above this line, see TracingEngine::GetVariantDefines
 
-in vec2 fragTexCoord;
-
-uniform vec3 viewParams;
-uniform vec2 resolution;
+#include "raytracer_common.glsl"
 
-uniform vec3 cameraPosition;
-uniform vec3 cameraDirection;
-uniform vec2 screenCenter;
+in vec2 fragTexCoord;
 
+// previous accumulation, rgb is the average and a the number of frames in it
 uniform sampler2D texture0;
-
-uniform int numRenderedFrames;
+uniform sampler2D previousNormalDepth;
+
+uniform vec3 previousCameraPosition;
+uniform vec3 previousCameraDirection;
+uniform bool cameraMoved;
+uniform bool historyValid;
+// frames of history kept per pixel, lower while moving so reprojection errors fade out
+uniform float maxHistory;
+
+// camera samples already in the accumulation
+uniform int sampleOffset;
+// fraction of the resolution traced, the image covers the bottom left of the targets
+uniform float renderScale;
+uniform float previousRenderScale;
+
+// foveation, GL pixel centre and radius of each focus region, see TracingEngine::ProjectFocusRegions
+#define MAX_FOCUS_REGIONS 16
+uniform vec3 focusRegions[MAX_FOCUS_REGIONS];
+uniform int numFocusRegions;
+// fraction of raysPerPixel traced outside the focus regions, 1 turns foveation off
+uniform float peripheryDensity;
 
 uniform bool denoise;
 uniform bool pause;
 
+// primary hits are read from the rasterized meshes instead of traversing them, see TracingEngine::DrawPrimaryRaster
+uniform bool hybridFirstHit;
+uniform sampler2D rasterPosition;
+uniform sampler2D rasterNormal;
+
+// the primary ray of every pixel, recorded once and read back while the camera, render scale and scene stay
+// the same, see TracingEngine::UpdatePrimaryCache. the bent direction with 1 in w for a singularity, the hit
+// point with the object hit in w, 0 for none, and the hit normal with the hit distance in w
+#define PRIMARY_CACHE_OFF 0
+#define PRIMARY_CACHE_RECORD 1
+#define PRIMARY_CACHE_READ 2
+uniform int primaryCacheMode;
+// min and max corner of the pixels the recording frame traced
+uniform vec4 primaryCacheBounds;
+layout(rgba32f, binding = 0) uniform image2D primaryCacheRay;
+layout(rgba32f, binding = 1) uniform image2D primaryCacheHit;
+layout(rgba32f, binding = 2) uniform image2D primaryCacheNormal;
+
 uniform int raysPerPixel;
 uniform int maxBounces;
 
-uniform float blur;
+layout(location = 0) out vec4 out_color;
+// first surface of the pixel for the denoiser, normal and hit distance (0 for sky) and albedo
+layout(location = 1) out vec4 out_normalDepth;
+layout(location = 2) out vec4 out_albedo;
+layout(location = 3) out vec4 out_emission;
 
-struct SkyMaterial
-{
-	vec4 skyColorZenith;
-	vec4 skyColorHorizon;
-	vec4 groundColor;
-	vec4 sunColor;
-	vec3 sunDirection;
-	float sunFocus;
-	float sunIntensity;
-};
-
-struct RayTracingMaterial
-{
-	vec4 color;
-	vec4 emission;
-	float emissionStrength;
-	float smoothness;
-};
+vec4 gBufferNormalDepth = vec4(0);
+vec4 gBufferAlbedo = vec4(1);
+vec4 gBufferEmission = vec4(0);
+vec3 gBufferHitPoint = vec3(0);
+bool gBufferWritten = false;
 
-struct GravityBody
-{
-	vec4 posmass;
-};
+#ifdef TRAVERSAL_STATS
+uniform int heatmap;
+uniform float heatmapRange;
+#endif
 
-struct Sphere
+void writeGBuffer(HitInfo hitInfo, vec3 normal)
 {
-	vec3 position;
-	float radius;
-	RayTracingMaterial material;
-};
+	if (hitInfo.didHit)
+	{
+		// straight line distance, the bent ray's length would not match what reprojection measures
+		gBufferNormalDepth = vec4(normal, distance(cameraPosition, hitInfo.hitPoint));
+		gBufferAlbedo = vec4(hitInfo.material.color.rgb, 1);
+		gBufferEmission = vec4(hitInfo.material.emission.rgb * hitInfo.material.emission.a, 1);
+		gBufferHitPoint = hitInfo.hitPoint;
+	}
 
-struct Triangle
-{
-	vec3 posA;
-	vec3 posB;
-	vec3 posC;
-	vec3 normalA;
-	vec3 normalB;
-	vec3 normalC;
-};
-
-struct Mesh
-{
-	int firstTriangleIndex;
-	int numTriangles;
-	int rootNodeIndex;
-	int bvhDepth;
-	RayTracingMaterial material;
-	vec3 boundingMin;
-	vec3 boundingMax;
-};
-
-struct BoundingBox
+	gBufferWritten = true;
+}
+
+// a paused frame traces nothing, but the denoiser still needs its guides
+void tracePrimaryGBuffer(Ray ray)
 {
-	vec3 min;
-	vec3 max;
-};
+	if (isSingularity(ray))
+	{
+		return;
+	}
 
-struct Node
+	Ray bentRay = calculateBending(ray);
+	HitInfo hitInfo = CalculateRayCollision(bentRay, 0);
+	writeGBuffer(hitInfo, dot(hitInfo.hitNormal, bentRay.direction) > 0 ? -hitInfo.hitNormal : hitInfo.hitNormal);
+}
+
+// the traced pixel a ray leaving the camera passes through, in pixels of the scaled image
+vec2 cameraPixel(vec3 direction)
 {
-	BoundingBox bounds;
-	int triangleIndex;
-	int numTriangles;
-	int childIndex;
-};
+	vec3 cw = normalize(cameraDirection);
+	vec3 cu = normalize(cross(cw, vec3(0.0, 1.0, 0.0)));
+	vec3 cv = cross(cu, cw);
 
-layout(std430, binding = 0) readonly restrict buffer SphereBuffer {
-	Sphere spheres[];
-};
+	vec3 local = vec3(dot(direction, cu), dot(direction, cv), dot(direction, cw));
 
-layout(std430, binding = 1) readonly restrict buffer GravityBodyBuffer {
-	GravityBody gravityBodies[];
-};
+	if (local.z <= 0)
+	{
+		return vec2(-1);
+	}
 
-layout(std430, binding = 2) readonly restrict buffer ObjectBuffer {
-	Mesh meshes[];
-};
+	return (local.xy / local.z * length(cameraDirection) * screenCenter.y + screenCenter) * renderScale;
+}
 
-layout(std430, binding = 3) readonly restrict buffer TriangleBuffer
+// the first hit of a primary ray out of the raster, spheres are not rasterized and are still traced. blur offsets
+// and bending leave the ray a straight line from the camera, so the texel it passes through stands in for it, its
+// hit point is up to half a pixel off the ray. a ray bent further than half a pixel would read texels magnified
+// by the lensing, those and rays leaving the image return false and are traced in full
+bool rasterFirstHit(Ray ray, Ray bentRay, out HitInfo hitInfo)
 {
-	Triangle triangles[];
-};
+	hitInfo.didHit = false;
+	hitInfo.distance = 100000000;
 
-layout(std430, binding = 4) readonly restrict buffer NodeBuffer
-{
-	Node nodes[];
-};
+	float halfPixel = 0.5 / (renderScale * screenCenter.y * length(cameraDirection));
 
+	// the sine of the bending angle, acos loses small angles to rounding
+	if (length(cross(ray.direction, bentRay.direction)) > halfPixel * length(ray.direction) * length(bentRay.direction))
+	{
+		return false;
+	}
 
-uniform SkyMaterial skyMaterial;
+	ivec2 texel = ivec2(floor(cameraPixel(bentRay.direction)));
 
-out vec4 out_color;
+	if (any(lessThan(texel, ivec2(0))) || any(greaterThanEqual(texel, ivec2(ceil(resolution * renderScale)))))
+	{
+		return false;
+	}
 
-struct Ray
-{
-	vec3 origin;
-	vec3 direction;
-	vec3 invDirection;
-};
+	COUNT_STAT(statRays);
 
-struct HitInfo
-{
-	bool didHit;
-	float distance;
-	vec3 hitPoint;
-	vec3 hitNormal;
-	RayTracingMaterial material;
-};
-
-vec3 CalcRayDir(vec2 nCoord) {
-	vec3 horizontal = normalize(cross(cameraDirection, vec3(.0, 1.0, .0)));
-	vec3 vertical = normalize(cross(horizontal, cameraDirection));
-	return normalize(cameraDirection + horizontal * nCoord.x + vertical * nCoord.y);
-}
+#if SPHERES
+	if (sphereRootNode >= 0)
+	{
+		hitInfo = RayBVH(bentRay, sphereRootNode, true);
+	}
+#endif
 
-mat3 setCamera()
-{
-	vec3 cw = normalize(cameraDirection);
-	vec3 cp = vec3(0.0, 1.0, 0.0);
-	vec3 cu = normalize(cross(cw, cp));
-	vec3 cv = (cross(cu, cw));
-	return mat3(cu, cv, cw);
+	vec4 position = texelFetch(rasterPosition, texel, 0);
+	float distance = length(position.xyz - bentRay.origin) / length(bentRay.direction);
+
+	if (position.a > 0 && distance < hitInfo.distance)
+	{
+		hitInfo.didHit = true;
+		hitInfo.distance = distance;
+		hitInfo.hitPoint = position.xyz;
+		hitInfo.hitNormal = texelFetch(rasterNormal, texel, 0).xyz;
+		hitInfo.material = meshes[int(position.a) - 1].material;
+		hitInfo.object = int(position.a);
+	}
+
+	return true;
 }
 
-HitInfo RayTriangle(Ray ray, Triangle tri)
+// bending and the first hit of the pixel's centre ray, the ray every sample starts from before blur offsets it
+void recordPrimaryCache(Ray ray)
 {
-	vec3 edgeAB = tri.posB - tri.posA;
-	vec3 edgeAC = tri.posC - tri.posA;
-	vec3 normalVector = cross(edgeAB, edgeAC);
-	vec3 ao = ray.origin - tri.posA;
-	vec3 dao = cross(ao, ray.direction);
+	ivec2 texel = ivec2(gl_FragCoord.xy);
+	bool singular = isSingularity(ray);
+	Ray bentRay = singular ? ray : calculateBending(ray);
 
-	float determinant = -dot(ray.direction, normalVector);
-	float invDet = 1 / determinant;
+	HitInfo hitInfo;
+	hitInfo.didHit = false;
 
-	float dst = dot(ao, normalVector) * invDet;
-	float u = dot(edgeAC, dao) * invDet;
-	float v = -dot(edgeAB, dao) * invDet;
-	float w = 1 - u - v;
+	if (!singular && (!hybridFirstHit || !rasterFirstHit(ray, bentRay, hitInfo)))
+	{
+		hitInfo = CalculateRayCollision(bentRay, 0);
+	}
 
-	HitInfo hitInfo;
-	hitInfo.didHit = determinant >= 1E-6 && dst >= 0 && u >= 0 && v >= 0 && w >= 0;
-	hitInfo.hitPoint = ray.origin + ray.direction * dst;
-	hitInfo.hitNormal = normalize(tri.normalA * w + tri.normalB * u + tri.normalC * v);
-	hitInfo.distance = dst;
-	return hitInfo;
+	imageStore(primaryCacheRay, texel, vec4(bentRay.direction, singular ? 1 : 0));
+	imageStore(primaryCacheHit, texel, vec4(hitInfo.hitPoint, hitInfo.didHit ? hitInfo.object : 0));
+	imageStore(primaryCacheNormal, texel, vec4(hitInfo.hitNormal, hitInfo.distance));
 }
 
-HitInfo RaySphere(Ray ray, vec3 center, float radius)
+// the recorded primary of the pixel a camera ray passes through, exact for the centre ray and, like the raster,
+// up to half a pixel off for rays blur offsets into a neighbour. false for rays leaving the recorded pixels
+bool readPrimaryCache(Ray ray, out Ray bentRay, out HitInfo hitInfo, out bool singular)
 {
-	HitInfo hitInfo;
-	hitInfo.didHit = false;
-	vec3 offsetRayOrigin = ray.origin - center;
+	ivec2 texel = ivec2(floor(cameraPixel(ray.direction)));
 
-	float a = dot(ray.direction, ray.direction);
-	float b = 2.0 * dot(offsetRayOrigin, ray.direction);
-	float c = dot(offsetRayOrigin, offsetRayOrigin) - (radius * radius);
+	if (any(lessThan(texel, ivec2(primaryCacheBounds.xy))) || any(greaterThanEqual(texel, ivec2(primaryCacheBounds.zw))))
+	{
+		return false;
+	}
 
-	float discriminant = b * b - 4.0 * a * c;
+	COUNT_STAT(statRays);
 
-	if (discriminant >= 0.0)
-	{
-		float distance = (-b - sqrt(discriminant)) / (2.0 * a);
+	vec4 direction = imageLoad(primaryCacheRay, texel);
+	vec4 hit = imageLoad(primaryCacheHit, texel);
+	vec4 normal = imageLoad(primaryCacheNormal, texel);
 
-		if (distance >= 0.0)
-		{
-			hitInfo.didHit = true;
-			hitInfo.distance = distance;
-			hitInfo.hitPoint = ray.origin + (ray.direction * distance);
-			hitInfo.hitNormal = normalize(hitInfo.hitPoint - center);
-		}
-	}
+	singular = direction.w > 0;
+	bentRay.origin = ray.origin;
+	bentRay.direction = direction.xyz;
+	bentRay.invDirection = 1 / direction.xyz;
 
-	return hitInfo;
-}
+	hitInfo.object = int(hit.w);
+	hitInfo.didHit = hitInfo.object != 0;
+	hitInfo.hitPoint = hit.xyz;
+	hitInfo.hitNormal = normal.xyz;
+	hitInfo.distance = normal.w;
 
-float RayBoundingBox(Ray ray, vec3 boundingMin, vec3 boundingMax) {
-	vec3 tMin = (boundingMin - ray.origin) * ray.invDirection;
-	vec3 tMax = (boundingMax - ray.origin) * ray.invDirection;
-	vec3 t1 = min(tMin, tMax);
-	vec3 t2 = max(tMin, tMax);
-	float dstFar = min(min(t2.x, t2.y), t2.z);
-	float dstNear = max(max(t1.x, t1.y), t1.z);
+	if (hitInfo.object > 0)
+	{
+		hitInfo.material = meshes[hitInfo.object - 1].material;
+	}
+	else if (hitInfo.object < 0)
+	{
+		hitInfo.material = spheres[-hitInfo.object - 1].material;
+	}
 
-	bool didHit = dstFar >= dstNear && dstFar > 0;
-	return didHit ? dstNear : 100000000;
+	return true;
 }
 
-HitInfo RayBVH(Ray ray, int nodeOffset, RayTracingMaterial material)
+// light from a sampled sky or sun direction reflected by a lambert lobe, bent and occluded like any other segment.
+// emissive surfaces in the way are left to the path that hits them
+vec3 sampleEnvironmentDirect(vec3 point, vec3 normal, vec3 albedo, inout SamplerState rng)
 {
-	int nodeStack[32];
-	int stackIndex = 0;
-	nodeStack[stackIndex++] = nodeOffset;
+	float lightPdf;
+	Ray shadowRay;
+	shadowRay.origin = point;
+	shadowRay.direction = sampleEnvironment(rng, lightPdf);
+	shadowRay.invDirection = 1 / shadowRay.direction;
 
-	HitInfo result;
-	result.distance = 100000000;
+	float cosTheta = dot(normal, shadowRay.direction);
 
-	while (stackIndex > 0)
+	if (cosTheta <= 0 || lightPdf <= 0 || isSingularity(shadowRay))
 	{
-		Node node = nodes[nodeStack[--stackIndex]];
-
-		if (node.childIndex == 0)
-		{
-			for (int t = node.triangleIndex; t < node.triangleIndex + node.numTriangles; t++)
-			{
-				Triangle tri = triangles[t];
+		return vec3(0);
+	}
 
-				HitInfo hitInfo = RayTriangle(ray, tri);
+	Ray bentRay = calculateBending(shadowRay);
 
-				if (hitInfo.didHit && hitInfo.distance < result.distance)
-				{
-					result = hitInfo;
-				}
-			}
-		}
-		else
-		{
-			int childIndexA = node.childIndex + 0;
-			int childIndexB = node.childIndex + 1;
-			Node childA = nodes[childIndexA];
-			Node childB = nodes[childIndexB];
-
-			float dstA = RayBoundingBox(ray, childA.bounds.min, childA.bounds.max);
-			float dstB = RayBoundingBox(ray, childB.bounds.min, childB.bounds.max);
-
-			bool isNearestA = dstA <= dstB;
-			float dstNear = isNearestA ? dstA : dstB;
-			float dstFar = isNearestA ? dstB : dstA;
-			int childIndexNear = isNearestA ? childIndexA : childIndexB;
-			int childIndexFar = isNearestA ? childIndexB : childIndexA;
-
-			if (dstFar < result.distance) nodeStack[stackIndex++] = childIndexFar;
-			if (dstNear < result.distance) nodeStack[stackIndex++] = childIndexNear;
-		}
+	if (CalculateRayCollision(bentRay, 1).didHit)
+	{
+		return vec3(0);
 	}
 
-	return result;
+	float weight = misWeight(lightPdf, cosTheta / PI);
+	return albedo / PI * cosTheta * getEnvironmentLight(bentRay) * weight / lightPdf;
 }
 
-HitInfo CalculateRayCollision(Ray ray, int bounce)
+vec3 trace(Ray ray, inout SamplerState rng, int maxBounces)
 {
-	HitInfo closestHit;
-	closestHit.didHit = false;
+	vec3 incomingLight = vec3(0);
+	vec3 rayColor = vec3(1);
+	// pdf the previous bounce's lambert lobe gave the current direction, 0 when nothing sampled the sky directly
+	float diffusePdf = 0;
 
-	closestHit.distance = 100000000;
+	vec3 debugNormal = vec3(0);
 
-	for (int i = 0; i < spheres.length(); i++)
+	// a constant bound lets the compiler unroll, maxBounces can still end the path sooner
+	for (int i = 0; i <= MAX_BOUNCES; i++)
 	{
-		Sphere sphere = spheres[i];
-		HitInfo hitInfo = RaySphere(ray, sphere.position, sphere.radius);
-
-		if (hitInfo.didHit && hitInfo.distance < closestHit.distance)
+		if (i > maxBounces)
 		{
-			closestHit = hitInfo;
-			closestHit.material = sphere.material;
+			break;
 		}
-	}
 
-	for (int i = 0; i < meshes.length(); i++)
-	{
-		RayTracingMaterial mat = meshes[i].material;
-		HitInfo hit = RayBVH(ray, meshes[i].rootNodeIndex, mat);
+		Ray bentRay;
+		HitInfo hitInfo;
+		bool singular = false;
+		bool cached = i == 0 && primaryCacheMode == PRIMARY_CACHE_READ && readPrimaryCache(ray, bentRay, hitInfo, singular);
 
-		if (hit.didHit && hit.distance < closestHit.distance)
+		if (cached ? singular : isSingularity(ray))
 		{
-			closestHit.didHit = true;
-			closestHit.distance = hit.distance;
-			closestHit.hitNormal = hit.hitNormal;
-			closestHit.hitPoint = ray.origin + ray.direction * hit.distance;
-			closestHit.material = mat;
+			rayColor = vec3(0);
+			if(i == 0) discard;
+			break;
 		}
-	}
-
-	return closestHit;
-}
-
-float random(inout int state)
-{
-	state = state * 747796405 + 2891336453;
-	int result = ((state >> ((state) >> 28) + 4) ^ state) * 277803737;
-	result = (result >> 22) ^ result;
-	return result / 4294967295.0;
-}
-
-float randomNormalDistribution(inout int state)
-{
-	float theta = 2 * 3.1415926 * random(state);
-	float rho = sqrt(-2 * log(random(state)));
-	return rho * cos(theta);
-}
 
-vec3 randomDirection(inout int state)
-{
-	float x = randomNormalDistribution(state);
-	float y = randomNormalDistribution(state);
-	float z = randomNormalDistribution(state);
-	return normalize(vec3(x, y, z));
-}
+		if (!cached)
+		{
+			bentRay = calculateBending(ray);
 
-vec3 randomHemisphereDirection(vec3 normal, inout int state)
-{
-	vec3 dir = randomDirection(state);
-	return dir * sign(dot(normal, dir));
-}
+			if (i > 0 || !hybridFirstHit || !rasterFirstHit(ray, bentRay, hitInfo))
+			{
+				hitInfo = CalculateRayCollision(bentRay, i);
+			}
+		}
 
-vec3 getEnvironmentLight(Ray ray)
-{
-	float skyGradientT = pow(smoothstep(0.0, 0.4, ray.direction.y), 0.35);
-	vec3 skyGradient = mix(skyMaterial.skyColorHorizon.rgb, skyMaterial.skyColorZenith.rgb, skyGradientT);
-	float sun = pow(max(0, dot(ray.direction, -skyMaterial.sunDirection)), skyMaterial.sunFocus) * skyMaterial.sunIntensity;
+		if (hitInfo.didHit)
+		{
+			RayTracingMaterial material = hitInfo.material;
+			vec3 emittedLight = material.emission.rgb * material.emission.a;
+			incomingLight += emittedLight * rayColor;
 
-	float groundToSkyT = smoothstep(-0.01, 0.0, ray.direction.y);
-	float sunMask = float(int(groundToSkyT >= 1));
-	return mix(skyMaterial.groundColor.rgb, skyGradient, groundToSkyT) + sun * sunMask * skyMaterial.sunColor.rgb;
-}
+			vec3 view = -normalize(bentRay.direction);
+			vec3 normal = dot(hitInfo.hitNormal, view) < 0 ? -hitInfo.hitNormal : hitInfo.hitNormal;
 
-float angleBetweenVectors(vec3 vecA, vec3 vecB) 
-{
-	return acos(dot(vecA, vecB) / (length(vecA) * length(vecB)));
-}
+			if (i == 0 && !gBufferWritten)
+			{
+				writeGBuffer(hitInfo, normal);
+			}
 
-bool isSingularity(Ray ray)
-{
-	for (int i = 0; i < gravityBodies.length(); i++)
-	{
-		vec3 source = gravityBodies[i].posmass.xyz;
+			vec3 weight = scatterRay(ray, hitInfo, normal, view, rng, diffusePdf);
 
-		vec3 toSourceVector = source - ray.origin;
+			// the last bounce's continuation is never traced, so the sky is not sampled there either
+			if (environmentSampling && diffusePdf > 0 && i < maxBounces)
+			{
+				incomingLight += sampleEnvironmentDirect(hitInfo.hitPoint, normal, material.color.rgb, rng) * rayColor;
+			}
+			else
+			{
+				diffusePdf = 0;
+			}
 
-		float distance = distance(source, ray.origin);
+			rayColor *= weight;
 
-		float closestDistance = distance * sin(angleBetweenVectors(toSourceVector, ray.direction));
-		float rayLength = distance * cos(angleBetweenVectors(toSourceVector, ray.direction));
+			if (dot(rayColor, rayColor) == 0)
+			{
+				break;
+			}
 
-		vec3 closestPoint = ray.origin + (ray.direction * rayLength);
-		vec3 closestPointToSourceVector = source - closestPoint;
+			debugNormal = hitInfo.hitNormal;
+		}
+		else
+		{
+			if (i == 0 && !gBufferWritten)
+			{
+				writeGBuffer(hitInfo, vec3(0));
+			}
 
-		vec3 changeVector = normalize(closestPointToSourceVector) * (1 / (closestDistance * closestDistance));
+			vec3 environment = getEnvironmentLight(bentRay);
 
-		vec3 newRayDirection = ray.direction + changeVector;
+			// the bounce before also sampled the sky directly, the two estimates are weighted against each other
+			if (diffusePdf > 0)
+			{
+				environment *= misWeight(diffusePdf, environmentPdf(normalize(ray.direction)));
+			}
 
-		if (angleBetweenVectors(newRayDirection, ray.direction) > 0.729548)
-		{
-			return true;
+			incomingLight += environment * rayColor;
+			break;
 		}
 	}
 
-	return false;
+	return incomingLight;
 }
 
-Ray calculateBending(Ray ray) 
+vec3 drawFrame(Ray ray, inout SamplerState rng, uint firstSample, int maxRaysPerPixel, int maxBounces)
 {
-	for (int i = 0; i < gravityBodies.length(); i++)
-	{
-		vec3 source = gravityBodies[i].posmass.xyz;
-
-		vec3 toSourceVector = source - ray.origin;
-
-		float distance = distance(source, ray.origin);
+	vec3 total = vec3(0);
 
-		float closestDistance = distance * sin(angleBetweenVectors(toSourceVector, ray.direction));
-		float rayLength = distance * cos(angleBetweenVectors(toSourceVector, ray.direction));
+	for (int i = 0; i < maxRaysPerPixel; i++)
+	{
+		beginSample(rng, firstSample + uint(i));
+		total += trace(offsetRay(ray, blur, rng), rng, maxBounces);
+	}
 
-		vec3 closestPoint = ray.origin + (ray.direction * rayLength);
-		vec3 closestPointToSourceVector = source - closestPoint;
+	return total / maxRaysPerPixel;
+}
 
-		vec3 changeVector = normalize(closestPointToSourceVector) * (1 / (closestDistance * closestDistance));
+// where the previous camera saw a point, or a sky direction, in pixels
+vec2 previousPixel(vec3 point, bool sky)
+{
+	vec3 cw = normalize(previousCameraDirection);
+	vec3 cu = normalize(cross(cw, vec3(0.0, 1.0, 0.0)));
+	vec3 cv = cross(cu, cw);
 
-		vec3 newRayDirection = ray.direction + changeVector;
+	vec3 direction = sky ? point : point - previousCameraPosition;
+	vec3 local = vec3(dot(direction, cu), dot(direction, cv), dot(direction, cw));
 
-		ray.direction = newRayDirection;
-		ray.invDirection = 1 / ray.direction;
+	if (local.z <= 0)
+	{
+		return vec2(-1);
 	}
 
-	return ray;
+	return local.xy / local.z * length(previousCameraDirection) * screenCenter.y + screenCenter;
 }
 
-
-vec3 trace(Ray ray, inout int rngState, int maxBounces)
+// bilinear fetch of the previous accumulation where this pixel's surface was, taps that saw sky
+// or a surface at another depth or facing another way are dropped as disoccluded. bending is
+// ignored, so close to gravity bodies this is approximate and relies on the shorter history
+vec4 reprojectHistory(vec3 primaryDirection)
 {
-	vec3 incomingLight = vec3(0);
-	vec3 rayColor = vec3(1);
+	if (!cameraMoved)
+	{
+		return texelFetch(texture0, ivec2(gl_FragCoord.xy), 0);
+	}
 
-	vec3 debugNormal = vec3(0);
+	bool sky = gBufferNormalDepth.w <= 0;
+	vec2 position = previousPixel(sky ? primaryDirection : gBufferHitPoint, sky) * previousRenderScale - 0.5;
+	ivec2 previousSize = ivec2(ceil(resolution * previousRenderScale));
+	ivec2 base = ivec2(floor(position));
+	vec2 fraction = position - base;
+	float previousDistance = distance(previousCameraPosition, gBufferHitPoint);
+
+	vec4 sum = vec4(0);
+	float weightSum = 0;
 
-	for (int i = 0; i <= maxBounces; i++)
+	for (int i = 0; i < 4; i++)
 	{
-		if (isSingularity(ray))
+		ivec2 offset = ivec2(i & 1, i >> 1);
+		ivec2 tap = base + offset;
+
+		if (any(lessThan(tap, ivec2(0))) || any(greaterThanEqual(tap, previousSize)))
 		{
-			rayColor = vec3(0);
-			if(i == 0) discard;
-			break;
+			continue;
 		}
-		Ray bentRay = calculateBending(ray);
-		HitInfo hitInfo = CalculateRayCollision(bentRay, i);
-		if (hitInfo.didHit)
-		{
-			ray.origin = hitInfo.hitPoint;
-			vec3 specularDirection = reflect(ray.direction, hitInfo.hitNormal);
-			vec3 diffuseDirection = normalize(hitInfo.hitNormal + randomHemisphereDirection(hitInfo.hitNormal, rngState));
-						
-			ray.direction = normalize(mix(diffuseDirection, specularDirection, hitInfo.material.smoothness));
-			ray.invDirection = 1 / ray.direction;
-
-			RayTracingMaterial material = hitInfo.material;
-			vec3 emittedLight = material.emission.rgb * material.emission.a;
 
-			incomingLight += emittedLight * rayColor;
-			rayColor *= material.color.rgb;
+		vec4 normalDepth = texelFetch(previousNormalDepth, tap, 0);
 
-			debugNormal = hitInfo.hitNormal;
+		if ((normalDepth.w <= 0) != sky)
+		{
+			continue;
 		}
-		else
+
+		if (!sky && (abs(normalDepth.w - previousDistance) > 0.1 * previousDistance || dot(normalDepth.xyz, gBufferNormalDepth.xyz) < 0.9))
 		{
-			incomingLight += getEnvironmentLight(bentRay) * rayColor;
-			break;
+			continue;
 		}
-	}
 
-	return incomingLight;
-}
+		vec2 bilinear = mix(1 - fraction, fraction, vec2(offset));
+		float weight = bilinear.x * bilinear.y;
 
-Ray offsetRay(Ray ray, float offsetStrength, inout int rngState)
-{
-	ray.direction += normalize(randomDirection(rngState)) * offsetStrength;
-	ray.invDirection = 1/ray.direction;
-	return ray;
+		sum += texelFetch(texture0, tap, 0) * weight;
+		weightSum += weight;
+	}
+
+	// nothing usable under the footprint, start over from this frame
+	return weightSum < 0.01 ? vec4(0) : sum / weightSum;
 }
 
-vec3 drawFrame(Ray ray, inout int rngState, int maxRaysPerPixel, int maxBounces)
+// full rate inside a focus region, easing down to peripheryDensity over the next radius out.
+// the fraction left over is traced on that share of frames, ordered per pixel by a golden ratio
+// sequence so the skipped frames spread out evenly in time, this can come out as 0
+int foveatedRays(vec2 pixel, uint pixelIndex)
 {
-	vec3 total = vec3(0);
+	float weight = 0;
 
-	for (int i = 0; i < maxRaysPerPixel; i++)
+	for (int i = 0; i < numFocusRegions; i++)
 	{
-		total += trace(offsetRay(ray, blur, rngState), rngState, maxBounces);
+		weight = max(weight, 1 - smoothstep(1.0, 2.0, distance(pixel, focusRegions[i].xy) / focusRegions[i].z));
 	}
 
-	return total / maxRaysPerPixel;
+	float rays = mix(peripheryDensity, 1.0, weight) * raysPerPixel;
+	float dither = fract(uintToUnitFloat(hash(pixelIndex)) + float(frameIndex) * 0.618034);
+
+	return int(rays) + (dither < fract(rays) ? 1 : 0);
+}
+
+#ifdef TRAVERSAL_STATS
+vec3 heatmapColor(float t)
+{
+	t = clamp(t, 0.0, 1.0);
+	vec3 cold = mix(vec3(0, 0, 0.5), vec3(0, 1, 1), smoothstep(0.0, 0.33, t));
+	vec3 warm = mix(vec3(1, 1, 0), vec3(1, 0, 0), smoothstep(0.66, 1.0, t));
+	return mix(cold, warm, smoothstep(0.25, 0.75, t));
+}
+
+void writeTraversalStats(int samples)
+{
+	uint slot = (uint(gl_FragCoord.x) + uint(gl_FragCoord.y) * 131u) % TRAVERSAL_STAT_SLOTS;
+	addTraversalStat(slot * 4u + 0u, uint(statNodeVisits));
+	addTraversalStat(slot * 4u + 1u, uint(statTriangleTests));
+	addTraversalStat(slot * 4u + 2u, uint(statBendingEvaluations));
+	addTraversalStat(slot * 4u + 3u, uint(statRays));
+
+	float count = heatmap == 1 ? statNodeVisits : heatmap == 2 ? statTriangleTests : statBendingEvaluations;
+	out_color = vec4(heatmapColor(count / max(1, samples) / heatmapRange), 1);
 }
+#endif
 
 void main()
 {
 	vec2 UV = gl_FragCoord.xy / resolution;
 
-	vec2 nCoord = (gl_FragCoord.xy - screenCenter.xy) / screenCenter.y;
+	vec2 nCoord = (gl_FragCoord.xy / renderScale - screenCenter.xy) / screenCenter.y;
 	mat3 cameraMatrix = setCamera();
 
 	float focalLength = length(cameraDirection);
@@ -479,42 +488,66 @@ void main()
 	ray.direction = rayDirection;
 	ray.invDirection = 1/rayDirection;
 
-	int pixelIndex = int(gl_FragCoord.y * gl_FragCoord.x);
+	uvec2 coord = uvec2(gl_FragCoord.xy);
+	uint pixelIndex = coord.x + coord.y * uint(resolution.x);
 
-	int rngState = pixelIndex + numRenderedFrames * 719393;
+	// accumulated frames continue one sequence, without accumulation every frame takes fresh samples
+	uint firstSample = denoise ? uint(sampleOffset) : uint(frameIndex);
+	SamplerState rng = createSampler(coord, pixelIndex, firstSample);
 
-	vec3 render;
+	vec3 render = vec3(0);
+	int rays = denoise ? raysPerPixel : 1;
 
-	if (!pause)
+	if (denoise && peripheryDensity < 1)
 	{
-		if (denoise)
-		{
-			render = drawFrame(ray, rngState, raysPerPixel, maxBounces);
-		}
-		else
-		{
-			render = drawFrame(ray, rngState, 1, 1);
-		}
+		rays = foveatedRays(gl_FragCoord.xy / renderScale, pixelIndex);
+	}
+
+	if (primaryCacheMode == PRIMARY_CACHE_RECORD)
+	{
+		recordPrimaryCache(ray);
 	}
 
-	float weight = 1.0 / (numRenderedFrames + 1);
-	vec3 accumulatedAverage = vec3(1);
+	if (!pause && rays > 0)
+	{
+		render = drawFrame(ray, rng, firstSample, rays, denoise ? maxBounces : 1);
+	}
+	else
+	{
+		tracePrimaryGBuffer(ray);
+	}
+
+	out_normalDepth = gBufferNormalDepth;
+	out_albedo = gBufferAlbedo;
+	out_emission = gBufferEmission;
 
 	if (denoise)
 	{
-		if (!pause)
+		vec4 history = historyValid ? reprojectHistory(rayDirection) : vec4(0);
+
+		// a skipped pixel with no history to show traces after all
+		if (!pause && rays == 0 && history.a == 0)
+		{
+			rays = 1;
+			render = drawFrame(ray, rng, firstSample, rays, maxBounces);
+		}
+
+		if (!pause && rays > 0)
 		{
-			accumulatedAverage = ((texture(texture0, fragTexCoord).xyz * (1 - weight)) + (render * weight));
+			float historyLength = min(history.a, maxHistory);
+			out_color = vec4((history.rgb * historyLength + render) / (historyLength + 1), historyLength + 1);
 		}
 		else
 		{
-			accumulatedAverage = texture(texture0, fragTexCoord).xyz;
+			out_color = history;
 		}
-
-		out_color = vec4(accumulatedAverage, 1);
 	}
 	else
 	{
 		out_color = vec4(render, 1);
 	}
+
+#ifdef TRAVERSAL_STATS
+	writeTraversalStats(rays);
+#endif
 }
\ No newline at end of file
@@ -0,0 +1,56 @@
+#version 430
+
+// brings the bottom left renderScale of texture0 up to the full resolution, the bilinear taps are
+// weighted by how well their surface matches the nearest one so edges stay sharp instead of bleeding
+
+in vec2 fragTexCoord;
+
+uniform sampler2D texture0;
+uniform sampler2D gNormalDepth;
+
+uniform float renderScale;
+uniform vec2 renderSize;
+
+out vec4 out_color;
+
+void main()
+{
+	vec2 position = gl_FragCoord.xy * renderScale - 0.5;
+	ivec2 base = ivec2(floor(position));
+	vec2 fraction = position - base;
+	ivec2 maxTexel = ivec2(renderSize) - 1;
+
+	// the tap closest to this pixel decides which surface it belongs to
+	ivec2 nearest = clamp(ivec2(floor(position + 0.5)), ivec2(0), maxTexel);
+	vec4 reference = texelFetch(gNormalDepth, nearest, 0);
+	bool referenceSky = reference.w <= 0;
+
+	vec3 sum = vec3(0);
+	float weightSum = 0;
+
+	for (int i = 0; i < 4; i++)
+	{
+		ivec2 offset = ivec2(i & 1, i >> 1);
+		ivec2 tap = clamp(base + offset, ivec2(0), maxTexel);
+
+		vec4 normalDepth = texelFetch(gNormalDepth, tap, 0);
+		bool sky = normalDepth.w <= 0;
+
+		float geometryWeight = 0;
+
+		if (sky == referenceSky)
+		{
+			geometryWeight = sky ? 1.0 : pow(max(0, dot(reference.xyz, normalDepth.xyz)), 16.0)
+				* exp(-abs(reference.w - normalDepth.w) / (0.05 * reference.w));
+		}
+
+		vec2 bilinear = mix(1 - fraction, fraction, vec2(offset));
+		float weight = bilinear.x * bilinear.y * geometryWeight;
+
+		sum += texelFetch(texture0, tap, 0).rgb * weight;
+		weightSum += weight;
+	}
+
+	vec3 color = weightSum > 0.0001 ? sum / weightSum : texelFetch(texture0, nearest, 0).rgb;
+	out_color = vec4(color, 1);
+}
@@ -0,0 +1,42 @@
+// buffers of the wavefront passes, see WavefrontTracer.h, bindings 0 to 4 are the scene's
+
+// a path that continues past its first hit, with the sampler state to pick it up where the primary pass left it
+struct WavefrontRay
+{
+	vec3 origin;
+	uint pixel;
+	vec3 direction;
+	// bin the ray was sorted into, only valid after the histogram pass
+	uint key;
+	vec3 throughput;
+	uint sampleIndex;
+	uint dimension;
+	uint pcgState;
+	uint padding0;
+	uint padding1;
+};
+
+layout(std430, binding = 5) restrict buffer WavefrontCounters
+{
+	uint rayCount;
+	uint nodeFetches;
+	uint nodeCacheHits;
+	uint counterPadding;
+};
+
+// in the order the primary pass emitted them
+layout(std430, binding = 6) restrict buffer RayBuffer
+{
+	WavefrontRay rays[];
+};
+
+// the rays the trace pass walks, the binned copy or RayBuffer itself when binning is off
+layout(std430, binding = 7) restrict buffer TraceRayBuffer
+{
+	WavefrontRay traceRays[];
+};
+
+layout(std430, binding = 9) restrict buffer RadianceBuffer
+{
+	vec4 radiance[];
+};